@@ -8,6 +8,13 @@
 #include <netinet/in.h>//for sockaddr_in
 #include <arpa/inet.h>//for socket 
 #include <communication/packet.hpp>
+#include <communication/service_executor.hpp>
+#include <communication/multicast.hpp>
+#include <communication/link_probe.hpp>
+#include <communication/topic_bridge.hpp>
+#ifdef BR_USE_IO_URING
+#include <communication/uring_link.hpp>
+#endif
 #include <thread>
 #include <serial/serial.h>
 #include <tf/transform_broadcaster.h>
@@ -18,6 +25,7 @@
 #include <communication/rings.h>
 #include <communication/shoot_aid.h>
 #include <communication/set_field.h>
+#include <communication/link_quality.h>
 #define reply 0x02
 #define pcdata 0x01
 #define needreply 0x00
@@ -36,6 +44,9 @@ class Communicator
         void UDPinit();
         static void robotUDPrece(target_ *,br_packet::Packet*);
         static void controllerUDPrece(target_ *,br_packet::Packet*);
+        static void updatePeer(target_ *,const sockaddr_in*);
+        bool uringInit();
+        void pollLink(double);
         void rosInit();
         void exampleCallback(uint8_t*, uint16_t);
         void example_ros_Callback(const std_msgs::UInt8&);
@@ -45,8 +56,14 @@ class Communicator
         void port2_sub_ros_Callback(const communication::rings&);
         static void controller_port2_Callback(uint8_t*, uint16_t);
         static void controller_port3_Callback(uint8_t*,uint16_t);
+        static void robot_probe_Callback(uint8_t*,uint16_t);
+        static void controller_probe_Callback(uint8_t*,uint16_t);
+        void probeUpdate();
         target controller,robot;
         br_packet::Packet robotPacket,controllerPacket; 
+        static br_packet::ServiceExecutor service_executor;
+        br_packet::TopicBridge<br_packet::Packet> topic_bridge;
+        bool use_io_uring;
         ros::NodeHandle nh_,nh_local_;
     private:
         
@@ -56,12 +73,30 @@ class Communicator
         static ros::Subscriber example_sub;
         static ros::Subscriber port2_sub;
         static ros::ServiceClient set_field_client;
+        static ros::Publisher link_pub;
+        static br_packet::LinkProbe robot_probe,controller_probe;
+#ifdef BR_USE_IO_URING
+        static br_packet::UringLink* uring_link;
+#endif
         std::string example_pub_topic;
         std::string example_sub_topic;
         std::string port2_sub_topic;
         std::string port2_pub_topic;
         std::string port3_pub_topic;
         std::string set_field_srv;
+        int service_workers;
+        int service_queue;
+        double service_timeout;
+        std::string robot_multicast_group;
+        std::string controller_multicast_group;
+        int multicast_ttl;
+        bool multicast_loop;
+        std::string link_quality_topic;
+        double link_probe_rate;
+        double link_probe_timeout;
+        int link_probe_window;
+        double link_report_rate;
+        ros::Time last_report;
 
 };
 // br_packet::Packet robotPacket,comtrollerPacket;
@@ -71,4 +106,11 @@ ros::Publisher Communicator::port3_pub;
 ros::Subscriber Communicator::example_sub;
 ros::Subscriber Communicator::port2_sub;
 ros::ServiceClient Communicator::set_field_client;
+br_packet::ServiceExecutor Communicator::service_executor;
+ros::Publisher Communicator::link_pub;
+br_packet::LinkProbe Communicator::robot_probe;
+br_packet::LinkProbe Communicator::controller_probe;
+#ifdef BR_USE_IO_URING
+br_packet::UringLink* Communicator::uring_link = nullptr;
+#endif
 #endif
\ No newline at end of file
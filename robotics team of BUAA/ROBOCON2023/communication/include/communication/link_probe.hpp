@@ -0,0 +1,107 @@
+#ifndef BR_LINK_PROBE
+#define BR_LINK_PROBE
+#include <stdint.h>
+#include <array>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+// 心跳占用的保留端口，各节点其它回调不要使用
+#define LINK_PROBE_PORT 15
+
+namespace br_packet{
+    // 主动心跳探测：按固定频率发 ping（pcdata 帧），对端原样回 pong，
+    // 统计 RTT、抖动与丢包，直方图按秒分片滚动，只保留最近 window 秒
+    // ping/pong 载荷：kind(1) seq(4) 发送时刻ns(8)，后两项只由发送方解析，对端不需要关心字节序
+    class LinkProbe{
+        public:
+            typedef std::function<void(uint8_t*, uint16_t)> send_func;
+            static const int PAYLOAD_LEN = 13;
+            static const int BUCKET_NUM = 11;   // 10个边界 + 溢出格
+
+            struct Summary{
+                double window = 0;
+                uint32_t sent = 0;
+                uint32_t received = 0;
+                uint32_t lost = 0;
+                double loss_rate = 0;
+                double rtt_min = 0, rtt_mean = 0, rtt_max = 0;  // ms
+                double rtt_p50 = 0, rtt_p95 = 0;
+                double jitter = 0;
+                double last_reply_age = -1;  // 从未收到时为 -1
+                std::array<uint32_t, BUCKET_NUM> hist{};
+            };
+
+            LinkProbe() = default;
+            LinkProbe(const LinkProbe&) = delete;
+            // rate 为0时只回 pong 不主动探测；timeout 秒内没有回应记为丢包
+            void init(send_func send, double rate, double timeout = 1.0, int window = 10);
+            // 在主循环中调用：到时间就发 ping，检查超时，滚动分片
+            void tick();
+            // 保留端口上收到帧时调用（可在接收线程中）
+            void onFrame(uint8_t *data, uint16_t len);
+            Summary summary();
+            bool enabled() { return rate_ > 0; }
+            // 直方图边界，ms
+            static const std::array<double, BUCKET_NUM - 1> &bounds();
+            // 链路状态：idle 未探测，down 窗口内没有回应，degraded 丢包超过10%，ok
+            static const char *state(const Summary &sum);
+        private:
+            typedef std::chrono::steady_clock clock;
+            static const int SLICE_NUM = 60;
+            static const int TRACK_NUM = 256;
+
+            struct Slice{
+                uint32_t sent = 0, received = 0, lost = 0;
+                double rtt_sum = 0, rtt_min = 0, rtt_max = 0;
+                std::array<uint32_t, BUCKET_NUM> hist{};
+            };
+            struct Track{
+                uint32_t seq = 0;
+                int64_t stamp = 0;
+                bool pending = false;
+            };
+
+            static int64_t now();
+            void record(double rtt);
+            void expire(int64_t t);
+
+            std::mutex mutex_;
+            send_func send_;
+            double rate_ = 0;
+            int64_t timeout_ = 0;
+            int window_ = 10;
+            int64_t next_ping_ = 0;
+            int64_t slice_start_ = 0;
+            int64_t last_reply_ = 0;
+            uint32_t seq_ = 0;
+            double last_rtt_ = -1;
+            double jitter_ = 0;
+            int cur_ = 0;
+            std::array<Slice, SLICE_NUM> slices_;
+            std::array<Track, TRACK_NUM> track_;
+    };
+
+    // 填充 communication::link_quality，模板化以免本文件依赖生成的消息头
+    template <class Msg>
+    void toMsg(const LinkProbe::Summary &sum, Msg &msg)
+    {
+        msg.window = sum.window;
+        msg.sent = sum.sent;
+        msg.received = sum.received;
+        msg.lost = sum.lost;
+        msg.loss_rate = sum.loss_rate;
+        msg.rtt_min = sum.rtt_min;
+        msg.rtt_mean = sum.rtt_mean;
+        msg.rtt_max = sum.rtt_max;
+        msg.rtt_p50 = sum.rtt_p50;
+        msg.rtt_p95 = sum.rtt_p95;
+        msg.jitter = sum.jitter;
+        msg.last_reply_age = sum.last_reply_age;
+        msg.rtt_bounds.assign(LinkProbe::bounds().begin(), LinkProbe::bounds().end());
+        msg.rtt_hist.assign(sum.hist.begin(), sum.hist.end());
+    }
+}
+
+#endif
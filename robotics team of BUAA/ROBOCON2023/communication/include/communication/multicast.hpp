@@ -0,0 +1,69 @@
+#ifndef BR_MULTICAST
+#define BR_MULTICAST
+#include <communication/target.hpp>
+#include <communication/link_probe.hpp>
+#include <string>
+#include <cstring>
+
+namespace br_packet{
+    // 发送端组播选项：从 iface 网卡发出，ttl 为1时不出本网段，loop 决定本机其它进程能否收到
+    inline bool setMulticastOptions(int fd, struct in_addr iface, int ttl, bool loop)
+    {
+        unsigned char cttl = ttl, cloop = loop ? 1 : 0;
+        if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) != 0 ||
+            setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &cttl, sizeof(cttl)) != 0 ||
+            setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &cloop, sizeof(cloop)) != 0) {
+            perror("multicast setsockopt error!\n");
+            return false;
+        }
+        return true;
+    }
+
+    inline bool makeGroupAddr(struct sockaddr_in *addr, const std::string &group, int port)
+    {
+        memset(addr, 0, sizeof(*addr));
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(port);
+        addr->sin_addr.s_addr = inet_addr(group.c_str());
+        return IN_MULTICAST(ntohl(addr->sin_addr.s_addr));
+    }
+
+    // 组播发布：pcdata帧（type 1，不需要应答）只发一次到组播组，所有订阅者都能收到；
+    // 需要应答的命令和应答帧仍单播到 addr_to
+    inline bool setMulticastSender(target *t_adr, const std::string &group, int port, int ttl, bool loop)
+    {
+        t_adr->multicast_ = false;
+        if (group.empty()) return false;
+        if (!makeGroupAddr(&t_adr->addr_group, group, port)) {
+            printf("%s: %s is not a multicast address\n", t_adr->Name_.c_str(), group.c_str());
+            return false;
+        }
+        if (!setMulticastOptions(t_adr->fd, t_adr->addr_from.sin_addr, ttl, loop)) return false;
+        t_adr->multicast_ = true;
+        return true;
+    }
+
+    // 监听端（第二个操作台、记录用电脑）加入组播组
+    inline bool joinMulticastGroup(int fd, const std::string &group, const std::string &iface)
+    {
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr.s_addr = inet_addr(group.c_str());
+        mreq.imr_interface.s_addr = iface.empty() ? htonl(INADDR_ANY) : inet_addr(iface.c_str());
+        return setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0;
+    }
+
+    // 帧格式见 Packet::sendData：0xFF, len(2), type<<6|level<<4|port, id, data..., sum
+    inline bool isPcdataFrame(const uint8_t *data, uint16_t len)
+    {
+        return len >= 6 && data[0] == 0xFF && (data[3] >> 6) == 1;
+    }
+
+    // 选择发送地址：组播模式下pcdata帧走组播，其余走单播；心跳只测到对端的单播链路
+    inline const struct sockaddr_in *frameDestination(const target *t_adr, const uint8_t *data, uint16_t len)
+    {
+        if (t_adr->multicast_ && isPcdataFrame(data, len) && (data[3] & 0x0F) != LINK_PROBE_PORT) return &t_adr->addr_group;
+        return &t_adr->addr_to;
+    }
+}
+
+#endif
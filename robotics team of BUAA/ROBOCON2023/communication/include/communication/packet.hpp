@@ -8,6 +8,8 @@
 #include <ctime>
 #include <cstring>
 #include <iostream>
+#include <functional>
+#include <mutex>
 
 #define PORT_NUM 16
 #define LEVEL_NUM 4
@@ -15,7 +17,8 @@
 #define FIX 6
 class Communicator;
 namespace br_packet{
-    typedef void(*port_func)(uint8_t*, uint16_t);
+    // 可以是普通函数，也可以是带上下文的 lambda（如 TopicBridge）
+    typedef std::function<void(uint8_t*, uint16_t)> port_func;
     typedef void(*output_func)(uint8_t*, uint16_t, target*);
 
 
@@ -34,7 +37,15 @@ namespace br_packet{
             void setPortCallback(port_func port_callback, int port);
             void receiveHanlder(uint8_t *data, uint16_t len);
             bool sendData(uint8_t *data, uint16_t len, int type, int port, int level);
+            // 直接在发送缓冲区里写载荷，省去一次拷贝：先取 payloadBuffer()，写入 len 字节后调用 sendPayload
+            // 发送缓冲区各线程共用，写载荷到 sendPayload 返回之间要持有 sendMutex()
+            uint8_t *payloadBuffer() { return send_buff_ + 5; }
+            uint16_t payloadCapacity() { return BUFF_SIZE - FIX; }
+            bool sendPayload(uint16_t len, int type, int port, int level);
+            bool hasPortCallback(int port) { return port >= 0 && port < PORT_NUM && port_callback_[port]; }
             bool update();
+            // sendData/sendPayload/update 和应答处理都在这把锁下改发送状态；接收线程回 pong、应答时也会发送，所以可重入
+            std::recursive_mutex &sendMutex() { return send_mutex_; }
             void reset();
             float getTime();
             target * target_;
@@ -68,9 +79,10 @@ namespace br_packet{
             uint8_t *buff_[LEVEL_NUM];
             uint16_t max_len_[LEVEL_NUM] = {BUFF_SIZE / 4, BUFF_SIZE / 4, BUFF_SIZE / 4, BUFF_SIZE};
 
-            port_func port_callback_[PORT_NUM];
+            port_func port_callback_[PORT_NUM];//未注册的端口收到数据直接忽略
 
             output_func output_ = nullptr;
+            std::recursive_mutex send_mutex_;
 
             void type0Callback();
             void type1Callback();
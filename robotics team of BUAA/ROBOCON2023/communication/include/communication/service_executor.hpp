@@ -0,0 +1,90 @@
+#ifndef BR_SERVICE_EXECUTOR
+#define BR_SERVICE_EXECUTOR
+#include <ros/ros.h>
+#include <stdint.h>
+#include <deque>
+#include <list>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+namespace br_packet{
+    // ros service 异步调用：收发线程只负责提交请求，service 在工作线程中阻塞，
+    // 结果（或超时）由主循环调用 update() 按端口回送，收发链路永远不会等 service
+    // ros::ServiceClient::call 没有超时，卡住的调用超过期限后由 update() 放弃该工作线程并补一个新的，
+    // 被放弃的线程在 call 返回后自行退出；同时卡住的线程最多 max_stuck 个
+    class ServiceExecutor{
+        public:
+            typedef std::chrono::steady_clock clock;
+
+            ServiceExecutor() = default;
+            ServiceExecutor(const ServiceExecutor&) = delete;
+            ~ServiceExecutor();
+            void init(int workers, int capacity, double timeout, int max_stuck = 4);
+            // 队列满时返回false，请求被丢弃；done(port, ok, srv) 在 update() 所在线程中执行
+            template <class Srv>
+            bool submit(const ros::ServiceClient &client, const Srv &srv, int port,
+                        std::function<void(int, bool, const Srv&)> done);
+            // call 在工作线程中执行，done(ok) 在 update() 所在线程中执行
+            bool submit(int port, std::function<bool()> call, std::function<void(bool)> done);
+            void update();
+            void shutdown();
+            int pending();
+            int stuck();    // 已放弃、call 仍未返回的线程数
+        private:
+            struct Job{
+                uint32_t id = 0;
+                int port = 0;
+                clock::time_point deadline;
+                std::function<bool()> call;
+                std::function<void(bool)> done;
+                bool finished = false;
+                bool ok = false;
+            };
+            typedef std::shared_ptr<Job> JobPtr;
+
+            struct Worker{
+                JobPtr job;             // 正在调用的请求
+                bool abandoned = false;
+            };
+            typedef std::shared_ptr<Worker> WorkerPtr;
+
+            // 工作线程持有 State，被放弃的线程在 ServiceExecutor 析构后仍可安全退出
+            struct State{
+                std::mutex mutex;
+                std::condition_variable cond;
+                std::deque<JobPtr> queue;      // 等待工作线程
+                std::list<JobPtr> inflight;    // 已提交、尚未回送
+                int stuck = 0;
+                bool running = false;
+            };
+
+            static void workLoop(std::shared_ptr<State> state, WorkerPtr self);
+            void spawn();   // 调用时需持有 state_->mutex
+
+            std::shared_ptr<State> state_ = std::make_shared<State>();
+            std::vector<std::pair<WorkerPtr, std::thread> > workers_;
+            int capacity_ = 0;
+            int max_stuck_ = 0;
+            clock::duration timeout_ = std::chrono::milliseconds(500);
+            uint32_t next_id_ = 0;
+    };
+
+    template <class Srv>
+    bool ServiceExecutor::submit(const ros::ServiceClient &client, const Srv &srv, int port,
+                                 std::function<void(int, bool, const Srv&)> done)
+    {
+        std::shared_ptr<Srv> data = std::make_shared<Srv>(srv);
+        std::shared_ptr<const Srv> orig = std::make_shared<const Srv>(srv);
+        ros::ServiceClient cli = client;
+        // 超时时工作线程可能仍在写 data，只回送原始请求
+        return submit(port, [cli, data]() mutable { return cli.call(*data); },
+                      [done, data, orig, port](bool ok) { if (done) done(port, ok, ok ? *data : *orig); });
+    }
+}
+
+#endif
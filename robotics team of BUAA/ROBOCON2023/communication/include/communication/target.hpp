@@ -12,4 +12,6 @@ typedef struct target{
     int fd;//套接字
     struct sockaddr_in addr_to;//目标地址
     struct sockaddr_in addr_from;//本机地址
+    bool multicast_ = false;//pcdata帧是否走组播
+    struct sockaddr_in addr_group;//组播地址
 }target_;
\ No newline at end of file
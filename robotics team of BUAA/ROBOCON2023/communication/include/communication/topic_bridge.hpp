@@ -0,0 +1,214 @@
+#ifndef BR_TOPIC_BRIDGE
+#define BR_TOPIC_BRIDGE
+#include <ros/ros.h>
+#include <ros/serialization.h>
+#include <std_msgs/Bool.h>
+#include <std_msgs/UInt8.h>
+#include <std_msgs/Int32.h>
+#include <std_msgs/Float32.h>
+#include <std_msgs/Float64.h>
+#include <std_msgs/String.h>
+#include <std_msgs/Float32MultiArray.h>
+#include <geometry_msgs/Point.h>
+#include <geometry_msgs/Pose2D.h>
+#include <geometry_msgs/Twist.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <communication/head_angle.h>
+#include <communication/ring.h>
+#include <communication/rings.h>
+#include <communication/target_pole.h>
+#include <communication/location_msg.h>
+#include <communication/link_probe.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef PORT_NUM
+#error "include packet.hpp or packet_serial.hpp before topic_bridge.hpp"
+#endif
+
+namespace br_packet{
+    // 由参数配置的 topic <-> 端口通用转发，新增一条链路只需要改 yaml：
+    //   bridge_links:
+    //     - {topic: /head_angle, type: communication/head_angle, port: 5, dir: rx}
+    //     - {topic: /compensation, type: geometry_msgs/Pose2D, port: 6, dir: tx, level: 0, reliable: false, peer: serial}
+    // 载荷就是消息的 ros 序列化结果：发送时直接序列化进 Packet 的发送缓冲区，
+    // 接收时直接从接收缓冲区反序列化进每条链路复用的消息对象
+    // 一帧的载荷只有 payloadCapacity() 字节，空消息都放不下的类型在加载时拒绝
+    // PacketT 为 packet.hpp 或 packet_serial.hpp 中的 Packet
+    template <class PacketT>
+    class TopicBridge{
+        public:
+            struct LinkConfig{
+                std::string topic;
+                std::string type;
+                std::string peer;
+                int port = -1;
+                int level = 0;
+                bool reliable = false;  // true 用需要应答的 type 0 帧，否则 pcdata
+                bool tx = true;         // tx: topic -> 端口，rx: 端口 -> topic
+                int queue = 10;
+            };
+
+            // 读取 param 下的链路列表，packets 为 peer 名到 Packet 的映射，只有一个时 peer 可省略
+            // 返回成功建立的链路数
+            int load(ros::NodeHandle &nh, const std::string &param, const std::map<std::string, PacketT *> &packets)
+            {
+                XmlRpc::XmlRpcValue list;
+                if (!nh.getParam(param, list)) return 0;
+                if (list.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+                    ROS_WARN("%s should be a list of links", param.c_str());
+                    return 0;
+                }
+                int count = 0;
+                for (int i = 0; i < list.size(); ++i) {
+                    LinkConfig cfg;
+                    if (!parse(list[i], cfg)) {
+                        ROS_WARN("%s[%d] ignored: need topic, type and port", param.c_str(), i);
+                        continue;
+                    }
+                    PacketT *packet = nullptr;
+                    if (cfg.peer.empty() && packets.size() == 1) packet = packets.begin()->second;
+                    else if (packets.count(cfg.peer)) packet = packets.at(cfg.peer);
+                    if (!packet) {
+                        ROS_WARN("bridge %s: unknown peer '%s'", cfg.topic.c_str(), cfg.peer.c_str());
+                        continue;
+                    }
+                    if (add(nh, cfg, packet)) ++count;
+                }
+                return count;
+            }
+
+            // 不经过参数直接添加一条链路
+            template <class M>
+            bool addLink(ros::NodeHandle &nh, const LinkConfig &cfg, PacketT *packet)
+            {
+                if (cfg.port < 0 || cfg.port >= PORT_NUM || cfg.port == LINK_PROBE_PORT || cfg.level < 0 || cfg.level > 3) {
+                    ROS_WARN("bridge %s: invalid port %d / level %d", cfg.topic.c_str(), cfg.port, cfg.level);
+                    return false;
+                }
+                uint32_t min_len = ros::serialization::serializationLength(M());
+                if (min_len > packet->payloadCapacity()) {
+                    ROS_WARN("bridge %s: %s needs at least %u bytes, a frame carries %u", cfg.topic.c_str(), cfg.type.c_str(),
+                             min_len, (unsigned)packet->payloadCapacity());
+                    return false;
+                }
+                if (cfg.tx) {
+                    std::unique_ptr<TxLink<M> > link(new TxLink<M>(cfg, packet));
+                    link->sub = nh.subscribe(cfg.topic, cfg.queue, &TxLink<M>::callback, link.get());
+                    links_.push_back(std::move(link));
+                }
+                else {
+                    if (packet->hasPortCallback(cfg.port)) {
+                        ROS_WARN("bridge %s: port %d already in use", cfg.topic.c_str(), cfg.port);
+                        return false;
+                    }
+                    std::unique_ptr<RxLink<M> > link(new RxLink<M>(cfg));
+                    link->pub = nh.advertise<M>(cfg.topic, cfg.queue);
+                    RxLink<M> *raw = link.get();
+                    packet->setPortCallback([raw](uint8_t *data, uint16_t len) { raw->callback(data, len); }, cfg.port);
+                    links_.push_back(std::move(link));
+                }
+                ROS_INFO("bridge %s [%s] %s port %d level %d%s", cfg.topic.c_str(), cfg.type.c_str(),
+                         cfg.tx ? "->" : "<-", cfg.port, cfg.level, cfg.reliable ? " reliable" : "");
+                return true;
+            }
+
+            int size() { return links_.size(); }
+
+        private:
+            struct Link{
+                virtual ~Link() {}
+            };
+
+            template <class M>
+            struct TxLink : Link{
+                TxLink(const LinkConfig &c, PacketT *p): cfg(c), packet(p) {}
+                void callback(const typename M::ConstPtr &msg)
+                {
+                    uint32_t len = ros::serialization::serializationLength(*msg);
+                    if (len > packet->payloadCapacity()) {
+                        ROS_WARN_THROTTLE(1, "bridge %s: %u bytes do not fit in one frame", cfg.topic.c_str(), len);
+                        return;
+                    }
+                    std::lock_guard<std::recursive_mutex> lock(packet->sendMutex());
+                    ros::serialization::OStream stream(packet->payloadBuffer(), len);
+                    ros::serialization::serialize(stream, *msg);
+                    if (!packet->sendPayload(len, cfg.reliable ? 0 : 1, cfg.port, cfg.level))
+                        ROS_WARN_THROTTLE(1, "bridge %s: send queue of level %d full", cfg.topic.c_str(), cfg.level);
+                }
+                LinkConfig cfg;
+                PacketT *packet;
+                ros::Subscriber sub;
+            };
+
+            template <class M>
+            struct RxLink : Link{
+                RxLink(const LinkConfig &c): cfg(c) {}
+                void callback(uint8_t *data, uint16_t len)
+                {
+                    try {
+                        ros::serialization::IStream stream(data, len);
+                        ros::serialization::deserialize(stream, msg);
+                    }
+                    catch (ros::serialization::StreamOverrunException &e) {
+                        ROS_WARN_THROTTLE(1, "bridge %s: truncated payload (%u bytes)", cfg.topic.c_str(), len);
+                        return;
+                    }
+                    pub.publish(msg);
+                }
+                LinkConfig cfg;
+                M msg;  // 复用，避免每帧分配
+                ros::Publisher pub;
+            };
+
+            // 支持的消息类型，新类型加在这里；序列化后要能放进一帧（Odometry、PoseWithCovarianceStamped 都放不下）
+            template <class... Ms>
+            struct Types{
+                static bool add(TopicBridge *, ros::NodeHandle &, const LinkConfig &cfg, PacketT *)
+                {
+                    ROS_WARN("bridge %s: unsupported type %s", cfg.topic.c_str(), cfg.type.c_str());
+                    return false;
+                }
+            };
+            template <class M, class... Ms>
+            struct Types<M, Ms...>{
+                static bool add(TopicBridge *bridge, ros::NodeHandle &nh, const LinkConfig &cfg, PacketT *packet)
+                {
+                    if (cfg.type == ros::message_traits::datatype<M>()) return bridge->template addLink<M>(nh, cfg, packet);
+                    return Types<Ms...>::add(bridge, nh, cfg, packet);
+                }
+            };
+            typedef Types<std_msgs::Bool, std_msgs::UInt8, std_msgs::Int32, std_msgs::Float32, std_msgs::Float64,
+                          std_msgs::String, std_msgs::Float32MultiArray,
+                          geometry_msgs::Point, geometry_msgs::Pose2D, geometry_msgs::Twist,
+                          geometry_msgs::PoseStamped,
+                          communication::head_angle, communication::ring, communication::rings,
+                          communication::target_pole, communication::location_msg> SupportedTypes;
+
+            bool add(ros::NodeHandle &nh, const LinkConfig &cfg, PacketT *packet)
+            {
+                return SupportedTypes::add(this, nh, cfg, packet);
+            }
+
+            static bool parse(XmlRpc::XmlRpcValue &v, LinkConfig &cfg)
+            {
+                if (v.getType() != XmlRpc::XmlRpcValue::TypeStruct || !v.hasMember("topic") || !v.hasMember("type") || !v.hasMember("port"))
+                    return false;
+                cfg.topic = static_cast<std::string>(v["topic"]);
+                cfg.type = static_cast<std::string>(v["type"]);
+                cfg.port = static_cast<int>(v["port"]);
+                if (v.hasMember("peer")) cfg.peer = static_cast<std::string>(v["peer"]);
+                if (v.hasMember("level")) cfg.level = static_cast<int>(v["level"]);
+                if (v.hasMember("reliable")) cfg.reliable = static_cast<bool>(v["reliable"]);
+                if (v.hasMember("queue")) cfg.queue = static_cast<int>(v["queue"]);
+                if (v.hasMember("dir")) cfg.tx = static_cast<std::string>(v["dir"]) != "rx";
+                return true;
+            }
+
+            std::vector<std::unique_ptr<Link> > links_;
+    };
+}
+
+#endif
@@ -8,10 +8,18 @@
 #include <serial/serial.h>
 #include <pthread.h>
 #include <communication/packet_serial.hpp>
+#include <communication/service_executor.hpp>
+#include <communication/multicast.hpp>
+#include <communication/link_probe.hpp>
+#include <communication/topic_bridge.hpp>
+#ifdef BR_USE_IO_URING
+#include <communication/uring_link.hpp>
+#endif
 #include <tf/transform_broadcaster.h>
 // #include <find_cylinder/CylinderParam.h>
 #include <communication/head_angle.h>
 #include <communication/shoot_aid.h>
+#include <communication/link_quality.h>
 #include <std_msgs/UInt8.h>
 #include <std_msgs/Int32.h>
 #include <std_msgs/String.h>
@@ -25,6 +33,7 @@ bool serialinit();
 static void write(uint8_t*, uint16_t);
 void UDPreviceve();
 void UDPsend();
+void UDPforward(uint8_t*, uint16_t);
 bool UDPhand();
 void packfloat(float f, uint8_t* da_ad);
 void sendlocation();
@@ -35,9 +44,20 @@ void img_angle_callback(uint8_t*,uint16_t);
 void pos_callback(const nav_msgs::Odometry& msg);
 void port0_callback(uint8_t*,uint16_t);
 void shoot_aid_sub_callback(const std_msgs::UInt8& msg);
+void shoot_aid_response(int, bool, const communication::shoot_aid&);
+void link_probe_callback(uint8_t*,uint16_t);
+void link_report();
 void* TFpub(void*);
 serial::Serial ser;
 br_packet::Packet packet;
+br_packet::ServiceExecutor service_executor;
+br_packet::LinkProbe link_probe;//到下位机的串口链路
+br_packet::TopicBridge<br_packet::Packet> topic_bridge;
+#ifdef BR_USE_IO_URING
+br_packet::UringLink uring_link;
+int serial_fd = -1;
+#endif
+bool use_io_uring = false;
 uint8_t buff[1024],packbuff[100];
 float x, y, u16yaw;
 float xx, yy;
@@ -49,6 +69,9 @@ std::string img_angle_topic;
 std::string pos_topic;
 std::string shoot_aid_topic;
 std::string shoot_aid_srv;
+double shoot_aid_timeout;
+int shoot_aid_workers;
+int shoot_aid_queue;
 // tf::StampedTransform base_world;
 // tf::TransformBroadcaster tf_pub;
 // tf::Quaternion q;
@@ -60,7 +83,18 @@ ros::ServiceClient shoot_aid_client;
 int fd, r;
 struct sockaddr_in addr_to;//目标服务器地址
 struct sockaddr_in addr_from;
+struct sockaddr_in addr_group;//组播地址，串口上行数据发到这里
+bool multicast = false;
+bool multicast_unicast = true;//组播时是否仍单播给最近发命令的一端
+std::string multicast_group;
+int multicast_ttl;
+bool multicast_loop;
 
 std::string to_ip,from_ip;
 int to_hton, from_hton;
-std_msgs::String exam_msg;
\ No newline at end of file
+std::string node_state;//节点所处阶段，随链路统计一起发布
+ros::Publisher link_pub;
+ros::Time last_report;
+std::string link_quality_topic;
+double link_probe_rate, link_probe_timeout, link_report_rate;
+int link_probe_window;
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef BR_URING_LINK
+#define BR_URING_LINK
+#include <liburing.h>
+#include <netinet/in.h>//for sockaddr_in
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+namespace br_packet{
+    // 收到数据时回调：fd，数据，长度，来源地址（串口为nullptr）
+    typedef std::function<void(int, uint8_t*, uint16_t, const sockaddr_in*)> link_recv_func;
+
+    // io_uring 收发后端：UDP 用 multishot recvmsg 收进注册的缓冲环，
+    // 串口用缓冲选择的 read，所有发送先排队，poll()/flush() 时一次提交
+    // 接收回调只在 poll() 中执行；回调里可以发送，发送槽用完时只回收已完成的发送，不会重入回调
+    class UringLink{
+        public:
+            struct Stats{
+                uint64_t enter = 0;     // io_uring_enter 次数（即系统调用数）
+                uint64_t received = 0;
+                uint64_t sent = 0;
+                uint64_t dropped = 0;   // 发送槽用完被丢弃的帧
+                uint64_t errors = 0;
+            };
+
+            UringLink() = default;
+            UringLink(const UringLink&) = delete;
+            ~UringLink();
+            // buf_num 必须为2的幂
+            bool init(unsigned entries = 64, unsigned buf_num = 64, unsigned buf_size = 2048, unsigned send_slots = 64);
+            // 已断开的源（alive 为 false）的位置会被复用，串口断开后重新打开时直接再 addStream
+            bool addSocket(int fd, link_recv_func callback);
+            bool addStream(int fd, link_recv_func callback);
+            bool sendTo(int fd, const uint8_t *data, uint16_t len, const sockaddr_in *addr);
+            bool write(int fd, const uint8_t *data, uint16_t len);
+            int flush();
+            // 提交所有排队的请求，最多等待timeout秒，处理所有完成事件，返回处理的事件数
+            int poll(double timeout);
+            bool alive(int fd);
+            const Stats &stats() { return stats_; }
+            bool inited() { return inited_; }
+        private:
+            enum { OP_RECVMSG = 1, OP_READ = 2, OP_SEND = 3 };
+            static const int BGID = 7;
+            static const unsigned SLOT_SIZE = 1024;
+
+            struct Source{
+                int fd;
+                int op;
+                bool alive = true;
+                link_recv_func callback;
+                struct msghdr msg;
+            };
+            struct Slot{
+                uint8_t data[SLOT_SIZE];
+                struct iovec iov;
+                struct msghdr msg;
+                struct sockaddr_in addr;
+            };
+
+            struct io_uring_sqe *getSqe();
+            bool addSource(int fd, int op, link_recv_func callback);
+            void arm(uint32_t idx);
+            void handle(const struct io_uring_cqe *cqe);
+            void recycle(unsigned bid);
+            // 取出完成队列：发送完成直接收回槽，接收完成拷到 deferred_ 留给 reap 分发；返回收回的发送数
+            int drain();
+            int reap();
+            int takeSlot();
+
+            struct io_uring ring_;
+            struct io_uring_buf_ring *buf_ring_ = nullptr;
+            std::vector<uint8_t> bufs_;
+            unsigned buf_num_ = 0;
+            unsigned buf_size_ = 0;
+            std::vector<std::unique_ptr<Source> > sources_;
+            std::vector<std::unique_ptr<Slot> > slots_;
+            std::vector<uint32_t> free_slots_;
+            std::vector<struct io_uring_cqe> deferred_, batch_;
+            bool inited_ = false;
+            Stats stats_;
+    };
+
+    // 以原始模式打开串口，供 io_uring 后端直接读写
+    int openSerialFd(const std::string &port, int baudrate);
+}
+
+#endif
@@ -11,10 +11,16 @@ nh_(nh),nh_local_(nh_local)
     controllerPacket.setPortCallback(controller_port2_Callback,2);
     controllerPacket.setPortCallback(set_field_Callback,1);
     controllerPacket.setPortCallback(example_controller_port0_Callback,0);
-    std::thread work_thread1(robotUDPrece, &robot,&robotPacket);
-    work_thread1.detach();
-    std::thread work_thread2(controllerUDPrece, &controller,&controllerPacket);
-    work_thread2.detach();
+    robotPacket.setPortCallback(robot_probe_Callback,LINK_PROBE_PORT);
+    controllerPacket.setPortCallback(controller_probe_Callback,LINK_PROBE_PORT);
+    if(!use_io_uring || !uringInit())
+    {
+        use_io_uring = false;
+        std::thread work_thread1(robotUDPrece, &robot,&robotPacket);
+        work_thread1.detach();
+        std::thread work_thread2(controllerUDPrece, &controller,&controllerPacket);
+        work_thread2.detach();
+    }
     robot.Name_ = "robot";
     controller.Name_ = "controller";
     
@@ -52,6 +58,36 @@ void Communicator::loadParameters()
     ROS_DEBUG("port3_pub_topic:%s",port3_pub_topic.c_str());
     nh_local_.param<std::string>("/set_field_srv",set_field_srv,"/set_field");//约定topic
     ROS_DEBUG("set_field_srv:%s",set_field_srv.c_str());
+    nh_local_.param<int>("/service_workers",service_workers,1);
+    ROS_DEBUG("service_workers: %d",service_workers);
+    nh_local_.param<int>("/service_queue",service_queue,4);
+    ROS_DEBUG("service_queue: %d",service_queue);
+    nh_local_.param<double>("/service_timeout",service_timeout,0.5);
+    ROS_DEBUG("service_timeout: %f",service_timeout);
+    nh_local_.param<bool>("/use_io_uring",use_io_uring,false);
+    ROS_DEBUG("use_io_uring: %d",use_io_uring);
+
+    //为空时不使用组播
+    nh_local_.param<std::string>("/robot_multicast_group",robot_multicast_group,"");
+    ROS_DEBUG("robot_multicast_group:%s",robot_multicast_group.c_str());
+    nh_local_.param<std::string>("/controller_multicast_group",controller_multicast_group,"");
+    ROS_DEBUG("controller_multicast_group:%s",controller_multicast_group.c_str());
+    nh_local_.param<int>("/multicast_ttl",multicast_ttl,1);
+    ROS_DEBUG("multicast_ttl: %d",multicast_ttl);
+    nh_local_.param<bool>("/multicast_loop",multicast_loop,true);
+    ROS_DEBUG("multicast_loop: %d",multicast_loop);
+
+    //心跳频率为0时只回应对端的探测
+    nh_local_.param<std::string>("/link_quality_topic",link_quality_topic,"/link_quality");
+    ROS_DEBUG("link_quality_topic:%s",link_quality_topic.c_str());
+    nh_local_.param<double>("/link_probe_rate",link_probe_rate,10.0);
+    ROS_DEBUG("link_probe_rate: %f",link_probe_rate);
+    nh_local_.param<double>("/link_probe_timeout",link_probe_timeout,0.5);
+    ROS_DEBUG("link_probe_timeout: %f",link_probe_timeout);
+    nh_local_.param<int>("/link_probe_window",link_probe_window,10);
+    ROS_DEBUG("link_probe_window: %d",link_probe_window);
+    nh_local_.param<double>("/link_report_rate",link_report_rate,1.0);
+    ROS_DEBUG("link_report_rate: %f",link_report_rate);
 
 }
 void Communicator::rosInit()
@@ -65,6 +101,21 @@ void Communicator::rosInit()
     port2_pub = nh_.advertise<std_msgs::UInt8>(port2_pub_topic,10);
     port3_pub = nh_.advertise<std_msgs::UInt8>(port3_pub_topic,10);
     set_field_client = nh_.serviceClient<communication::set_field>(set_field_srv);
+    service_executor.init(service_workers,service_queue,service_timeout);
+
+    link_pub = nh_.advertise<communication::link_quality>(link_quality_topic,10);
+    robot_probe.init([this](uint8_t* data,uint16_t len){robotPacket.sendData(data,len,pcdata,LINK_PROBE_PORT,0);},
+        link_probe_rate,link_probe_timeout,link_probe_window);
+    controller_probe.init([this](uint8_t* data,uint16_t len){controllerPacket.sendData(data,len,pcdata,LINK_PROBE_PORT,0);},
+        link_probe_rate,link_probe_timeout,link_probe_window);
+    last_report = ros::Time::now();
+
+    //yaml 中配置的通用 topic<->端口 链路，peer 为 robot 或 controller
+    std::map<std::string,br_packet::Packet*> packets;
+    packets["robot"] = &robotPacket;
+    packets["controller"] = &controllerPacket;
+    int links = topic_bridge.load(nh_local_,"/bridge_links",packets);
+    ROS_INFO("%d bridge links loaded",links);
 }
 void Communicator::UDPinit()
 {
@@ -107,6 +158,52 @@ void Communicator::UDPinit()
         len=bind(robot.fd,(struct sockaddr*)&robot.addr_from,sizeof(robot.addr_from));
     }while(len==-1);
     printf("robot Bind successfully.\n");
+
+    if(br_packet::setMulticastSender(&controller,controller_multicast_group,controller.to_hton_,multicast_ttl,multicast_loop))
+    printf("controller pcdata multicast to %s\n",controller_multicast_group.c_str());
+    if(br_packet::setMulticastSender(&robot,robot_multicast_group,robot.to_hton_,multicast_ttl,multicast_loop))
+    printf("robot pcdata multicast to %s\n",robot_multicast_group.c_str());
+}
+void Communicator::updatePeer(target* t_adr,const sockaddr_in* from)
+{
+    if(from && memcmp(&from->sin_addr.s_addr, &(t_adr->addr_to.sin_addr.s_addr), sizeof(t_adr->addr_to.sin_addr.s_addr))!=0)
+    {
+        memcpy(&t_adr->addr_to.sin_addr.s_addr,&from->sin_addr.s_addr,sizeof(t_adr->addr_to.sin_addr.s_addr));
+        std::cerr << t_adr->Name_ <<"ipchanged: "<< inet_ntoa(from->sin_addr) << std::endl;
+    }
+}
+bool Communicator::uringInit()
+{
+#ifdef BR_USE_IO_URING
+    //两个peer的收发都挂在同一个ring上，由主循环pollLink处理
+    static br_packet::UringLink link;
+    if(!link.inited() && !link.init())
+    {
+        ROS_WARN("io_uring link unavailable, fall back to receive threads");
+        return false;
+    }
+    link.addSocket(robot.fd,[this](int,uint8_t* data,uint16_t len,const sockaddr_in* from)
+    {
+        updatePeer(&robot,from);
+        robotPacket.receiveHanlder(data,len);
+    });
+    link.addSocket(controller.fd,[this](int,uint8_t* data,uint16_t len,const sockaddr_in* from)
+    {
+        updatePeer(&controller,from);
+        controllerPacket.receiveHanlder(data,len);
+    });
+    uring_link = &link;
+    return true;
+#else
+    ROS_WARN("built without liburing, use_io_uring ignored");
+    return false;
+#endif
+}
+void Communicator::pollLink(double timeout)
+{
+#ifdef BR_USE_IO_URING
+    if(uring_link)uring_link->poll(timeout);
+#endif
 }
 void Communicator::robotUDPrece(target* t_adr,br_packet::Packet *P_adr)
 {
@@ -160,7 +257,17 @@ void Communicator::UDPsend(uint8_t* data, uint16_t len, target* t_adr)
 {
     uint8_t buf[1024];
     int slen;
-    slen=sendto(t_adr->fd,data,len,MSG_DONTWAIT,(struct sockaddr*)&t_adr->addr_to,sizeof(t_adr->addr_to)); 
+#ifdef BR_USE_IO_URING
+    //发送只排队，下一次pollLink时和其他peer一起提交
+    if(uring_link)
+    {
+        if(!uring_link->sendTo(t_adr->fd,data,len,br_packet::frameDestination(t_adr,data,len)))
+        printf("%s send falure!\n", t_adr->Name_.c_str());
+        return;
+    }
+#endif
+    //组播模式下pcdata帧一次发送到所有订阅者，命令与应答仍单播
+    slen=sendto(t_adr->fd,data,len,MSG_DONTWAIT,(const struct sockaddr*)br_packet::frameDestination(t_adr,data,len),sizeof(t_adr->addr_to)); 
     if(slen==-1)
     {
     printf("%s send falure!\n", t_adr->Name_.c_str());
@@ -199,9 +306,15 @@ void Communicator::set_field_Callback(uint8_t* data,uint16_t len)
     set_field_service.request.x = tempfloat[0];
     set_field_service.request.y = tempfloat[1];
     set_field_service.request.theta = tempfloat[2];
-    bool flag=set_field_client.call(set_field_service);
-    if(flag)
-    std::cout<<"set_field service called"<<std::endl;
+    //在UDP接收线程中不能阻塞，交给service_executor，结果在主循环中回送
+    service_executor.submit<communication::set_field>(set_field_client,set_field_service,1,
+        [](int port,bool ok,const communication::set_field&)
+        {
+            if(ok)
+            std::cout<<"set_field service called"<<std::endl;
+            else
+            ROS_WARN("set_field service on port %d failed",port);
+        });
     return;
 }
 
@@ -255,3 +368,35 @@ void Communicator::controller_port3_Callback(uint8_t* data,uint16_t len)
     std::cerr << "port3_msg_received" << std::endl;
     return;
 }
+
+void Communicator::robot_probe_Callback(uint8_t* data,uint16_t len)
+{
+    robot_probe.onFrame(data,len);
+}
+
+void Communicator::controller_probe_Callback(uint8_t* data,uint16_t len)
+{
+    controller_probe.onFrame(data,len);
+}
+
+//主循环中调用：发心跳，按 link_report_rate 发布两条链路的统计
+void Communicator::probeUpdate()
+{
+    robot_probe.tick();
+    controller_probe.tick();
+    if(link_report_rate <= 0 || (ros::Time::now() - last_report).toSec() < 1.0/link_report_rate)
+    return;
+    last_report = ros::Time::now();
+    communication::link_quality msg;
+    msg.header.stamp = last_report;
+    br_packet::LinkProbe::Summary sum = robot_probe.summary();
+    br_packet::toMsg(sum,msg);
+    msg.peer = robot.Name_;
+    msg.status = br_packet::LinkProbe::state(sum);
+    link_pub.publish(msg);
+    sum = controller_probe.summary();
+    br_packet::toMsg(sum,msg);
+    msg.peer = controller.Name_;
+    msg.status = br_packet::LinkProbe::state(sum);
+    link_pub.publish(msg);
+}
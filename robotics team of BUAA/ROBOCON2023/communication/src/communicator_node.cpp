@@ -16,7 +16,12 @@ int main(int argc, char** argv)
     {
         communicator_.robotPacket.update();
         communicator_.controllerPacket.update();
+        communicator_.service_executor.update();
+        communicator_.probeUpdate();
         ros::spinOnce();
+        if(communicator_.use_io_uring)
+        communicator_.pollLink(1.0/60);
+        else
         loop_rate.sleep();
     }
 }
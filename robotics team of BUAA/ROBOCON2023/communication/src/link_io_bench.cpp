@@ -0,0 +1,160 @@
+// 本地回环对比：阻塞 recvfrom/sendto + 串口 read/write 与 io_uring 后端
+// 用法：link_io_bench [frames=10000] [peers=2]
+// 每个peer是一对回环UDP套接字，另加一对pty模拟串口
+#include "communication/uring_link.hpp"
+#include <arpa/inet.h>//for socket
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+#define FRAME_LEN 18 // FIX + 3个float，与 /compensation 帧一致
+
+struct Peer{
+    int tx, rx;
+    struct sockaddr_in rx_addr;
+};
+
+static double wallTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpuTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool openPeer(Peer &p)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = 0;
+    p.tx = socket(AF_INET, SOCK_DGRAM, 0);
+    p.rx = socket(AF_INET, SOCK_DGRAM, 0);
+    if (p.tx < 0 || p.rx < 0) return false;
+    int rcvbuf = 4 << 20;
+    setsockopt(p.rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (bind(p.rx, (struct sockaddr *)&addr, sizeof(addr)) != 0) return false;
+    socklen_t len = sizeof(p.rx_addr);
+    getsockname(p.rx, (struct sockaddr *)&p.rx_addr, &len);
+    return true;
+}
+
+static bool openPty(int &master, int &slave)
+{
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) return false;
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0) return false;
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+    return true;
+}
+
+static void report(const char *name, long frames, long syscalls, double wall, double cpu)
+{
+    printf("%-10s frames %8ld  syscalls %9ld  syscalls/s %12.0f  cpu %8.1f us/1k frames  wall %7.3f s\n",
+           name, frames, syscalls, syscalls / wall, cpu * 1e6 / (frames / 1000.0), wall);
+}
+
+// 当前节点的做法：每帧一次 sendto / recvfrom，串口每块一次 write / read
+static void runBlocking(std::vector<Peer> &peers, int master, int slave, long frames)
+{
+    uint8_t frame[FRAME_LEN], buf[2048];
+    memset(frame, 0xAB, sizeof(frame));
+    long syscalls = 0, total = 0;
+    double w0 = wallTime(), c0 = cpuTime();
+    for (long i = 0; i < frames; ++i) {
+        for (auto &p : peers) {
+            sendto(p.tx, frame, FRAME_LEN, 0, (struct sockaddr *)&p.rx_addr, sizeof(p.rx_addr));
+            recvfrom(p.rx, buf, sizeof(buf), 0, NULL, NULL);
+            syscalls += 2;
+            ++total;
+        }
+        if (::write(master, frame, FRAME_LEN) == FRAME_LEN) {
+            int got = 0;
+            while (got < FRAME_LEN) {
+                int n = read(slave, buf, sizeof(buf));
+                ++syscalls;
+                if (n <= 0) break;
+                got += n;
+            }
+        }
+        ++syscalls;
+        ++total;
+    }
+    report("blocking", total, syscalls, wallTime() - w0, cpuTime() - c0);
+}
+
+// io_uring：所有peer与串口的发送排队后一次提交，接收为multishot
+static void runUring(std::vector<Peer> &peers, int master, int slave, long frames, int batch)
+{
+    br_packet::UringLink link;
+    if (!link.init(256, 256, 2048, 256)) {
+        printf("io_uring not available\n");
+        return;
+    }
+    uint8_t frame[FRAME_LEN];
+    memset(frame, 0xAB, sizeof(frame));
+    long received = 0, serial_bytes = 0;
+    for (auto &p : peers)
+        link.addSocket(p.rx, [&](int, uint8_t *, uint16_t, const sockaddr_in *) { ++received; });
+    link.addStream(slave, [&](int, uint8_t *, uint16_t len, const sockaddr_in *) { serial_bytes += len; });
+
+    long total = frames * (peers.size() + 1);
+    double w0 = wallTime(), c0 = cpuTime();
+    for (long i = 0; i < frames; i += batch) {
+        long n = std::min<long>(batch, frames - i);
+        for (long k = 0; k < n; ++k) {
+            for (auto &p : peers)
+                link.sendTo(p.tx, frame, FRAME_LEN, &p.rx_addr);
+            link.write(master, frame, FRAME_LEN);
+        }
+        long want_udp = (i + n) * peers.size(), want_ser = (i + n) * FRAME_LEN;
+        // 超时无事件说明有帧丢失，放弃等待
+        while (received < want_udp || serial_bytes < want_ser)
+            if (link.poll(0.1) <= 0) break;
+    }
+    report("io_uring", total, link.stats().enter, wallTime() - w0, cpuTime() - c0);
+    if (link.stats().dropped) printf("dropped %lu\n", (unsigned long)link.stats().dropped);
+}
+
+int main(int argc, char **argv)
+{
+    long frames = argc > 1 ? atol(argv[1]) : 10000;
+    int npeer = argc > 2 ? atoi(argv[2]) : 2;
+    std::vector<Peer> peers(npeer);
+    for (auto &p : peers) {
+        if (!openPeer(p)) {
+            perror("socket");
+            return 1;
+        }
+    }
+    int master, slave;
+    if (!openPty(master, slave)) {
+        perror("pty");
+        return 1;
+    }
+    runBlocking(peers, master, slave, frames);
+    runUring(peers, master, slave, frames, 32);
+    return 0;
+}
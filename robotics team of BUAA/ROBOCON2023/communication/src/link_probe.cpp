@@ -0,0 +1,176 @@
+#include "communication/link_probe.hpp"
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+namespace br_packet{
+    enum { KIND_PING = 0, KIND_PONG = 1 };
+    static const int64_t NS = 1000000000LL;
+
+    const std::array<double, LinkProbe::BUCKET_NUM - 1> &LinkProbe::bounds()
+    {
+        static const std::array<double, BUCKET_NUM - 1> b{{0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500}};
+        return b;
+    }
+
+    const char *LinkProbe::state(const Summary &sum)
+    {
+        if (sum.sent == 0) return "idle";
+        if (sum.received == 0) return "down";
+        if (sum.loss_rate > 0.1) return "degraded";
+        return "ok";
+    }
+
+    int64_t LinkProbe::now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+    }
+
+    void LinkProbe::init(send_func send, double rate, double timeout, int window)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        send_ = send;
+        rate_ = rate > 0 ? rate : 0;
+        timeout_ = (int64_t)(timeout * NS);
+        window_ = std::max(1, std::min(window, SLICE_NUM - 1));
+        next_ping_ = slice_start_ = now();
+        for (auto &s : slices_) s = Slice();
+        for (auto &t : track_) t = Track();
+        cur_ = 0;
+    }
+
+    void LinkProbe::expire(int64_t t)
+    {
+        for (auto &tr : track_) {
+            if (tr.pending && t - tr.stamp > timeout_) {
+                tr.pending = false;
+                ++slices_[cur_].lost;
+            }
+        }
+    }
+
+    void LinkProbe::tick()
+    {
+        uint8_t ping[PAYLOAD_LEN];
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!send_) return;
+            int64_t t = now();
+            // 每秒一片，超过 window 的分片清零复用
+            while (t - slice_start_ >= NS) {
+                slice_start_ += NS;
+                cur_ = (cur_ + 1) % SLICE_NUM;
+                slices_[cur_] = Slice();
+            }
+            expire(t);
+            if (rate_ <= 0 || t < next_ping_) return;
+            next_ping_ = std::max(next_ping_ + (int64_t)(NS / rate_), t);
+
+            Track &tr = track_[seq_ % TRACK_NUM];
+            if (tr.pending) ++slices_[cur_].lost;  // 槽被覆盖，之前的 ping 已经没有机会统计
+            tr.seq = seq_;
+            tr.stamp = t;
+            tr.pending = true;
+            ++slices_[cur_].sent;
+
+            ping[0] = KIND_PING;
+            memcpy(ping + 1, &seq_, 4);
+            memcpy(ping + 5, &t, 8);
+            ++seq_;
+        }
+        send_(ping, PAYLOAD_LEN);
+    }
+
+    void LinkProbe::onFrame(uint8_t *data, uint16_t len)
+    {
+        if (len != PAYLOAD_LEN) return;
+        if (data[0] == KIND_PING) {
+            // 原样回给对端，只改类型
+            uint8_t pong[PAYLOAD_LEN];
+            memcpy(pong, data, PAYLOAD_LEN);
+            pong[0] = KIND_PONG;
+            send_func send;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                send = send_;
+            }
+            if (send) send(pong, PAYLOAD_LEN);
+            return;
+        }
+        if (data[0] != KIND_PONG) return;
+
+        uint32_t seq;
+        int64_t stamp;
+        memcpy(&seq, data + 1, 4);
+        memcpy(&stamp, data + 5, 8);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Track &tr = track_[seq % TRACK_NUM];
+        // 超时后才到的 pong 已记为丢包，不再计入
+        if (!tr.pending || tr.seq != seq || tr.stamp != stamp) return;
+        tr.pending = false;
+        int64_t t = now();
+        last_reply_ = t;
+        record((t - stamp) * 1e-6);
+    }
+
+    void LinkProbe::record(double rtt)
+    {
+        Slice &s = slices_[cur_];
+        if (s.received == 0 || rtt < s.rtt_min) s.rtt_min = rtt;
+        if (s.received == 0 || rtt > s.rtt_max) s.rtt_max = rtt;
+        ++s.received;
+        s.rtt_sum += rtt;
+        const auto &b = bounds();
+        ++s.hist[std::lower_bound(b.begin(), b.end(), rtt) - b.begin()];
+        // RFC 3550 的平滑抖动估计
+        if (last_rtt_ >= 0) jitter_ += (std::fabs(rtt - last_rtt_) - jitter_) / 16.0;
+        last_rtt_ = rtt;
+    }
+
+    LinkProbe::Summary LinkProbe::summary()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Summary sum;
+        sum.window = window_;
+        double rtt_sum = 0;
+        bool first = true;
+        for (int i = 0; i < window_; ++i) {
+            const Slice &s = slices_[(cur_ - i + SLICE_NUM) % SLICE_NUM];
+            sum.sent += s.sent;
+            sum.lost += s.lost;
+            if (s.received == 0) continue;
+            if (first || s.rtt_min < sum.rtt_min) sum.rtt_min = s.rtt_min;
+            if (first || s.rtt_max > sum.rtt_max) sum.rtt_max = s.rtt_max;
+            first = false;
+            sum.received += s.received;
+            rtt_sum += s.rtt_sum;
+            for (int k = 0; k < BUCKET_NUM; ++k) sum.hist[k] += s.hist[k];
+        }
+        if (sum.received + sum.lost > 0) sum.loss_rate = (double)sum.lost / (sum.received + sum.lost);
+        if (sum.received > 0) sum.rtt_mean = rtt_sum / sum.received;
+        sum.jitter = jitter_;
+        if (last_reply_ > 0) sum.last_reply_age = (now() - last_reply_) * 1e-9;
+
+        // 分位数在直方图格内线性插值，并用实际最小/最大值夹住
+        const auto &b = bounds();
+        auto quantile = [&](double q) {
+            double target = q * sum.received, acc = 0;
+            for (int k = 0; k < BUCKET_NUM; ++k) {
+                if (sum.hist[k] == 0) continue;
+                if (acc + sum.hist[k] >= target) {
+                    double lo = k == 0 ? 0 : b[k - 1];
+                    double hi = k == BUCKET_NUM - 1 ? sum.rtt_max : b[k];
+                    double v = lo + (hi - lo) * (target - acc) / sum.hist[k];
+                    return std::max(sum.rtt_min, std::min(sum.rtt_max, v));
+                }
+                acc += sum.hist[k];
+            }
+            return sum.rtt_max;
+        };
+        if (sum.received > 0) {
+            sum.rtt_p50 = quantile(0.5);
+            sum.rtt_p95 = quantile(0.95);
+        }
+        return sum;
+    }
+}
@@ -26,7 +26,9 @@ namespace br_packet{
                 break;
             case 3:
                 data_len_ |= *data;
-                state_ = 4;
+                // 长度超过接收缓冲区的帧直接丢弃
+                if (data_len_ > BUFF_SIZE) reset();
+                else state_ = 4;
                 break;
             case 4:
                 type_ = (*data) >> 6;
@@ -73,8 +75,17 @@ namespace br_packet{
     }
 
     bool Packet::sendData(uint8_t *data, uint16_t len, int type, int port, int level){
+        if (len > payloadCapacity()) return false;
+        std::lock_guard<std::recursive_mutex> lock(send_mutex_);
+        memcpy(&send_buff_[5], data, len);
+        return sendPayload(len, type, port, level);
+    }
+
+    bool Packet::sendPayload(uint16_t len, int type, int port, int level){
+        if (len > payloadCapacity()) return false;
+        std::lock_guard<std::recursive_mutex> lock(send_mutex_);
         uint8_t check_sum = 0;
-        for (int i = 0; i < len; ++i){check_sum += data[i];}
+        for (int i = 0; i < len; ++i){check_sum += send_buff_[i + 5];}
         int ilen = len;
         send_buff_[ilen + 5] = check_sum;
         send_buff_[0] = 0xFF;
@@ -86,7 +97,6 @@ namespace br_packet{
             send_buff_[4] = send_id_[level];
         }
         else send_buff_[4] = 0;
-        memcpy(&send_buff_[5], data, len);
         
         if (type == 0){
             if (len + (uint16_t)FIX > spare_len_[level]) return false;
@@ -100,6 +110,7 @@ namespace br_packet{
 
 
     bool Packet::update(){
+        std::lock_guard<std::recursive_mutex> lock(send_mutex_);
         int flag = LEVEL_NUM;
         for (int i = LEVEL_NUM - 1; i >= 0; --i) 
         if (recv_flag_[i] == 0) flag = i;
@@ -132,7 +143,7 @@ namespace br_packet{
 
     void Packet::type0Callback(){
         if (id_ != last_id_[level_]) {   
-            port_callback_[port_](recv_buff_, data_len_);
+            if (port_callback_[port_]) port_callback_[port_](recv_buff_, data_len_);
             std::cout << "receive type 0 data" << std::endl;
         }
         else std::cout << "receive the same type0 data" << std::endl;
@@ -140,10 +151,11 @@ namespace br_packet{
     }
 
     void Packet::type1Callback(){
-        port_callback_[port_](recv_buff_, data_len_);
+        if (port_callback_[port_]) port_callback_[port_](recv_buff_, data_len_);
     }
 
     void Packet::type2Callback(){
+        std::lock_guard<std::recursive_mutex> lock(send_mutex_);
         uint16_t data_len = 0;
         data_len |= buff_[level_][1];
         data_len << 8;
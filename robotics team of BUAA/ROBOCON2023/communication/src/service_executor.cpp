@@ -0,0 +1,159 @@
+#include "communication/service_executor.hpp"
+
+
+namespace br_packet{
+    ServiceExecutor::~ServiceExecutor()
+    {
+        shutdown();
+    }
+
+    void ServiceExecutor::init(int workers, int capacity, double timeout, int max_stuck)
+    {
+        shutdown();
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        capacity_ = capacity > 0 ? capacity : 1;
+        max_stuck_ = max_stuck > 0 ? max_stuck : 0;
+        timeout_ = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(timeout));
+        state_->running = true;
+        for (int i = 0; i < (workers > 0 ? workers : 1); ++i)
+            spawn();
+    }
+
+    void ServiceExecutor::spawn()
+    {
+        WorkerPtr w = std::make_shared<Worker>();
+        workers_.emplace_back(w, std::thread(&ServiceExecutor::workLoop, state_, w));
+    }
+
+    bool ServiceExecutor::submit(int port, std::function<bool()> call, std::function<void(bool)> done)
+    {
+        JobPtr job = std::make_shared<Job>();
+        job->port = port;
+        job->call = call;
+        job->done = done;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (!state_->running || (int)state_->queue.size() >= capacity_) {
+                ROS_WARN("service queue full, request on port %d dropped", job->port);
+                return false;
+            }
+            job->id = ++next_id_;
+            job->deadline = clock::now() + timeout_;
+            state_->queue.push_back(job);
+            state_->inflight.push_back(job);
+        }
+        state_->cond.notify_one();
+        return true;
+    }
+
+    void ServiceExecutor::workLoop(std::shared_ptr<State> state, WorkerPtr self)
+    {
+        while (true) {
+            JobPtr job;
+            {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                while (true) {
+                    state->cond.wait(lock, [&] { return !state->running || !state->queue.empty(); });
+                    if (!state->running) return;
+                    job = state->queue.front();
+                    state->queue.pop_front();
+                    // 排队期间已经超时的请求不再调用
+                    if (clock::now() <= job->deadline) break;
+                }
+                self->job = job;
+            }
+            bool ok = false;
+            try {
+                ok = job->call();
+            }
+            catch (...) {
+                ok = false;
+            }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            job->ok = ok;
+            job->finished = true;
+            self->job.reset();
+            if (self->abandoned) {
+                // 已有替补线程，这个线程退出
+                --state->stuck;
+                return;
+            }
+        }
+    }
+
+    void ServiceExecutor::update()
+    {
+        std::vector<std::pair<JobPtr, bool> > ready;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            clock::time_point now = clock::now();
+            for (auto it = state_->inflight.begin(); it != state_->inflight.end();) {
+                if ((*it)->finished) {
+                    ready.emplace_back(*it, (*it)->ok);
+                    it = state_->inflight.erase(it);
+                }
+                else if (now > (*it)->deadline) {
+                    // 超时的请求直接回送失败，之后完成的结果被丢弃
+                    ROS_WARN("service request %u on port %d timed out", (*it)->id, (*it)->port);
+                    ready.emplace_back(*it, false);
+                    it = state_->inflight.erase(it);
+                }
+                else ++it;
+            }
+            // 调用超过期限仍未返回的线程放弃掉，补一个新的，后续请求不会被它堵住
+            for (size_t i = 0; i < workers_.size();) {
+                Worker &w = *workers_[i].first;
+                if (!w.job || now <= w.job->deadline) {
+                    ++i;
+                    continue;
+                }
+                if (state_->stuck >= max_stuck_) {
+                    ROS_WARN_THROTTLE(1, "%d service calls stuck, no more workers are added", state_->stuck);
+                    break;
+                }
+                ROS_WARN("service request %u on port %d is still blocking, worker replaced", w.job->id, w.job->port);
+                w.abandoned = true;
+                ++state_->stuck;
+                workers_[i].second.detach();
+                workers_.erase(workers_.begin() + i);
+                spawn();
+            }
+        }
+        for (auto &r : ready) r.first->done(r.second);
+    }
+
+    void ServiceExecutor::shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->running = false;
+            state_->queue.clear();
+            state_->inflight.clear();
+            // 正在调用 service 的线程不等，call 返回后自行退出；空闲的线程下面 join
+            for (auto &w : workers_)
+                if (w.first->job) {
+                    w.first->abandoned = true;
+                    ++state_->stuck;
+                    w.second.detach();
+                }
+        }
+        state_->cond.notify_all();
+        for (auto &w : workers_)
+            if (w.second.joinable()) w.second.join();
+        workers_.clear();
+        // 被放弃的线程仍持有旧的 State，重新 init 时换一份，互不影响
+        state_ = std::make_shared<State>();
+    }
+
+    int ServiceExecutor::pending()
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->inflight.size();
+    }
+
+    int ServiceExecutor::stuck()
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->stuck;
+    }
+}
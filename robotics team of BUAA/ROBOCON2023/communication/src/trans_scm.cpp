@@ -25,6 +25,17 @@ bool UDP_init()
     close(fd);
     return false;
     }
+    multicast = false;
+    if(!multicast_group.empty())
+    {
+        if(!br_packet::makeGroupAddr(&addr_group,multicast_group,to_hton))
+        ROS_WARN("%s is not a multicast address, multicast disabled",multicast_group.c_str());
+        else if(br_packet::setMulticastOptions(fd,addr_from.sin_addr,multicast_ttl,multicast_loop))
+        {
+            multicast = true;
+            ROS_INFO("serial data multicast to %s",multicast_group.c_str());
+        }
+    }
     return true;
 }
 
@@ -76,6 +87,21 @@ void UDPsend(uint8_t* data, uint16_t len)
     }
 }
 
+//串口上行数据：组播模式下发一次给所有监听端，命令端可选仍单播
+void UDPforward(uint8_t* data, uint16_t len)
+{
+#ifdef BR_USE_IO_URING
+    if(use_io_uring)
+    {
+        if(multicast) uring_link.sendTo(fd, data, len, &addr_group);
+        if(!multicast || multicast_unicast) uring_link.sendTo(fd, data, len, &addr_to);
+        return;
+    }
+#endif
+    if(multicast) sendto(fd,data,len,0,(struct sockaddr*)&addr_group,sizeof(addr_group));
+    if(!multicast || multicast_unicast) sendto(fd,data,len,0,(struct sockaddr*)&addr_to,sizeof(addr_to));
+}
+
 bool serial_init()
 {
     try{   
@@ -105,6 +131,13 @@ bool serial_init()
 void write(uint8_t* buff, uint16_t len)
 {
     int ilen = len;
+#ifdef BR_USE_IO_URING
+    if(use_io_uring)
+    {
+        uring_link.write(serial_fd, buff, len);
+        return;
+    }
+#endif
     // int dataa;
     // for (int i =0 ;i<ilen;i++)
     // {
@@ -160,21 +193,28 @@ void img_angle_callback(uint8_t* data,uint16_t len){
     return;
 }
 
-void shoot_aid_sub_callback(const std_msgs::UInt8& msg)
+void shoot_aid_response(int port, bool ok, const communication::shoot_aid& aid_service)
 {
     static uint8_t data[5];
     float tempfloat;
+    if(!ok)
+    {
+        ROS_WARN("shoot_aid service failed or timed out");
+        return;
+    }
+    tempfloat=aid_service.response.offset;
+    std::cout<<tempfloat<<std::endl;
+    memcpy(data,&tempfloat,4);
+    packet.sendData(data,4,pcdata,port,0);
+}
+
+void shoot_aid_sub_callback(const std_msgs::UInt8& msg)
+{
     uint8_t tempuint8=msg.data;
     communication::shoot_aid aid_service;
     aid_service.request.target_id=tempuint8;
-    bool flag=shoot_aid_client.call(aid_service);
-    if(flag)
-    {
-        tempfloat=aid_service.response.offset;
-        std::cout<<tempfloat<<std::endl;
-        memcpy(data,&tempfloat,4);
-        packet.sendData(data,4,pcdata,1,0);
-    }
+    //检测程序耗时较长，不能在串口主循环中阻塞
+    service_executor.submit<communication::shoot_aid>(shoot_aid_client,aid_service,1,shoot_aid_response);
 }
 
 void port0_callback(uint8_t* data,uint16_t len){
@@ -182,18 +222,89 @@ void port0_callback(uint8_t* data,uint16_t len){
     return;
 }
 
-void* exam_topic_publisher(void* args)
+#ifdef BR_USE_IO_URING
+// io_uring 模式：UDP与串口都在主线程中收发，不再开UDPreviceve线程
+void uring_udp_callback(int, uint8_t* data, uint16_t len, const sockaddr_in* from)
 {
-    ros::Rate loop_rate(100);
-    ros::NodeHandle nh;
-    ros::Publisher exam_pub = nh.advertise<std_msgs::String>("exam_topic",1);
-    while(ros::ok())
+    if(from && memcmp(&from->sin_addr.s_addr, &addr_to.sin_addr.s_addr, sizeof(addr_to.sin_addr.s_addr))!=0)
+    {
+        memcpy(&addr_to.sin_addr,&from->sin_addr,sizeof(addr_to.sin_addr));
+    }
+    uring_link.write(serial_fd, data, len);
+}
+
+void uring_serial_callback(int, uint8_t* data, uint16_t len, const sockaddr_in*)
+{
+    UDPforward(data, len);
+    packet.receiveHanlder(data, len);
+    packet.update();
+}
+
+bool uring_open_serial()
+{
+    serial_fd = br_packet::openSerialFd("/dev/ttyUSB0", 115200);
+    if(serial_fd < 0)
+    {
+        ROS_ERROR_STREAM("Unable to open Serial Port !");
+        return false;
+    }
+    uring_link.addStream(serial_fd, uring_serial_callback);
+    return true;
+}
+
+bool uring_init()
+{
+    if(!uring_link.inited() && !uring_link.init())
     {
-        exam_pub.publish(exam_msg);
+        return false;
+    }
+    uring_link.addSocket(fd, uring_udp_callback);
+    ROS_INFO_STREAM("io_uring link initialized");
+    return true;
+}
+
+// 打开串口；断开后关掉旧的 fd 重新打开，期间 UDP 照常收发
+void uring_reopen_serial()
+{
+    if(serial_fd >= 0)
+    {
+        node_state="serial err";
+        ROS_WARN("serial link lost, reopening");
+        close(serial_fd);
+        serial_fd = -1;
+    }
+    while(ros::ok() && !uring_open_serial())
+    {
+        //重试间隔内照常处理 UDP
+        uring_link.poll(0.1);
+        service_executor.update();
+        link_report();
         ros::spinOnce();
-        loop_rate.sleep();
+        uring_link.flush();
     }
-    
+    node_state="serial_init";
+}
+#endif
+
+void link_probe_callback(uint8_t* data,uint16_t len){
+    link_probe.onFrame(data,len);
+}
+
+//发心跳并按 link_report_rate 发布链路统计，代替原来100Hz发状态字符串的线程
+void link_report()
+{
+    //串口没打开时不能往里写心跳
+    if(use_io_uring || ser.isOpen()) link_probe.tick();
+    if(link_report_rate <= 0 || (ros::Time::now() - last_report).toSec() < 1.0/link_report_rate)
+    return;
+    last_report = ros::Time::now();
+    communication::link_quality msg;
+    br_packet::LinkProbe::Summary sum = link_probe.summary();
+    br_packet::toMsg(sum,msg);
+    msg.header.stamp = last_report;
+    msg.peer = "serial";
+    msg.status = node_state + "/" + br_packet::LinkProbe::state(sum);
+    link_pub.publish(msg);
 }
 
 // void* TFpub(void* args)
@@ -209,9 +320,7 @@ int main(int argc, char** argv)
     ros::init(argc, argv, "trans_node");
     ros::NodeHandle nh;
     ros::Rate loop_rate(100);
-    exam_msg.data="no_init";
-    pthread_t thread_exam;
-    int rc_exam = pthread_create(&thread_exam, NULL, exam_topic_publisher, NULL);
+    node_state="no_init";
 
    
     packet.init(write);
@@ -222,15 +331,37 @@ int main(int argc, char** argv)
     nh.param<std::string>("pos_topic",pos_topic,"/compensation");
     nh.param<std::string>("shoot_aid_srv",shoot_aid_srv,"/shoot_aid");
     nh.param<std::string>("shoot_aid_topic",shoot_aid_topic,"/need_shoot_aid");
+    nh.param<double>("shoot_aid_timeout",shoot_aid_timeout,1.0);
+    nh.param<int>("shoot_aid_workers",shoot_aid_workers,1);
+    nh.param<int>("shoot_aid_queue",shoot_aid_queue,2);
     
     nh.param<std::string>("to_ip",to_ip,"192.168.3.19");
     nh.param<int>("b_to_hton",to_hton,7777);
 
     nh.param<std::string>("from_ip",from_ip,"10.42.0.4");
     nh.param<int>("b_from_hton",from_hton,7777);
+    nh.param<bool>("use_io_uring",use_io_uring,false);
+    //为空时不使用组播
+    nh.param<std::string>("multicast_group",multicast_group,"");
+    nh.param<int>("multicast_ttl",multicast_ttl,1);
+    nh.param<bool>("multicast_loop",multicast_loop,true);
+    nh.param<bool>("multicast_unicast",multicast_unicast,true);
+    nh.param<std::string>("link_quality_topic",link_quality_topic,"/link_quality");
+    nh.param<double>("link_probe_rate",link_probe_rate,10.0);
+    nh.param<double>("link_probe_timeout",link_probe_timeout,0.5);
+    nh.param<int>("link_probe_window",link_probe_window,10);
+    nh.param<double>("link_report_rate",link_report_rate,1.0);
+#ifndef BR_USE_IO_URING
+    if(use_io_uring)
+    {
+        ROS_WARN("built without liburing, use_io_uring ignored");
+        use_io_uring = false;
+    }
+#endif
 
     packet.setPortCallback(port0_callback,0);
     packet.setPortCallback(img_angle_callback,1);
+    packet.setPortCallback(link_probe_callback,LINK_PROBE_PORT);
     // base_name = "base_link";
     // world_name = "world";
     // pthread_t thread;
@@ -239,20 +370,58 @@ int main(int argc, char** argv)
     shoot_aid_sub = nh.subscribe(shoot_aid_topic,1,&shoot_aid_sub_callback);
     pos_sub = nh.subscribe(pos_topic,1,&pos_callback);
     shoot_aid_client = nh.serviceClient<communication::shoot_aid>(shoot_aid_srv);
+    service_executor.init(shoot_aid_workers,shoot_aid_queue,shoot_aid_timeout);
+    link_pub = nh.advertise<communication::link_quality>(link_quality_topic,10);
+    link_probe.init([](uint8_t* data,uint16_t len){packet.sendData(data,len,pcdata,LINK_PROBE_PORT,0);},
+        link_probe_rate,link_probe_timeout,link_probe_window);
+    last_report = ros::Time::now();
+    //yaml 中配置的通用 topic<->端口 链路，都走串口
+    std::map<std::string,br_packet::Packet*> packets;
+    packets["serial"] = &packet;
+    topic_bridge.load(nh,"bridge_links",packets);
     
     serial_restart: ROS_INFO_STREAM("serial opening");
     while(!UDP_init())
     {
+        link_report();
         loop_rate.sleep();
     }
-    exam_msg.data="udp_init";
+    node_state="udp_init";
+#ifdef BR_USE_IO_URING
+    if(use_io_uring)
+    {
+        if(!uring_init())
+        {
+            ROS_WARN("io_uring link unavailable, fall back to blocking I/O");
+            use_io_uring = false;
+        }
+        else
+        {
+            uring_reopen_serial();
+            while(ros::ok())
+            {
+                if(!uring_link.alive(serial_fd))
+                {
+                    uring_reopen_serial();
+                    continue;
+                }
+                //等待收发事件，最多等一个周期
+                uring_link.poll(0.01);
+                service_executor.update();
+                link_report();
+                ros::spinOnce();
+                uring_link.flush();
+            }
+            return 0;
+        }
+    }
+#endif
     serial_init();
-    exam_msg.data="serial_init";
+    node_state="serial_init";
     pthread_t thread;
 
     int rc = pthread_create(&thread, NULL, UDPreviceve, NULL);
     // ros::service::waitForService(shoot_aid_srv);
-    int templen;
     while(ros::ok())
     {
        if(ser.isOpen())
@@ -260,7 +429,7 @@ int main(int argc, char** argv)
             if(ser.available())
         {
         len = ser.read(buff, ser.available());
-        templen=sendto(fd,buff,len,0,(struct sockaddr*)&addr_to,sizeof(addr_to)); 
+        UDPforward(buff,len);
         // if(templen==-1){
         // printf("send falure!\n");
         // }
@@ -274,11 +443,12 @@ int main(int argc, char** argv)
         }
         else
         {
-            exam_msg.data="serial err";
+            node_state="serial err";
             goto serial_restart;
         }
         
-
+        service_executor.update();
+        link_report();
         ros::spinOnce();
         loop_rate.sleep();
     
@@ -0,0 +1,309 @@
+#include "communication/uring_link.hpp"
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace br_packet{
+    // user_data 低8位为操作类型，高位为 source / slot 下标
+    static inline uint64_t packUser(int op, uint32_t idx) { return ((uint64_t)idx << 8) | (uint64_t)op; }
+
+    UringLink::~UringLink()
+    {
+        if (!inited_) return;
+        if (buf_ring_) io_uring_free_buf_ring(&ring_, buf_ring_, buf_num_, BGID);
+        io_uring_queue_exit(&ring_);
+    }
+
+    bool UringLink::init(unsigned entries, unsigned buf_num, unsigned buf_size, unsigned send_slots)
+    {
+        if (inited_ || buf_num == 0 || (buf_num & (buf_num - 1)) != 0) return false;
+        int ret = io_uring_queue_init(entries, &ring_, 0);
+        if (ret < 0) {
+            printf("io_uring init failure: %s\n", strerror(-ret));
+            return false;
+        }
+        buf_num_ = buf_num;
+        buf_size_ = buf_size;
+        bufs_.resize((size_t)buf_num * buf_size);
+        buf_ring_ = io_uring_setup_buf_ring(&ring_, buf_num, BGID, 0, &ret);
+        if (!buf_ring_) {
+            printf("io_uring buffer ring failure: %s\n", strerror(-ret));
+            io_uring_queue_exit(&ring_);
+            return false;
+        }
+        for (unsigned i = 0; i < buf_num; ++i)
+            io_uring_buf_ring_add(buf_ring_, &bufs_[(size_t)i * buf_size], buf_size, i, io_uring_buf_ring_mask(buf_num), i);
+        io_uring_buf_ring_advance(buf_ring_, buf_num);
+
+        for (unsigned i = 0; i < send_slots; ++i) {
+            slots_.emplace_back(new Slot());
+            free_slots_.push_back(i);
+        }
+        inited_ = true;
+        return true;
+    }
+
+    struct io_uring_sqe *UringLink::getSqe()
+    {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+        if (!sqe) {
+            flush();
+            sqe = io_uring_get_sqe(&ring_);
+        }
+        return sqe;
+    }
+
+    bool UringLink::addSocket(int fd, link_recv_func callback)
+    {
+        return addSource(fd, OP_RECVMSG, callback);
+    }
+
+    bool UringLink::addStream(int fd, link_recv_func callback)
+    {
+        return addSource(fd, OP_READ, callback);
+    }
+
+    bool UringLink::addSource(int fd, int op, link_recv_func callback)
+    {
+        if (!inited_) return false;
+        // 断开的源不会再挂接读请求，下标可以直接复用
+        uint32_t idx = 0;
+        while (idx < sources_.size() && sources_[idx]->alive) ++idx;
+        if (idx == sources_.size()) sources_.emplace_back(new Source());
+        Source &src = *sources_[idx];
+        src.fd = fd;
+        src.op = op;
+        src.alive = true;
+        src.callback = callback;
+        memset(&src.msg, 0, sizeof(src.msg));
+        if (op == OP_RECVMSG) src.msg.msg_namelen = sizeof(struct sockaddr_in);
+        arm(idx);
+        return src.alive;
+    }
+
+    void UringLink::arm(uint32_t idx)
+    {
+        Source &src = *sources_[idx];
+        struct io_uring_sqe *sqe = getSqe();
+        if (!sqe) {
+            src.alive = false;
+            return;
+        }
+        if (src.op == OP_RECVMSG)
+            io_uring_prep_recvmsg_multishot(sqe, src.fd, &src.msg, 0);
+        else
+            io_uring_prep_read(sqe, src.fd, NULL, buf_size_, (uint64_t)-1);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BGID;
+        io_uring_sqe_set_data64(sqe, packUser(src.op, idx));
+    }
+
+    int UringLink::takeSlot()
+    {
+        // 发送槽用完，等已提交的发送完成；期间到达的接收只暂存，不在这里分发
+        // 槽够用时不提交，排队的发送由 poll() 的 submit_and_wait 一起提交
+        if (free_slots_.empty())
+            flush();
+        while (free_slots_.empty()) {
+            struct io_uring_cqe *cqe;
+            if (io_uring_wait_cqe(&ring_, &cqe) != 0) break;
+            drain();
+        }
+        if (free_slots_.empty()) {
+            ++stats_.dropped;
+            return -1;
+        }
+        int id = free_slots_.back();
+        free_slots_.pop_back();
+        return id;
+    }
+
+    bool UringLink::sendTo(int fd, const uint8_t *data, uint16_t len, const sockaddr_in *addr)
+    {
+        if (!inited_ || len > SLOT_SIZE) return false;
+        int id = takeSlot();
+        if (id < 0) return false;
+        Slot &slot = *slots_[id];
+        memcpy(slot.data, data, len);
+        slot.addr = *addr;
+        slot.iov.iov_base = slot.data;
+        slot.iov.iov_len = len;
+        memset(&slot.msg, 0, sizeof(slot.msg));
+        slot.msg.msg_name = &slot.addr;
+        slot.msg.msg_namelen = sizeof(slot.addr);
+        slot.msg.msg_iov = &slot.iov;
+        slot.msg.msg_iovlen = 1;
+        struct io_uring_sqe *sqe = getSqe();
+        if (!sqe) {
+            free_slots_.push_back(id);
+            return false;
+        }
+        io_uring_prep_sendmsg(sqe, fd, &slot.msg, MSG_DONTWAIT);
+        io_uring_sqe_set_data64(sqe, packUser(OP_SEND, id));
+        return true;
+    }
+
+    bool UringLink::write(int fd, const uint8_t *data, uint16_t len)
+    {
+        if (!inited_ || len > SLOT_SIZE) return false;
+        int id = takeSlot();
+        if (id < 0) return false;
+        Slot &slot = *slots_[id];
+        memcpy(slot.data, data, len);
+        struct io_uring_sqe *sqe = getSqe();
+        if (!sqe) {
+            free_slots_.push_back(id);
+            return false;
+        }
+        io_uring_prep_write(sqe, fd, slot.data, len, (uint64_t)-1);
+        io_uring_sqe_set_data64(sqe, packUser(OP_SEND, id));
+        return true;
+    }
+
+    int UringLink::flush()
+    {
+        if (io_uring_sq_ready(&ring_) == 0) return 0;
+        ++stats_.enter;
+        return io_uring_submit(&ring_);
+    }
+
+    int UringLink::poll(double timeout)
+    {
+        if (!inited_) return -1;
+        struct __kernel_timespec ts;
+        ts.tv_sec = (long long)timeout;
+        ts.tv_nsec = (long long)((timeout - (double)ts.tv_sec) * 1e9);
+        struct io_uring_cqe *cqe;
+        ++stats_.enter;
+        int ret = io_uring_submit_and_wait_timeout(&ring_, &cqe, 1, &ts, NULL);
+        if (ret < 0 && ret != -ETIME && ret != -EINTR) return ret;
+        return reap();
+    }
+
+    int UringLink::drain()
+    {
+        struct io_uring_cqe *cqe;
+        unsigned head;
+        unsigned count = 0;
+        int sends = 0;
+        io_uring_for_each_cqe(&ring_, head, cqe)
+        {
+            uint64_t user = io_uring_cqe_get_data64(cqe);
+            if ((user & 0xFF) == OP_SEND) {
+                handle(cqe);
+                ++sends;
+            }
+            else deferred_.push_back(*cqe);
+            ++count;
+        }
+        io_uring_cq_advance(&ring_, count);
+        return sends;
+    }
+
+    int UringLink::reap()
+    {
+        int count = drain();
+        // 回调里的发送可能再次 drain，新的接收进 deferred_，下一次 poll 再分发
+        batch_.swap(deferred_);
+        for (const struct io_uring_cqe &cqe : batch_) handle(&cqe);
+        count += batch_.size();
+        batch_.clear();
+        return count;
+    }
+
+    void UringLink::recycle(unsigned bid)
+    {
+        io_uring_buf_ring_add(buf_ring_, &bufs_[(size_t)bid * buf_size_], buf_size_, bid, io_uring_buf_ring_mask(buf_num_), 0);
+        io_uring_buf_ring_advance(buf_ring_, 1);
+    }
+
+    void UringLink::handle(const struct io_uring_cqe *cqe)
+    {
+        uint64_t user = io_uring_cqe_get_data64(cqe);
+        int op = user & 0xFF;
+        uint32_t idx = user >> 8;
+        if (op == OP_SEND) {
+            free_slots_.push_back(idx);
+            if (cqe->res < 0) ++stats_.errors;
+            else ++stats_.sent;
+            return;
+        }
+
+        Source &src = *sources_[idx];
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            uint8_t *buf = &bufs_[(size_t)bid * buf_size_];
+            if (op == OP_RECVMSG && cqe->res > 0) {
+                struct io_uring_recvmsg_out *out = io_uring_recvmsg_validate(buf, cqe->res, &src.msg);
+                if (out && !(out->flags & MSG_TRUNC)) {
+                    const sockaddr_in *from = out->namelen >= sizeof(sockaddr_in) ? (const sockaddr_in *)io_uring_recvmsg_name(out) : nullptr;
+                    uint8_t *payload = (uint8_t *)io_uring_recvmsg_payload(out, &src.msg);
+                    unsigned len = io_uring_recvmsg_payload_length(out, cqe->res, &src.msg);
+                    ++stats_.received;
+                    src.callback(src.fd, payload, len, from);
+                }
+            }
+            else if (op == OP_READ && cqe->res > 0) {
+                ++stats_.received;
+                src.callback(src.fd, buf, cqe->res, nullptr);
+            }
+            recycle(bid);
+        }
+
+        if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -EINTR && cqe->res != -EAGAIN) {
+            // 串口断开等不可恢复的错误，不再重新挂接
+            printf("io_uring receive on fd %d failure: %s\n", src.fd, strerror(-cqe->res));
+            ++stats_.errors;
+            src.alive = false;
+            return;
+        }
+        if (op == OP_READ && cqe->res == 0) {
+            src.alive = false;
+            return;
+        }
+        if (!more) arm(idx);
+    }
+
+    bool UringLink::alive(int fd)
+    {
+        for (auto &src : sources_)
+            if (src->fd == fd) return src->alive;
+        return false;
+    }
+
+    int openSerialFd(const std::string &port, int baudrate)
+    {
+        int fd = open(port.c_str(), O_RDWR | O_NOCTTY);
+        if (fd < 0) return -1;
+        struct termios tio;
+        if (tcgetattr(fd, &tio) != 0) {
+            close(fd);
+            return -1;
+        }
+        cfmakeraw(&tio);
+        speed_t speed;
+        switch (baudrate)
+        {
+        case 9600: speed = B9600; break;
+        case 57600: speed = B57600; break;
+        case 230400: speed = B230400; break;
+        case 460800: speed = B460800; break;
+        case 921600: speed = B921600; break;
+        default: speed = B115200; break;
+        }
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <communication/service_executor.hpp>
+#include <atomic>
+
+using br_packet::ServiceExecutor;
+
+namespace {
+    // 主循环：反复 update 直到 pred 成立或超过 limit 秒
+    template <class Pred>
+    bool spinUntil(ServiceExecutor &ex, Pred pred, double limit)
+    {
+        auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(limit);
+        while (!pred()) {
+            if (std::chrono::steady_clock::now() > end) return false;
+            ex.update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        return true;
+    }
+}
+
+TEST(ServiceExecutor, ReturnsResult)
+{
+    ServiceExecutor ex;
+    ex.init(1, 2, 0.5);
+    int result = -1;
+    ASSERT_TRUE(ex.submit(3, [] { return true; }, [&](bool ok) { result = ok; }));
+    ASSERT_TRUE(spinUntil(ex, [&] { return result >= 0; }, 1.0));
+    EXPECT_EQ(1, result);
+    EXPECT_EQ(0, ex.pending());
+}
+
+TEST(ServiceExecutor, ExceptionReportsFailure)
+{
+    ServiceExecutor ex;
+    ex.init(1, 2, 0.5);
+    int result = -1;
+    ASSERT_TRUE(ex.submit(0, []() -> bool { throw std::runtime_error("boom"); }, [&](bool ok) { result = ok; }));
+    ASSERT_TRUE(spinUntil(ex, [&] { return result >= 0; }, 1.0));
+    EXPECT_EQ(0, result);
+}
+
+// 唯一的工作线程卡在 call 里，超时后后续请求仍能被处理
+TEST(ServiceExecutor, HungHandlerIsReplaced)
+{
+    ServiceExecutor ex;
+    ex.init(1, 2, 0.05);
+    std::atomic<bool> release(false);
+    std::atomic<bool> hung_returned(false);
+    int hung = -1;
+    ASSERT_TRUE(ex.submit(1, [&] {
+        while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        hung_returned = true;
+        return true;
+    }, [&](bool ok) { hung = ok; }));
+    ASSERT_TRUE(spinUntil(ex, [&] { return hung >= 0; }, 1.0));
+    EXPECT_EQ(0, hung);
+    ASSERT_TRUE(spinUntil(ex, [&] { return ex.stuck() == 1; }, 1.0));
+
+    // 队列容量为 2，提交多于容量的请求，全部应由替补线程完成
+    int done = 0, failed = 0;
+    for (int i = 0; i < 6; ++i) {
+        ASSERT_TRUE(ex.submit(2, [] { return true; }, [&](bool ok) { ok ? ++done : ++failed; }));
+        ASSERT_TRUE(spinUntil(ex, [&] { return done + failed == i + 1; }, 1.0));
+    }
+    EXPECT_EQ(6, done);
+    EXPECT_EQ(0, failed);
+
+    // 卡住的调用返回后线程自行退出，结果被丢弃
+    release = true;
+    ASSERT_TRUE(spinUntil(ex, [&] { return ex.stuck() == 0; }, 1.0));
+    EXPECT_TRUE(hung_returned);
+    EXPECT_EQ(0, hung);
+}
+
+// 卡住的线程达到上限后不再补充，超时照常回送失败
+TEST(ServiceExecutor, StuckWorkersAreBounded)
+{
+    ServiceExecutor ex;
+    ex.init(1, 4, 0.02, 2);
+    std::atomic<bool> release(false);
+    std::atomic<int> returned(0);
+    int failed = 0;
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(ex.submit(i, [&] {
+            while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            ++returned;
+            return true;
+        }, [&](bool ok) { if (!ok) ++failed; }));
+        ASSERT_TRUE(spinUntil(ex, [&] { return failed == i + 1; }, 1.0));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ex.update();
+    EXPECT_EQ(2, ex.stuck());
+    release = true;
+    ex.shutdown();
+    // 线程引用了本函数栈上的变量，等它们都返回
+    while (returned < 3) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+// 关闭时不等卡住的调用
+TEST(ServiceExecutor, ShutdownDoesNotWaitForHungCall)
+{
+    std::atomic<bool> release(false), started(false), returned(false);
+    {
+        ServiceExecutor ex;
+        ex.init(1, 2, 10.0);
+        ASSERT_TRUE(ex.submit(0, [&] {
+            started = true;
+            while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            returned = true;
+            return true;
+        }, nullptr));
+        while (!started) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_FALSE(returned);
+    release = true;
+    while (!returned) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
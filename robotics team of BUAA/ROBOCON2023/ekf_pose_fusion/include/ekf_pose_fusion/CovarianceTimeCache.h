@@ -3,7 +3,8 @@
 
 #include "tf/tf.h"
 #include <eigen3/Eigen/Dense>
-#include <set>
+#include <eigen3/Eigen/StdVector>
+#include <vector>
 
 using Eigen::MatrixXd;
 
@@ -12,70 +13,86 @@ namespace uncertain_tf
 
     typedef tf::Stamped<Eigen::MatrixXd> StampedCovariance;
     using tf::CompactFrameID;
-    class CovarianceStorage
+
+    // 定维协方差：位姿融合用 3 维 (x y yaw)，uncertain_tf 的 6 自由度变换用 6 维
+    template <int N>
+    class CovarianceStorageT
     {
     public:
-        CovarianceStorage(){};
+        typedef Eigen::Matrix<double, N, N> Matrix;
 
-        CovarianceStorage(const MatrixXd &data, ros::Time stamp, CompactFrameID frame_id, CompactFrameID child_frame_id); //, CompactFrameID frame_id);
+        CovarianceStorageT() : covariance_(Matrix::Zero()), frame_id_(0), child_frame_id_(0){};
 
-        CovarianceStorage(const CovarianceStorage &rhs)
-        {
-            *this = rhs;
-        }
+        CovarianceStorageT(const Matrix &data, ros::Time stamp, CompactFrameID frame_id = 0, CompactFrameID child_frame_id = 0)
+            : covariance_(data), stamp_(stamp), frame_id_(frame_id), child_frame_id_(child_frame_id){};
 
-        CovarianceStorage &operator=(const CovarianceStorage &rhs)
-        {
-            covariance_ = rhs.covariance_;
-            stamp_ = rhs.stamp_;
-            frame_id_ = rhs.frame_id_;
-            child_frame_id_ = rhs.child_frame_id_;
-            return *this;
-        }
-
-        bool operator<(const CovarianceStorage &b) const
+        bool operator<(const CovarianceStorageT &b) const
         {
             return this->stamp_ < b.stamp_;
         }
 
-        bool operator>(const CovarianceStorage &b) const
+        bool operator>(const CovarianceStorageT &b) const
         {
             return this->stamp_ > b.stamp_;
         }
 
-        MatrixXd covariance_;
+        Matrix covariance_;
         ros::Time stamp_;
         CompactFrameID frame_id_;
         CompactFrameID child_frame_id_;
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     };
 
-    class CovarianceTimeCache
+    // 定容量环形缓冲，构造时一次性分配，插入/查询不再申请堆内存
+    // 下标 0 为最旧，按时间戳二分查找
+    template <int N>
+    class CovarianceTimeCacheT
     {
     public:
+        typedef CovarianceStorageT<N> Storage;
+
         static const int MIN_INTERPOLATION_DISTANCE = 5;                     //!< Number of nano-seconds to not interpolate below.
-        static const unsigned int MAX_LENGTH_LINKED_LIST = 1000000;          //!< Maximum length of linked list, to make sure not to be able to use unlimited memory.
+        static const size_t DEFAULT_CAPACITY = 1024;                         //!< 默认容量，1s 的存储时间下足够 1kHz 的输入
         static const int64_t DEFAULT_MAX_STORAGE_TIME = 1ULL * 1000000000LL; //!< default value of 1 seconds storage
 
-        CovarianceTimeCache(ros::Duration max_storage_time = ros::Duration().fromNSec(DEFAULT_MAX_STORAGE_TIME));
+        CovarianceTimeCacheT(ros::Duration max_storage_time = ros::Duration().fromNSec(DEFAULT_MAX_STORAGE_TIME),
+                             size_t capacity = DEFAULT_CAPACITY);
 
-        bool getData(ros::Time time, CovarianceStorage &data_out, std::string *error_str = 0);
+        bool getData(ros::Time time, Storage &data_out, std::string *error_str = 0);
 
-        bool insertData(const CovarianceStorage &new_data);
+        bool insertData(const Storage &new_data);
 
-        inline uint8_t findClosest(const CovarianceStorage *&one, const CovarianceStorage *&two, ros::Time target_time, std::string *error_str);
+        void clearList();
 
-        inline void interpolate(const CovarianceStorage &one, const CovarianceStorage &two, ros::Time time, CovarianceStorage &output);
+        size_t size() const { return size_; }
+        size_t capacity() const { return ring_.size(); }
+        ros::Time getLatestTimestamp() const { return size_ ? at(size_ - 1).stamp_ : ros::Time(); }
+        ros::Time getOldestTimestamp() const { return size_ ? at(0).stamp_ : ros::Time(); }
 
-        void pruneList();
+        ros::Duration max_storage_time_;
 
-        void clearList();
+    private:
+        uint8_t findClosest(const Storage *&one, const Storage *&two, ros::Time target_time, std::string *error_str);
 
-        typedef std::deque<CovarianceStorage> L_CovarianceStorage;
-        L_CovarianceStorage storage_;
+        void interpolate(const Storage &one, const Storage &two, ros::Time time, Storage &output);
 
-        ros::Duration max_storage_time_;
+        void pruneList();
+
+        Storage &at(size_t i) { return ring_[(head_ + i) % ring_.size()]; }
+        const Storage &at(size_t i) const { return ring_[(head_ + i) % ring_.size()]; }
+        // 第一个 stamp >= time 的下标
+        size_t lowerBound(const ros::Time &time) const;
+
+        std::vector<Storage, Eigen::aligned_allocator<Storage>> ring_;
+        size_t head_, size_;
     };
 
+    typedef CovarianceStorageT<3> CovarianceStorage;
+    typedef CovarianceTimeCacheT<3> CovarianceTimeCache;
+    typedef CovarianceStorageT<6> CovarianceStorage6;
+    typedef CovarianceTimeCacheT<6> CovarianceTimeCache6;
+
 }
 
 #endif
@@ -5,6 +5,10 @@
 #include "ekf_pose_fusion/UncertainTransformer.h"
 #include "ekf_pose_fusion/utfMessage.h"
 #include "ekf_pose_fusion/EigenMultiVariateNormal.hpp"
+#include "ekf_pose_fusion/batch_normal_sampler.hpp"
+#include "ekf_pose_fusion/worker_pool.hpp"
+#include <memory>
+#include <mutex>
 
 // 功能构思
 // 发布transform、cov，并附带时间戳
@@ -42,6 +46,23 @@ namespace uncertain_tf
         void sampleTransformUniformTime(const std::string &target_frame, const std::string &source_frame,
                                         const ros::Time &time_start, const ros::Time &time_end, std::vector<StampedTransform> &output, size_t n);
 
+        //! 无迹变换：用 2N+1 个 sigma 点沿链传播均值和 6 维协方差（x y z yaw pitch roll），结果确定
+        bool unscentedTransform(const std::string &target_frame, const std::string &source_frame,
+                                const ros::Time &time, StampedTransform &mean, MatrixXd &cov);
+
+        //! 同上，time travel 版本
+        bool unscentedTransform(const std::string &target_frame, const ros::Time &target_time,
+                                const std::string &source_frame, const ros::Time &source_time,
+                                const std::string &fixed_frame, StampedTransform &mean, MatrixXd &cov);
+
+        //! 缩放无迹变换参数，默认 alpha = 1, beta = 2, kappa = 0，所有权值非负
+        void setUnscentedParams(double alpha, double beta, double kappa)
+        {
+            ut_alpha_ = alpha;
+            ut_beta_ = beta;
+            ut_kappa_ = kappa;
+        }
+
         void printFrame(std::string last_frame, std::string current_frame, tf::Transform rel);
 
         //! sample n transforms given mean and cov in eigen types
@@ -70,15 +91,54 @@ namespace uncertain_tf
         VectorXd calculateSampleMean(const MatrixXd &x);
 
         //! convert a vector of transforms to a eigen sampleset matrix for covariance calculation
-        MatrixXd sampleSetTFtoMatrixXd(std::vector<tf::StampedTransform> sampleset);
+        MatrixXd sampleSetTFtoMatrixXd(const std::vector<tf::StampedTransform> &sampleset);
+
+        //! 采样用的线程数，0 为硬件线程数；样本数少于 PARALLEL_MIN_SAMPLES 时在调用线程里算
+        //! 线程常驻，第一次并行采样时创建，改线程数后重建
+        void setNumThreads(unsigned int n) { num_threads_ = n; }
+        static const size_t PARALLEL_MIN_SAMPLES = 256;
 
     private:
+        // 链上的一个环节：变换、其协方差，以及向下走时是否取逆
+        struct ChainLink
+        {
+            tf::Transform rel;
+            MatrixXd cov;
+            bool inverse;
+            bool certain; // 协方差全零，不采样
+        };
+
+        // 找出 source 到 target 的坐标系链，按作用顺序返回各环节
+        bool lookupChain(const std::string &target_frame, const std::string &source_frame,
+                         const ros::Time &time, StampedTransform &mean, std::vector<ChainLink> &chain);
+
+        // 沿链相乘，link 环节右乘扰动 delta；link 越界时不扰动
+        tf::Transform composeChain(const std::vector<ChainLink> &chain, size_t link, const VectorXd &delta);
+
+        // 沿链相乘，每个环节各采一个扰动
+        tf::Transform sampleChain(const std::vector<ChainLink> &chain);
+
+        bool unscentedTransform(const std::vector<ChainLink> &chain, tf::Transform &mean, MatrixXd &cov);
+
+        // 把 [0, n) 分块交给常驻线程执行 f(begin, end)，f 抛出的异常在调用线程重新抛出
+        void parallelFor(size_t n, const WorkerPool::Task &f);
+
+        // 每个线程一个采样器，Cholesky 因子按协方差缓存
+        static BatchNormalSampler<6> &threadSampler();
+
+        // 在给定的一组时刻上各采一个样本：先在调用线程里逐个查链，再并行采样
+        void sampleAtTimes(const std::string &target_frame, const std::string &source_frame,
+                           const std::vector<double> &times, std::vector<StampedTransform> &output);
+
         void subscription_callback(const ekf_pose_fusion::utfMessageConstPtr &msg);
 
         ros::NodeHandle node_;
         ros::Subscriber message_subscriber_utf_;
-        EigenMultivariateNormal<double, 6> *emn_;
         UnivariateNormal<double> *univ_;
+        unsigned int num_threads_;
+        std::unique_ptr<WorkerPool> pool_;
+        std::mutex pool_mutex_;
+        double ut_alpha_, ut_beta_, ut_kappa_;
     };
 
     template <typename Derived, typename OtherDerived>
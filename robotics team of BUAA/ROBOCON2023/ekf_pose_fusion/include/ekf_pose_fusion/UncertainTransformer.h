@@ -18,9 +18,9 @@ namespace uncertain_tf
     public:
         bool setCovariance(const StampedCovariance &cov);
 
-        CovarianceTimeCache *getCovariance(unsigned int frame_number);
+        CovarianceTimeCache6 *getCovariance(unsigned int frame_number);
 
-        std::vector<CovarianceTimeCache *> covariances_;
+        std::vector<CovarianceTimeCache6 *> covariances_;
 
         mutable boost::recursive_mutex cov_mutex_;
 
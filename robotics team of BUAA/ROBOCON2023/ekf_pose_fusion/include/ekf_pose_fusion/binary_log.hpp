@@ -0,0 +1,222 @@
+#ifndef __BINARY_LOG_HPP
+#define __BINARY_LOG_HPP
+
+#include "ekf_pose_fusion/mpsc_queue.hpp"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace estimation
+{
+    // 定长二进制记录，每次滤波更新一条；读取见 fusion_log_dump
+    // 协方差只存上三角 xx xy xyaw yy yyaw yawyaw
+    struct FilterLogRecord
+    {
+        uint32_t type;  // 与 LatencyStats::Source 相同：wheel laser visual imu true_pose output
+        uint32_t flags; // 见 FLAG_*
+        int64_t stamp_ns;                     // 数据时间戳
+        int64_t arrival_ns, start_ns, end_ns; // wall time：入队、开始处理、处理完
+        double x[3];   // 更新后的 map->base_footprint x y yaw
+        double P[6];
+        double z[3];   // 量测（wheel、imu 为 odom->base_footprint）
+        double nu[3];  // 新息 z - h(x)
+        double R[6];
+        double m2o[3]; // 处理完时的 map->odom
+        double nis;    // 新息一致性检查的 NIS，未检查时为 0
+        double reserved[2];
+
+        static const uint32_t FLAG_MEASUREMENT = 1;  // z nu R 有效
+        static const uint32_t FLAG_REJECTED = 2;     // 量测过旧或未通过一致性检查，未融合
+        static const uint32_t FLAG_DOWNWEIGHTED = 4; // 已融合，但量测协方差按 NIS 放大过
+        static const uint32_t FLAG_WHEEL_SLIP = 8;   // 判定为轮子打滑，估计直接拉回到量测
+
+        static void packCov(const double *full, double *upper)
+        {
+            upper[0] = full[0];
+            upper[1] = full[1];
+            upper[2] = full[2];
+            upper[3] = full[4];
+            upper[4] = full[5];
+            upper[5] = full[8];
+        }
+    };
+    static_assert(sizeof(FilterLogRecord) == 256, "FilterLogRecord is a fixed 256 byte on-disk layout");
+
+    struct FilterLogHeader
+    {
+        char magic[8]; // "EKFLOG1"
+        uint32_t version;
+        uint32_t record_size;
+        uint64_t count;   // 已写入的记录数，写线程周期性更新
+        uint64_t dropped; // 队列满丢弃的记录数
+        int64_t start_wall_ns;
+        char reserved[24];
+    };
+    static_assert(sizeof(FilterLogHeader) == 64, "FilterLogHeader is a fixed 64 byte on-disk layout");
+
+    // 记录先进无锁队列，后台线程拷进 mmap 的文件，由内核回写磁盘
+    // 融合线程里的 write 只有一次入队，不做系统调用，也不会被磁盘阻塞
+    class BinaryLogger
+    {
+    public:
+        static const size_t GROW_RECORDS = 16384; // 文件每次扩展 4MB
+
+        BinaryLogger(size_t queue_size = 4096)
+            : queue_(queue_size), fd_(-1), map_(NULL), capacity_(0), count_(0), running_(false), dropped_(0) {}
+        ~BinaryLogger() { close(); }
+        BinaryLogger(const BinaryLogger &) = delete;
+
+        // 失败时返回 false，错误信息见 error()
+        bool open(const std::string &path)
+        {
+            close();
+            fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd_ < 0)
+            {
+                error_ = path + ": " + strerror(errno);
+                return false;
+            }
+            count_ = 0;
+            dropped_ = 0;
+            if (!grow())
+            {
+                ::close(fd_);
+                fd_ = -1;
+                return false;
+            }
+            FilterLogHeader *h = header();
+            memset(h, 0, sizeof(*h));
+            memcpy(h->magic, "EKFLOG1", 8);
+            h->version = 1;
+            h->record_size = sizeof(FilterLogRecord);
+            h->start_wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            running_ = true;
+            thread_ = std::thread(&BinaryLogger::flushLoop, this);
+            return true;
+        }
+
+        bool isOpen() const { return running_.load(std::memory_order_relaxed); }
+        const std::string &error() const { return error_; }
+        uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+        // 任意线程，不阻塞；队列满时丢弃并计数
+        void write(const FilterLogRecord &r)
+        {
+            if (!queue_.push(r))
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // 写完队列中剩余的记录，文件截到实际长度
+        void close()
+        {
+            if (thread_.joinable())
+            {
+                running_ = false;
+                thread_.join();
+            }
+            if (map_)
+            {
+                drain();
+                syncHeader();
+                msync(map_, mapSize(), MS_SYNC);
+                munmap(map_, mapSize());
+                if (ftruncate(fd_, sizeof(FilterLogHeader) + count_ * sizeof(FilterLogRecord)) != 0)
+                    error_ = std::string("truncate: ") + strerror(errno);
+            }
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+                fd_ = -1;
+            }
+            // 回到未打开的状态，再次 open() 时 grow() 从零开始映射
+            map_ = NULL;
+            capacity_ = 0;
+            count_ = 0;
+        }
+
+    private:
+        void flushLoop()
+        {
+            while (running_.load(std::memory_order_relaxed))
+            {
+                if (drain())
+                    syncHeader();
+                else
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+
+        // 只在写线程（或 close 中线程结束后）调用
+        bool drain()
+        {
+            bool any = false;
+            FilterLogRecord r;
+            while (queue_.pop(r))
+            {
+                if (count_ == capacity_ && !grow())
+                {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                memcpy(records() + count_, &r, sizeof(r));
+                ++count_;
+                any = true;
+            }
+            return any;
+        }
+
+        // 计数在记录之后写，进程崩溃时文件里的计数不会超过有效记录
+        void syncHeader()
+        {
+            header()->dropped = dropped_.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            header()->count = count_;
+        }
+
+        bool grow()
+        {
+            size_t old_size = mapSize();
+            size_t new_capacity = capacity_ + GROW_RECORDS;
+            size_t new_size = sizeof(FilterLogHeader) + new_capacity * sizeof(FilterLogRecord);
+            if (ftruncate(fd_, new_size) != 0)
+            {
+                error_ = std::string("ftruncate: ") + strerror(errno);
+                return false;
+            }
+            void *m = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (m == MAP_FAILED)
+            {
+                error_ = std::string("mmap: ") + strerror(errno);
+                return false;
+            }
+            if (map_)
+                munmap(map_, old_size);
+            map_ = static_cast<char *>(m);
+            capacity_ = new_capacity;
+            return true;
+        }
+
+        size_t mapSize() const { return sizeof(FilterLogHeader) + capacity_ * sizeof(FilterLogRecord); }
+        FilterLogHeader *header() { return reinterpret_cast<FilterLogHeader *>(map_); }
+        FilterLogRecord *records() { return reinterpret_cast<FilterLogRecord *>(map_ + sizeof(FilterLogHeader)); }
+
+        MpscQueue<FilterLogRecord> queue_;
+        int fd_;
+        char *map_;
+        size_t capacity_, count_;
+        std::atomic<bool> running_;
+        std::atomic<uint64_t> dropped_;
+        std::thread thread_;
+        std::string error_;
+    };
+}
+
+#endif
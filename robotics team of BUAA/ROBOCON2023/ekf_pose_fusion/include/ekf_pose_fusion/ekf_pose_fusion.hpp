@@ -7,23 +7,44 @@
 #include <tf/tf.h>
 #include <tf/transform_listener.h>
 #include <tf/transform_broadcaster.h>
-#include "odom_estimation.h"
 
 // messages
 #include "nav_msgs/Odometry.h"
 #include "geometry_msgs/Twist.h"
 #include "sensor_msgs/Imu.h"
+#include "sensor_msgs/LaserScan.h"
 #include "geometry_msgs/PoseStamped.h"
 #include "geometry_msgs/PoseWithCovarianceStamped.h"
+#include "ekf_pose_fusion/ExtrapolatedPose.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include "std_srvs/Trigger.h"
 
 #include <boost/thread/mutex.hpp>
 #include "ekf_pose_fusion/CovarianceTimeCache.h"
+#include "ekf_pose_fusion/fixed_ekf.hpp"
+#include "ekf_pose_fusion/object_pool.hpp"
+#include "ekf_pose_fusion/time_ring.hpp"
+#include "ekf_pose_fusion/seqlock.hpp"
+#include "ekf_pose_fusion/pose_history.hpp"
+#include "ekf_pose_fusion/imu_predictor.hpp"
+#include "ekf_pose_fusion/se2.hpp"
+#include "ekf_pose_fusion/mpsc_queue.hpp"
+#include "ekf_pose_fusion/latency_stats.hpp"
+#include "ekf_pose_fusion/binary_log.hpp"
+#include "ekf_pose_fusion/global_relocalizer.hpp"
+#include "ekf_pose_fusion/scan_matcher.hpp"
+#include "ekf_pose_fusion/field_map_file.hpp"
+#include "ekf_pose_fusion/pose_smoother.hpp"
+#include "ekf_pose_fusion/innovation_monitor.hpp"
 
 // log files
 #include <fstream>
 
 #include <mutex>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
 
 namespace estimation
 {
@@ -31,68 +52,75 @@ namespace estimation
     typedef boost::shared_ptr<nav_msgs::Odometry const> wheel_odomConstPtr;
     typedef boost::shared_ptr<geometry_msgs::PoseWithCovarianceStamped const> visual_odomConstPtr;
     typedef boost::shared_ptr<geometry_msgs::PoseWithCovarianceStamped const> laser_odomConstPtr;
-    // utils functions
+    typedef boost::shared_ptr<sensor_msgs::Imu const> imuConstPtr;
+    // utils functions，角度处理都是常数时间，见 se2.hpp
     static void angleOverflowCorrect(double &a, double ref)
     {
-        // while ((a - ref) > M_PI)
-        //     a -= 2 * M_PI;
-        // while ((a - ref) < -M_PI)
-        //     a += 2 * M_PI;
-
-        while (fabs(a - ref) > fabs(a - 2 * M_PI - ref))
-        {
-            a -= 2 * M_PI;
-        }
-        while (fabs(a - ref) > fabs(a + 2 * M_PI - ref))
-        {
-            a += 2 * M_PI;
-        }
+        a = nearestAngle(a, ref);
     }
     static void customizAngle_in_fabsPi(double &an)
     {
-        while (an > M_PI)
-            an -= 2 * M_PI;
-        while (an < -M_PI)
-            an += 2 * M_PI;
+        an = wrapAngle(an);
     }
-    static void ColumnVector2Transform(MatrixWrapper::ColumnVector &state, tf::Transform &trans)
+    static void ColumnVector2Transform(const Eigen::Vector3d &state, tf::Transform &trans)
     {
-        trans.setOrigin(tf::Vector3(state(1), state(2), 0));
-        tf::Quaternion q;
-        q.setRPY(0, 0, state(3));
-        q.normalize();
-        trans.setRotation(q);
+        trans = SE2(state).toTransform();
+    }
+    static void decomposeTransform(const tf::Transform &trans, Eigen::Vector3d &vec)
+    {
+        vec = SE2::fromTransform(trans).vec();
     }
     class pose_factor
     {
     public:
         ros::Time stamp;
-        tf::Transform woTrans;
+        SE2 woTrans; // 量测时刻的 odom->base_footprint
         Eigen::Matrix3d cov;
-        tf::Transform measurement;
-        using Ptr = std::shared_ptr<pose_factor>;
+        SE2 measurement;
+
+        // factor 来自定容量池，Ptr 析构时归还到池中
+        static const int POOL_SIZE = 64;
+        typedef ObjectPool<pose_factor, POOL_SIZE> Pool;
+        static Pool &pool()
+        {
+            static Pool p;
+            return p;
+        }
+        struct Release
+        {
+            void operator()(pose_factor *f) const { pool().release(f); }
+        };
+        using Ptr = std::unique_ptr<pose_factor, Release>;
+        // 池空时返回空指针
+        static Ptr create() { return Ptr(pool().acquire()); }
     };
     class pose_fuser;
     class BR_transformer
     {
-        boost::mutex m2o_mutex;
-        boost::mutex o2b_mutex;
-        boost::mutex m2b_cov_mutex;
+        // map2odom 与 odom2basefootprint 成对发布，读者通过顺序锁无锁读取一致的快照
+        struct Frames
+        {
+            double m2o[7]; // x y z qx qy qz qw
+            double o2b[7];
+            int64_t m2o_stamp, o2b_stamp; // ns
+        };
+        SeqLock<Frames> frames_;
+        // 写者之间互斥，写者持有的工作副本只在此锁内访问
+        boost::mutex write_mutex;
+        tf::StampedTransform map2odom_;
+        tf::StampedTransform odom2basefootprint_;
+        // 位姿历史的锁，先 write_mutex 后 list_mutex
+        boost::mutex list_mutex;
         bool fuserSeted = false;
 
     public:
-        tf::StampedTransform map2odom;
-        tf::StampedTransform odom2basefootprint;
         std::string map_frame;            // CompactFrameID as 1
         std::string odom_frame;           // CompactFrameID as 2
         std::string base_footprint_frame; // CompactFrameID as 3
         std::string laser_frame;          // CompactFrameID as 4
         std::string camera_frame;         // CompactFrameID as 5
-        tf::TimeCache m2o_list;
-        tf::TimeCache o2b_list;
-        tf::TimeCache true_pose_list;
-        uncertain_tf::CovarianceTimeCache m2b_cov_list;
-        uncertain_tf::CovarianceTimeCache m2o_cov_list;
+        // map2odom、odom2basefootprint、真值与 map->base 协方差共用一条时间索引
+        PoseHistory history;
         class pose_fuser *fuser;
 
     public:
@@ -104,12 +132,13 @@ namespace estimation
         BR_transformer()
         {
             getFrameParams();
-            map2odom.setIdentity();
-            map2odom.frame_id_ = map_frame;
-            map2odom.child_frame_id_ = odom_frame;
-            odom2basefootprint.setIdentity();
-            odom2basefootprint.frame_id_ = odom_frame;
-            odom2basefootprint.child_frame_id_ = base_footprint_frame;
+            map2odom_.setIdentity();
+            map2odom_.frame_id_ = map_frame;
+            map2odom_.child_frame_id_ = odom_frame;
+            odom2basefootprint_.setIdentity();
+            odom2basefootprint_.frame_id_ = odom_frame;
+            odom2basefootprint_.child_frame_id_ = base_footprint_frame;
+            publishFrames();
         }
         void getFrameParams()
         {
@@ -121,363 +150,589 @@ namespace estimation
             n_pri.param<std::string>("odom_frame", odom_frame, "odom");
         }
 
-        void set_m2o(double x, double y, double alpha, const ros::Time &stamp)
+        // 读者接口，不会阻塞写者，也不会读到一半更新的变换
+        tf::StampedTransform get_m2o() const
+        {
+            Frames f = frames_.load();
+            return unpack(f.m2o, f.m2o_stamp, map_frame, odom_frame);
+        }
+        tf::StampedTransform get_o2b() const
         {
-            boost::mutex::scoped_lock(m2o_mutex);
+            Frames f = frames_.load();
+            return unpack(f.o2b, f.o2b_stamp, odom_frame, base_footprint_frame);
+        }
+        // 同一时刻的一对变换
+        void get_frames(tf::StampedTransform &m2o, tf::StampedTransform &o2b) const
+        {
+            Frames f = frames_.load();
+            m2o = unpack(f.m2o, f.m2o_stamp, map_frame, odom_frame);
+            o2b = unpack(f.o2b, f.o2b_stamp, odom_frame, base_footprint_frame);
+        }
 
-            map2odom.setOrigin(tf::Vector3(x, y, 0));
-            map2odom.setRotation(tf::createQuaternionFromRPY(0, 0, alpha));
-            map2odom.stamp_ = stamp;
-            m2o_list.insertData(tf::TransformStorage(map2odom, 1, 2));
+        void set_m2o(double x, double y, double alpha, const ros::Time &stamp)
+        {
+            set_m2o(SE2(x, y, alpha), stamp);
         }
 
         void set_o2b(double x, double y, double alpha, const ros::Time &stamp)
         {
-            boost::mutex::scoped_lock(o2b_mutex);
+            set_o2b(SE2(x, y, alpha), stamp);
+        }
+        void set_m2o(const SE2 &p, const ros::Time &stamp)
+        {
+            boost::mutex::scoped_lock lock(write_mutex);
 
-            odom2basefootprint.setOrigin(tf::Vector3(x, y, 0));
-            tf::Quaternion q;
-            q.setRPY(0, 0, alpha);
-            q.normalize();
-            odom2basefootprint.setRotation(q);
-            odom2basefootprint.stamp_ = stamp;
-            if (!o2b_list.insertData(tf::TransformStorage(odom2basefootprint, 2, 3)))
-            {
-                ROS_ERROR("set failed");
-                std::cout << "lastest: " << o2b_list.getLatestTimestamp() << std::endl;
-                std::cout << "this: " << stamp << std::endl;
-            }
+            map2odom_.setData(p.toTransform());
+            map2odom_.stamp_ = stamp;
+            publishFrames();
+            boost::mutex::scoped_lock list_lock(list_mutex);
+            history.insert(PoseHistory::M2O, stamp, p);
         }
-        void decomposeTransform(const tf::Transform &trans, MatrixWrapper::ColumnVector &vec)
+        void set_o2b(const SE2 &p, const ros::Time &stamp)
         {
-            vec(1) = trans.getOrigin().x();
-            vec(2) = trans.getOrigin().y();
-            vec(3) = getYaw(trans.getRotation());
-        };
+            boost::mutex::scoped_lock lock(write_mutex);
+
+            odom2basefootprint_.setData(p.toTransform());
+            odom2basefootprint_.stamp_ = stamp;
+            publishFrames();
+            insert_o2b(p);
+        }
         void compensate_m2o(const tf::Transform &comp, const ros::Time &stamp)
         {
-            boost::mutex::scoped_lock(m2o_mutex);
+            boost::mutex::scoped_lock lock(write_mutex);
 
-            map2odom *= comp;
-            map2odom.stamp_ = stamp;
-            m2o_list.insertData(tf::TransformStorage(map2odom, 1, 2));
-            MatrixWrapper::ColumnVector m2ovec(3);
-            decomposeTransform(map2odom, m2ovec);
-            std::cout << "compen m2ovec: " << m2ovec << std::endl;
+            map2odom_ *= comp;
+            map2odom_.stamp_ = stamp;
+            publishFrames();
+            {
+                boost::mutex::scoped_lock list_lock(list_mutex);
+                history.insert(PoseHistory::M2O, stamp, map2odom_);
+            }
+            Eigen::Vector3d m2ovec;
+            decomposeTransform(map2odom_, m2ovec);
+            std::cout << "compen m2ovec: " << m2ovec.transpose() << std::endl;
         }
         void set_m2o(const tf::Transform &trans, const ros::Time &stamp)
         {
-            boost::mutex::scoped_lock(m2o_mutex);
+            boost::mutex::scoped_lock lock(write_mutex);
 
-            map2odom.setRotation(trans.getRotation().normalize());
-            map2odom.setOrigin(trans.getOrigin());
-            map2odom.stamp_ = stamp;
+            map2odom_.setRotation(trans.getRotation().normalize());
+            map2odom_.setOrigin(trans.getOrigin());
+            map2odom_.stamp_ = stamp;
+            publishFrames();
 
-            // 此处出现segmentation fault, 时间戳跳跃问题
-            m2o_list.insertData(tf::TransformStorage(map2odom, 1, 2));
+            boost::mutex::scoped_lock list_lock(list_mutex);
+            history.insert(PoseHistory::M2O, stamp, map2odom_);
         }
         void set_o2b(const tf::Transform &trans, const ros::Time &stamp)
         {
-            boost::mutex::scoped_lock(o2b_mutex);
-
-            odom2basefootprint.setRotation(trans.getRotation().normalize());
-            odom2basefootprint.setOrigin(trans.getOrigin());
-            odom2basefootprint.stamp_ = stamp;
-            if (!o2b_list.insertData(tf::TransformStorage(odom2basefootprint, 2, 3)))
-            {
-                ROS_ERROR("set failed");
+            boost::mutex::scoped_lock lock(write_mutex);
 
-                std::cout << "lastest: " << o2b_list.getLatestTimestamp() << std::endl;
-                std::cout << "this: " << stamp << std::endl;
-            }
+            odom2basefootprint_.setRotation(trans.getRotation().normalize());
+            odom2basefootprint_.setOrigin(trans.getOrigin());
+            odom2basefootprint_.stamp_ = stamp;
+            publishFrames();
+            insert_o2b(SE2::fromTransform(odom2basefootprint_));
         }
 
         void pub_m2o(const ros::Time &stamp)
         {
-            boost::mutex::scoped_lock(m2o_mutex);
+            boost::mutex::scoped_lock lock(write_mutex);
 
-            map2odom.stamp_ = stamp;
+            map2odom_.stamp_ = stamp;
+            publishFrames();
         }
 
         void pub_o2b(const ros::Time &stamp)
         {
-            boost::mutex::scoped_lock(o2b_mutex);
+            boost::mutex::scoped_lock lock(write_mutex);
 
-            odom2basefootprint.stamp_ = stamp;
+            odom2basefootprint_.stamp_ = stamp;
+            publishFrames();
         }
 
-        void set_m2b_cov(const Eigen::MatrixXd &cov, const ros::Time &stamp)
+        void set_m2b_cov(const Eigen::Matrix3d &cov, const ros::Time &stamp)
         {
-            using namespace uncertain_tf;
-            boost::mutex::scoped_lock(o2b_cov_mutex);
+            boost::mutex::scoped_lock lock(list_mutex);
+            history.setCovariance(stamp, cov);
+        }
 
-            CovarianceStorage covsto(cov, stamp, 1, 3);
-            m2b_cov_list.insertData(covsto);
+        // 一次查询得到该时刻的全部坐标系与协方差；超出历史范围时返回最新值并返回 false
+        bool lookup_frames(const ros::Time &time, PoseHistory::Sample &out)
+        {
+            boost::mutex::scoped_lock lock(list_mutex);
+            if (history.lookup(time, out))
+                return true;
+            history.lookup(ros::Time(0), out);
+            return false;
+        }
+        void insert_true_pose(const tf::Transform &pose, const ros::Time &stamp)
+        {
+            boost::mutex::scoped_lock lock(list_mutex);
+            history.insert(PoseHistory::TRUE_POSE, stamp, pose);
         }
 
         void lookupPoseAndCov(const ros::Time &time, tf::Transform &transform, uncertain_tf::CovarianceStorage &cs)
         {
+            PoseHistory::Sample frames;
+            if (!lookup_frames(time, frames))
+                ROS_ERROR("it is trans");
+            transform = get_m2o() * frames.transform(PoseHistory::O2B);
+            cs = uncertain_tf::CovarianceStorage(frames.cov, time, 1, 3);
+        }
 
-            // TODO 记得改这里的插值
-            tf::TransformStorage m2o, o2b;
-
-            {
-                boost::mutex::scoped_lock(m2o_mutex);
-                boost::mutex::scoped_lock(o2b_mutex);
-
-                if ((!m2o_list.getData(time, m2o)) || (!o2b_list.getData(time, o2b)))
-                {
-                    m2o_list.getData(ros::Time(0), m2o);
-                    o2b_list.getData(ros::Time(0), o2b);
-                    ROS_ERROR("it is trans");
-                }
-
-                transform = map2odom * tf::Transform(o2b.rotation_, o2b.translation_);
-            }
+    private:
+        // 需持有 write_mutex
+        void publishFrames()
+        {
+            Frames f;
+            pack(map2odom_, f.m2o);
+            pack(odom2basefootprint_, f.o2b);
+            f.m2o_stamp = map2odom_.stamp_.toNSec();
+            f.o2b_stamp = odom2basefootprint_.stamp_.toNSec();
+            frames_.store(f);
+        }
+        // 需持有 write_mutex
+        void insert_o2b(const SE2 &p)
+        {
+            boost::mutex::scoped_lock list_lock(list_mutex);
+            if (!history.insert(PoseHistory::O2B, odom2basefootprint_.stamp_, p))
             {
-                boost::mutex::scoped_lock(m2b_cov_mutex);
-
-                if (!m2b_cov_list.getData(time, cs))
-                {
-                    m2b_cov_list.getData(ros::Time(0), cs);
-                    ROS_ERROR("it is cov");
-                }
+                ROS_ERROR("set failed");
+                std::cout << "oldest: " << history.oldest() << std::endl;
+                std::cout << "this: " << odom2basefootprint_.stamp_ << std::endl;
             }
-
-            // listener.getCovariance(listener.lookupOrInsertFrameNumber(base_footprint_frame))->getData(time, cs);
+        }
+        static void pack(const tf::Transform &t, double *d)
+        {
+            const tf::Vector3 &o = t.getOrigin();
+            tf::Quaternion q = t.getRotation();
+            d[0] = o.x();
+            d[1] = o.y();
+            d[2] = o.z();
+            d[3] = q.x();
+            d[4] = q.y();
+            d[5] = q.z();
+            d[6] = q.w();
+        }
+        static tf::StampedTransform unpack(const double *d, int64_t stamp, const std::string &frame, const std::string &child)
+        {
+            ros::Time t;
+            t.fromNSec(stamp);
+            return tf::StampedTransform(tf::Transform(tf::Quaternion(d[3], d[4], d[5], d[6]), tf::Vector3(d[0], d[1], d[2])),
+                                        t, frame, child);
         }
     };
     class pose_fuser
     {
     public:
         bool transformerSeted = false;
-        int fuse_list_length = 10;
-        ros::Time last_filt_time;
-        tf::Transform last_filt_woTrans;
+        ros::Time last_filt_time; // 最近一次融合的量测时间戳
+        // 轮式里程计预测的过程噪声：每米、每弧度增加的方差，以及每步的基础方差
+        double odom_noise_xy = 1e-3;
+        double odom_noise_yaw = 1e-3;
+        double odom_noise_min = 1e-8;
+        // EKF：状态历史上逐条预测、更新，乱序时重放；SMOOTHER：每个量测一个节点的滑窗位姿图，见 SlidingWindowSmoother
+        // 两者发布的 map2odom 相同，都取最新量测时刻的估计；需在 initFilter 之前设置
+        enum Backend
+        {
+            EKF,
+            SMOOTHER
+        };
+        Backend backend = EKF;
+        int smoother_window = 20;
+        int smoother_iterations = 3;
+
+        // 新息一致性检查，两种后端相同
+        // 雷达：量测相对预测的 NIS 过卡方门限，超出的按比例降权或丢弃
+        // 单帧对不上时分不清是雷达错配还是轮子打滑，先当作错配丢弃。以下两种情况认为是估计随打滑偏了：
+        // 下一帧与被丢弃的那帧按里程计增量一致（打滑已结束，两帧雷达都对），或已连续丢弃 reject_limit 帧（仍在打滑）。
+        // 此时把新息计入预测协方差再融合，估计直接拉回到雷达
+        bool gating = true;
+        NisGate lidar_gate;
+        NisGate wheel_gate;
+        int reject_limit = 3;
+        double slip_max_gap = 1.0; // 相邻雷达量测间隔超过此值 (s) 不做打滑检查
+        NisMonitor lidar_nis, wheel_nis; // 供诊断汇报读取
+
+        // 最近一次 addMeasurements 的检查结果
+        struct MeasurementCheck
+        {
+            double nis = 0;       // 雷达 NIS，未检查时为 0
+            double wheel_nis = 0; // 与上一帧雷达之间里程计增量的 NIS，未检查时为 0
+            NisGate::Verdict verdict = NisGate::ACCEPT;
+            bool slip = false;
+            bool too_old = false; // 早于状态历史或平滑窗口，没有检查
+        };
+
+        // 某一时刻的滤波状态。轮式里程计每帧记一条，量测按自己的时间戳插入
+        struct Snapshot
+        {
+            ros::Time stamp;
+            SE2 o2b;           // 该时刻的 odom->base_footprint
+            Eigen::Vector3d x; // map->base_footprint 后验 x y yaw
+            Eigen::Matrix3d P;
+            bool has_meas = false; // 该时刻有量测，重放时需要再次融合
+            Eigen::Vector3d z;
+            Eigen::Matrix3d R;
+            Eigen::Vector3d nu; // 最近一次融合时的新息
+            // 以下只对有量测的状态有效，重放时按相同条件重新判定
+            double nis = 0;
+            NisGate::Verdict verdict = NisGate::ACCEPT;
+            bool slip_candidate = false; // 插入时满足打滑条件，对不上时不丢弃
+            bool slip = false;           // 判定为打滑，新息已计入预测协方差
+        };
 
-        std::vector<pose_factor::Ptr> factor_list;
+    private:
         class BR_transformer *trans_ptr;
-        BFL::LinearAnalyticSystemModelGaussianUncertainty *sys_model_;
-        BFL::LinearAnalyticConditionalGaussian *sys_pdf_;
-        BFL::LinearAnalyticConditionalGaussian *meas_pdf_;
-        BFL::LinearAnalyticMeasurementModelGaussianUncertainty *meas_model_;
-        BFL::Gaussian *prior_;
-        BFL::ExtendedKalmanFilter *filter_;
+        // 3维位姿 x y yaw，量测直接观测全状态
+        FixedEKF<3> filter_;
+        TimeRing<Snapshot> history_;
+        boost::mutex history_mutex_;
+        SlidingWindowSmoother smoother_;
+        // 平滑后端只在量测时刻有节点，记下最新一帧里程计用于 snapshotAt
+        ros::Time last_odom_stamp_;
+        SE2 last_odom_;
+        // 打滑检查的参考：按时间顺序的上一帧雷达量测，不论是否被丢弃
+        struct LastMeasurement
+        {
+            bool valid = false;
+            bool rejected = false;
+            ros::Time stamp;
+            SE2 o2b;
+            Eigen::Vector3d z;
+            Eigen::Matrix3d R;
+        } last_meas_;
+        int lidar_rejects_ = 0; // 连续未直接通过门限（丢弃或按打滑接受）的雷达量测数
+        MeasurementCheck last_check_;
 
     public:
-        pose_fuser()
-        {
-            using namespace MatrixWrapper;
-            using namespace BFL;
-            ColumnVector sysNoise_Mu(3);
-            sysNoise_Mu = 0;
-            SymmetricMatrix sysNoise_Cov(3);
-            // sys的过程噪声设置为0，实际的过程噪声直接在updateCov中加入，故过程噪声就不再重复叠加
-            sysNoise_Cov = 0;
-
-            Matrix A(3, 3);
-            A = 0;
-            A(1, 1) = 1.0;
-            A(2, 2) = 1.0;
-            A(3, 3) = 1.0;
-            Matrix B(3, 3);
-            B = 0;
-            B(1, 1) = 1.0;
-            B(2, 1) = 1.0;
-            B(3, 3) = 1.0;
-
-            std::vector<Matrix> AB(2);
-            AB[0] = A;
-            AB[1] = B;
-
-            Gaussian system_Uncertainty(sysNoise_Mu, sysNoise_Cov);
-            sys_pdf_ = new LinearAnalyticConditionalGaussian(AB, system_Uncertainty);
-            sys_model_ = new LinearAnalyticSystemModelGaussianUncertainty(sys_pdf_);
-
-            ColumnVector measNoise_Mu(3);
-            measNoise_Mu = 0;
-            SymmetricMatrix measNoise_Cov(3);
-            measNoise_Cov = 0;
-            for (unsigned int i = 1; i <= 3; i++)
-                measNoise_Cov(i, i) = pow(0.008, 2);
-            Gaussian measurement_Uncertainty(measNoise_Mu, measNoise_Cov);
-            Matrix H(3, 3);
-            H = 0;
-            H(1, 1) = 1;
-            H(2, 2) = 1;
-            H(3, 3) = 1;
-            meas_pdf_ = new LinearAnalyticConditionalGaussian(H, measurement_Uncertainty);
-            meas_model_ = new LinearAnalyticMeasurementModelGaussianUncertainty(meas_pdf_);
-        }
+        pose_fuser(size_t history_length = 400) : history_(history_length) {}
         void setTransformer(class BR_transformer *_ptr)
         {
             trans_ptr = _ptr;
             transformerSeted = true;
         }
+        // 历史长度决定能接受多晚到达的量测，需在 initFilter 之前设置
+        void setHistoryLength(size_t length)
+        {
+            boost::mutex::scoped_lock lock(history_mutex_);
+            history_.reset(length);
+        }
         void initFilter(const tf::Transform &prior, const ros::Time &time)
         {
-            using namespace MatrixWrapper;
-            using namespace BFL;
-            ColumnVector prior_Mu(3);
-            decomposeTransform(prior, prior_Mu);
-            SymmetricMatrix prior_Cov(3);
-            for (unsigned int i = 1; i <= 3; i++)
+            initFilter(prior, time, Eigen::Matrix3d::Identity() * pow(0.01, 2));
+        }
+        // 重定位后以新位姿和协方差重新开始，之前的历史全部作废
+        void initFilter(const tf::Transform &prior, const ros::Time &time, const Eigen::Matrix3d &cov)
+        {
+            assert(transformerSeted);
+            boost::mutex::scoped_lock lock(history_mutex_);
+            Snapshot s;
+            s.stamp = time;
+            s.o2b = SE2::fromTransform(trans_ptr->get_o2b());
+            s.x = SE2::fromTransform(prior).vec();
+            s.P = cov;
+            history_.clear();
+            history_.push_back(s);
+            last_meas_.valid = false;
+            lidar_rejects_ = 0;
+            if (backend == SMOOTHER)
             {
-                for (unsigned int j = 1; j <= 3; j++)
-                {
-                    if (i == j)
-                        prior_Cov(i, j) = pow(0.01, 2);
-                    else
-                        prior_Cov(i, j) = 0;
-                }
+                smoother_.options.window = smoother_window;
+                smoother_.options.max_iterations = smoother_iterations;
+                smoother_.options.odom_noise_xy = odom_noise_xy;
+                smoother_.options.odom_noise_yaw = odom_noise_yaw;
+                smoother_.options.odom_noise_min = odom_noise_min;
+                smoother_.reset(time, s.o2b, s.x, cov);
+                last_odom_stamp_ = time;
+                last_odom_ = s.o2b;
             }
-            prior_ = new Gaussian(prior_Mu, prior_Cov);
-            filter_ = new ExtendedKalmanFilter(prior_);
         }
-        void updateCov(ros::Time &last, ros::Time &now, tf::Transform &lastwo, tf::Transform &thiswo)
-        // 直接对filter_进行处理
+
+        // 轮式里程计到达：在前一状态上按里程计增量预测并记入历史
+        void addOdometry(const SE2 &o2b, const ros::Time &stamp)
         {
-            MatrixWrapper::SymmetricMatrix cov(3);
-            cov = 0;
-            for (int i = 1; i <= 3; ++i)
+            boost::mutex::scoped_lock lock(history_mutex_);
+            if (backend == SMOOTHER)
             {
-                cov(i, i) = 1e-5;
+                // map2odom 只随量测变化，里程计本身不需要处理
+                if (stamp >= last_odom_stamp_)
+                {
+                    last_odom_stamp_ = stamp;
+                    last_odom_ = o2b;
+                }
+                return;
             }
-            filter_->PostGet()->CovarianceSet(cov);
+            Snapshot s;
+            s.stamp = stamp;
+            s.o2b = o2b;
+            size_t pos = insert(s);
+            if (pos == 0)
+                return;
+            // 里程计晚于量测到达时，后面的状态需要重放，并更新 map2odom
+            replay(pos);
+            if (pos + 1 < history_.size())
+                publishLatest();
         }
-        void decomposeTransform(const tf::Transform &trans, MatrixWrapper::ColumnVector &vec)
+
+        // 量测到达：插到自己的时间戳上融合，再重放之后的里程计与量测
+        // 过旧或未通过卡方门限时返回 false，检查结果见 lastCheck
+        bool addMeasurements(pose_factor::Ptr &factor)
         {
-            vec(1) = trans.getOrigin().x();
-            vec(2) = trans.getOrigin().y();
-            vec(3) = getYaw(trans.getRotation());
-        };
-        MatrixWrapper::SymmetricMatrix eigen2wraped(const Eigen::MatrixXd &eig)
-        {
-            MatrixWrapper::SymmetricMatrix ret(eig.rows());
-            for (unsigned int i = 0; i < eig.rows(); i++)
-                for (unsigned int j = 0; j < eig.rows(); j++)
-                    ret(i + 1, j + 1) = eig(i, j);
-            return ret;
-        }
-        void ColumnVector2Transform(MatrixWrapper::ColumnVector &state, tf::Transform &trans)
-        {
-            trans.setOrigin(tf::Vector3(state(1), state(2), 0));
-            tf::Quaternion q;
-            q.setRPY(0, 0, state(3));
-            q.normalize();
-            trans.setRotation(q);
-        }
-        void fuseList(void)
-        {
-            using namespace std;
-            // 对已经排序的list进行融合（其实排序不是必须的）
-            // get current wo trans, 需要与transformer进行交互，应该进一步设计类的关系
-            // 调用 getCurrentWoTF
-            tf::Transform curr_m2o, curr_o2b;
-            getCurrentTF(curr_o2b, curr_m2o, factor_list.back()->stamp);
-
-            // 设置为自上次校准之后的wo叠加值
-            MatrixWrapper::ColumnVector pripose(3);
-            decomposeTransform(curr_m2o * curr_o2b, pripose);
-            filter_->PostGet()->ExpectedValueSet(pripose);
-            std::cout << pripose << std::endl;
-            // 先验协方差的更新是与时间间隔、位移变化量有关的
-            updateCov(last_filt_time, factor_list.back()->stamp, last_filt_woTrans, curr_o2b);
-            cout << filter_->PostGet()->CovarianceGet() << endl;
-
-            MatrixWrapper::ColumnVector meas(3);
-            for (int i = 0; i < factor_list.size(); i++)
+            boost::mutex::scoped_lock lock(history_mutex_);
+            MeasurementCheck check;
+            Eigen::Vector3d z = factor->measurement.vec();
+            bool slip_candidate = lidar_rejects_ >= reject_limit;
+            if (gating && checkWheel(factor->stamp, factor->woTrans, z, factor->cov, check.wheel_nis))
+                slip_candidate = slip_candidate || last_meas_.rejected;
+            bool fused = backend == SMOOTHER ? addToSmoother(factor, z, slip_candidate, check)
+                                             : addToHistory(factor, z, slip_candidate, check);
+            last_check_ = check;
+            if (check.too_old)
+                return false;
+            if (gating)
             {
-
-                decomposeTransform(factor_list[i]->measurement * factor_list[i]->woTrans.inverse() * curr_o2b, meas);
-                angleOverflowCorrect(meas(3), filter_->PostGet()->ExpectedValueGet()(3));
-                meas_pdf_->AdditiveNoiseSigmaSet(eigen2wraped(factor_list[i]->cov));
-                cout << meas << endl;
-                filter_->Update(sys_model_, MatrixWrapper::ColumnVector(3) = 0, meas_model_, meas);
-                if (i == (factor_list.size() - 1))
+                lidar_nis.record(check.nis, check.verdict);
+                // 轮式一致性只在两帧雷达都可信时统计；确认打滑记为一次丢弃
+                if (check.slip)
+                    wheel_nis.record(check.wheel_nis, NisGate::REJECT);
+                else if (check.wheel_nis > 0 && fused && !last_meas_.rejected)
                 {
-                    customizAngle_in_fabsPi(filter_->PostGet()->ExpectedValueGet()(3));
+                    // checkWheel 对不上时 NIS 已超过 accept，按门限实际判定计数
+                    double wheel_scale;
+                    wheel_nis.record(check.wheel_nis, wheel_gate.classify(check.wheel_nis, wheel_scale));
                 }
-                cout << filter_->PostGet()->CovarianceGet() << endl;
-                cout << filter_->PostGet()->ExpectedValueGet() << endl;
+                // 按打滑接受的帧不清零：若它其实是错配，下一帧还能直接拉回
+                lidar_rejects_ = fused && !check.slip ? 0 : lidar_rejects_ + 1;
+            }
+            if (!last_meas_.valid || factor->stamp >= last_meas_.stamp)
+            {
+                last_meas_.valid = true;
+                last_meas_.rejected = !fused;
+                last_meas_.stamp = factor->stamp;
+                last_meas_.o2b = factor->woTrans;
+                last_meas_.z = z;
+                last_meas_.R = factor->cov;
             }
+            if (!fused)
+                return false;
+            if (factor->stamp > last_filt_time)
+                last_filt_time = factor->stamp;
+            return true;
+        }
 
-            tf::Transform posttf;
-            MatrixWrapper::ColumnVector postpose = filter_->PostGet()->ExpectedValueGet();
-            cout << postpose << endl;
-            cout << filter_->PostGet()->CovarianceGet() << endl;
-            ColumnVector2Transform(postpose, posttf);
+        MeasurementCheck lastCheck(void)
+        {
+            boost::mutex::scoped_lock lock(history_mutex_);
+            return last_check_;
+        }
 
-            // 同时用最新的时间戳对last_filt_time进行更新
-            last_filt_time = factor_list.back()->stamp;
-            last_filt_woTrans = factor_list.back()->woTrans;
+        size_t historySize(void)
+        {
+            boost::mutex::scoped_lock lock(history_mutex_);
+            return backend == SMOOTHER ? smoother_.size() : history_.size();
+        }
 
-            // 利用融合值更新transformer中的odom2base_footprint变换
-            // 调用 setCurrentWoTF
-            setCurrentM2oTF(posttf * curr_o2b.inverse(), last_filt_time);
+        // 取时间戳恰好为 stamp 的状态（量测插入的那一条）；stamp 为 0 时取最新的
+        bool snapshotAt(const ros::Time &stamp, Snapshot &out)
+        {
+            boost::mutex::scoped_lock lock(history_mutex_);
+            if (backend == SMOOTHER)
+                return smootherSnapshot(stamp, out);
+            if (history_.empty())
+                return false;
+            if (stamp.isZero())
+            {
+                out = history_.back();
+                return true;
+            }
+            size_t pos = history_.upperBound(stamp);
+            if (pos == 0 || history_[pos - 1].stamp != stamp)
+                return false;
+            out = history_[pos - 1];
+            return true;
         }
 
-        void clearList(void)
+    private:
+        // 按时间戳插入，返回下标；返回 0 表示早于整个历史（或历史已满时恰好是最旧的一条），未插入
+        size_t insert(const Snapshot &s)
         {
-            // 使用了shared_ptr，不用对list中的所有factor都释放
-            factor_list.clear();
+            if (history_.empty() || s.stamp < history_.front().stamp)
+                return 0;
+            size_t pos = history_.upperBound(s.stamp);
+            if (pos <= 1 && history_.size() == history_.capacity())
+                return 0;
+            return history_.insert(pos, s);
         }
 
-        //      早     ->    晚
-        // list[begin] -> list[end]
-        void sortList(void)
+        // 从 from 开始逐条用前一状态预测，有量测的再更新
+        void replay(size_t from)
         {
-            std::sort(factor_list.begin(), factor_list.end(),
-                      [](const pose_factor::Ptr &a, const pose_factor::Ptr &b)
-                      { return a->stamp < b->stamp; });
+            for (size_t i = from; i < history_.size(); ++i)
+                propagate(history_[i - 1], history_[i]);
         }
 
-        void getCurrentTF(tf::Transform &currentWoTf, tf::Transform &currentM2oTf, ros::Time &stamp)
+        void propagate(const Snapshot &prev, Snapshot &next)
+        {
+            // 里程计增量在 base_footprint 系下，按前一时刻航向转到 map 系
+            SE2 delta = prev.o2b.between(next.o2b);
+            double dx = delta.x, dy = delta.y;
+            double dyaw = delta.yaw();
+            double c = cos(prev.x(2)), sn = sin(prev.x(2));
+            Eigen::Vector3d fx = boxplus(prev.x, Eigen::Vector3d(c * dx - sn * dy, sn * dx + c * dy, dyaw));
+            Eigen::Matrix3d F = Eigen::Matrix3d::Identity();
+            F(0, 2) = -sn * dx - c * dy;
+            F(1, 2) = c * dx - sn * dy;
+            Eigen::Matrix3d Q = Eigen::Matrix3d::Zero();
+            Q(0, 0) = Q(1, 1) = odom_noise_min + odom_noise_xy * hypot(dx, dy);
+            Q(2, 2) = odom_noise_min + odom_noise_yaw * fabs(dyaw);
+
+            filter_.init(prev.x, prev.P);
+            filter_.predictNonlinear(fx, F, Q);
+            if (next.has_meas)
+            {
+                next.nu = boxminus(next.z, filter_.state());
+                double scale = 1;
+                if (gating)
+                    next.verdict = gate(next.nu, filter_.covariance(), next.R, next.slip_candidate, next.nis, next.slip, scale);
+                if (next.verdict != NisGate::REJECT)
+                {
+                    filter_.updateIdentity(next.nu, next.R * scale);
+                    filter_.state()(2) = wrapAngle(filter_.state()(2));
+                }
+            }
+            next.x = filter_.state();
+            next.P = filter_.covariance();
+        }
 
+        bool addToHistory(pose_factor::Ptr &factor, const Eigen::Vector3d &z, bool slip_candidate, MeasurementCheck &check)
         {
-            assert(transformerSeted);
-            tf::TransformStorage tr;
-            // TODO wo tf stamp should be same with the input stamp
-            if (!trans_ptr->o2b_list.getData(stamp, tr))
+            Snapshot s;
+            s.stamp = factor->stamp;
+            s.o2b = factor->woTrans;
+            s.has_meas = true;
+            s.z = z;
+            s.R = factor->cov;
+            s.slip_candidate = slip_candidate;
+            size_t pos = insert(s);
+            if (pos == 0)
             {
-                trans_ptr->o2b_list.getData(ros::Time(0), tr);
+                ROS_WARN_THROTTLE(1, "measurement at %.3f is older than the state history, dropped", factor->stamp.toSec());
+                check.too_old = true;
+                return false;
             }
-            currentWoTf.setRotation(tr.rotation_);
-            currentWoTf.setOrigin(tr.translation_);
+            replay(pos);
+            publishLatest();
+            check.nis = history_[pos].nis;
+            check.verdict = history_[pos].verdict;
+            check.slip = history_[pos].slip;
+            return check.verdict != NisGate::REJECT;
+        }
 
-            currentM2oTf = trans_ptr->map2odom;
+        bool addToSmoother(pose_factor::Ptr &factor, const Eigen::Vector3d &z, bool slip_candidate, MeasurementCheck &check)
+        {
+            Eigen::Vector3d x;
+            Eigen::Matrix3d P;
+            if (!smoother_.predict(factor->stamp, factor->woTrans, x, P))
+            {
+                ROS_WARN_THROTTLE(1, "measurement at %.3f is older than the smoother window, dropped", factor->stamp.toSec());
+                check.too_old = true;
+                return false;
+            }
+            Eigen::Matrix3d slip_cov = Eigen::Matrix3d::Zero();
+            double scale = 1;
+            if (gating)
+            {
+                Eigen::Vector3d nu = boxminus(z, x);
+                check.verdict = gate(nu, P, factor->cov, slip_candidate, check.nis, check.slip, scale);
+                if (check.verdict == NisGate::REJECT)
+                    return false;
+                if (check.slip)
+                {
+                    // 平滑器的里程计因子在前一节点系下，新息按预测航向近似转过去
+                    Eigen::Matrix3d J = Eigen::Matrix3d::Identity();
+                    J.topLeftCorner<2, 2>() = Eigen::Rotation2Dd(-x(2)).toRotationMatrix();
+                    Eigen::Vector3d d = J * nu;
+                    slip_cov = d * d.transpose();
+                }
+            }
+            smoother_.add(factor->stamp, factor->woTrans, z, factor->cov * scale, slip_cov);
+            const SlidingWindowSmoother::Node &latest = smoother_.latest();
+            setCurrentM2oTF(SE2(latest.x) * latest.o2b.inverse(), latest.stamp);
+            return true;
         }
 
-        void setCurrentM2oTF(tf::Transform m2o, ros::Time stamp)
+        // 新息 nu、预测协方差 P 下的判定；打滑时 P 加上 nu nu^T 后重新计算 NIS
+        NisGate::Verdict gate(const Eigen::Vector3d &nu, Eigen::Matrix3d &P, const Eigen::Matrix3d &R, bool slip_candidate,
+                              double &nis, bool &slip, double &scale) const
+        {
+            nis = normalizedInnovation(nu, P + R);
+            slip = nis > lidar_gate.accept && slip_candidate;
+            if (slip)
+            {
+                P += nu * nu.transpose();
+                nis = normalizedInnovation(nu, P + R);
+            }
+            return lidar_gate.classify(nis, scale);
+        }
 
+        // 上一帧雷达到本帧之间，里程计增量与雷达增量之差的 NIS，返回两者是否一致；间隔过长或乱序时不检查
+        bool checkWheel(const ros::Time &stamp, const SE2 &o2b, const Eigen::Vector3d &z, const Eigen::Matrix3d &R, double &nis) const
         {
-            assert(transformerSeted);
-            MatrixWrapper::ColumnVector ll(3);
-            decomposeTransform(trans_ptr->map2odom, ll);
-            std::cout << "puser:" << ll << std::endl;
-            trans_ptr->map2odom.setData(m2o);
-            trans_ptr->map2odom.stamp_ = stamp;
-            decomposeTransform(trans_ptr->map2odom, ll);
-            std::cout << "puser:" << ll << std::endl;
+            if (!last_meas_.valid || stamp <= last_meas_.stamp || (stamp - last_meas_.stamp).toSec() > slip_max_gap)
+                return false;
+            SE2 odom = last_meas_.o2b.between(o2b);
+            SE2 lidar = SE2(last_meas_.z).between(SE2(z));
+            Eigen::Matrix3d A, B;
+            betweenJacobians(last_meas_.z, z, A, B);
+            Eigen::Matrix3d Q = Eigen::Matrix3d::Zero();
+            Q(0, 0) = Q(1, 1) = odom_noise_min + odom_noise_xy * hypot(odom.x, odom.y);
+            Q(2, 2) = odom_noise_min + odom_noise_yaw * fabs(odom.yaw());
+            nis = normalizedInnovation(boxminus(odom.vec(), lidar.vec()), Q + A * last_meas_.R * A.transpose() + B * R * B.transpose());
+            return nis <= wheel_gate.accept;
         }
 
-        bool addMeasurements(pose_factor::Ptr &factor)
+        // 平滑后端：量测时刻取对应节点；最新一帧里程计时刻由最新节点按里程计外推，协方差沿用最新节点
+        bool smootherSnapshot(const ros::Time &stamp, Snapshot &out) const
         {
-            factor_list.push_back(factor);
-            if (factor_list.size() >= fuse_list_length)
+            if (smoother_.empty())
+                return false;
+            const SlidingWindowSmoother::Node &latest = smoother_.latest();
+            int i = stamp.isZero() ? -1 : smoother_.find(stamp);
+            bool extrapolate = i < 0 && (stamp.isZero() ? last_odom_stamp_ > latest.stamp : stamp == last_odom_stamp_);
+            if (i < 0 && !extrapolate && !stamp.isZero())
+                return false;
+            const SlidingWindowSmoother::Node &n = i >= 0 ? smoother_.node(i) : latest;
+            out.stamp = n.stamp;
+            out.o2b = n.o2b;
+            out.x = n.x;
+            out.P = n.P;
+            out.has_meas = n.has_meas;
+            out.z = n.z;
+            out.R = n.R;
+            out.nu = n.nu;
+            if (extrapolate)
             {
-                sortList();
-                fuseList();
-                clearList();
+                out.stamp = last_odom_stamp_;
+                out.o2b = last_odom_;
+                out.x = (SE2(latest.x) * latest.o2b.between(last_odom_)).vec();
+                out.has_meas = false;
             }
-            std::cout << "reg" << factor_list.size() << std::endl;
-
             return true;
         }
 
-        int getListLength(void)
+        // 用最新状态更新 transformer 中的 map2odom
+        void publishLatest(void)
+        {
+            const Snapshot &latest = history_.back();
+            setCurrentM2oTF(SE2(latest.x) * latest.o2b.inverse(), latest.stamp);
+        }
+
+        void setCurrentM2oTF(const SE2 &m2o, const ros::Time &stamp)
         {
-            return factor_list.size();
+            assert(transformerSeted);
+            trans_ptr->set_m2o(m2o, stamp);
         }
     };
     class BR_pose_ekf
@@ -513,26 +768,79 @@ namespace estimation
 
         void decomposeTransform(const tf::Transform &trans, double &x, double &y, double &yaw);
 
-        void decomposeTransform(const tf::Transform &trans, MatrixWrapper::ColumnVector &vec);
+        void decomposeTransform(const tf::Transform &trans, Eigen::Vector3d &vec);
 
         // void angleOverflowCorrect(double &a, double ref);
 
-        // static MatrixWrapper::SymmetricMatrix cov2wraped(boost::array<double, 36UL> cov);
-        static MatrixWrapper::SymmetricMatrix cov2wraped(const boost::array<double, 9UL> &cov);
+        // 6维协方差取 x y yaw 对应的 3x3 块
+        static Eigen::Matrix3d downDim(const boost::array<double, 36UL> &dim6);
 
-        // static boost::array<double, 36UL> wraped2cov(MatrixWrapper::SymmetricMatrix wraped);
-        static boost::array<double, 9UL> wraped2cov(const MatrixWrapper::SymmetricMatrix &wraped);
+        // 预测 + 全状态观测更新
+        void filterUpdate(FixedEKF<3> &filter, const Eigen::Vector3d &u, const Eigen::Matrix3d &meas_cov, const Eigen::Vector3d &z);
+        void setPrior(FixedEKF<3> &filter, const Eigen::Vector3d &pose, const uncertain_tf::CovarianceStorage &cov);
+        void truePoseCallback(const nav_msgs::Odometry::ConstPtr &odom_msg);
+        void woCallback2(const wheel_odomConstPtr &odom);
+        // 两帧里程计之间按 IMU 频率外推位姿并发布
+        void imuCallback(const imuConstPtr &imu);
 
-        static boost::array<double, 9UL> downDim(const boost::array<double, 36UL> &dim6);
+        // 定频输出线程：按最近的融合结果和速度外推到当前时刻
+        void outputLoop(void);
+        void publishExtrapolated(const ros::Time &now);
+        // 记录最新的 odom -> base_footprint 及机体系速度，供外推使用
+        void storeMotion(const ros::Time &stamp, const Eigen::Vector3d &o2b, double vx, double vy, double wz);
 
-        static MatrixWrapper::SymmetricMatrix eigen2wraped(const Eigen::MatrixXd &eig);
+        // 传感器回调只把消息放进无锁队列，由唯一的融合线程按时间戳顺序处理
+        struct SensorEvent
+        {
+            enum Type
+            {
+                WHEEL,
+                LASER,
+                VISUAL,
+                IMU,
+                TRUE_POSE
+            };
+            Type type;
+            ros::Time stamp;
+            int64_t arrival; // 入队时的 wall time (ns)
+#ifdef EKF_LATENCY_STATS
+            int64_t stamp_age; // 入队时 ros::Time::now() - stamp (ns)
+#endif
+            boost::shared_ptr<void const> msg;
 
-        static Eigen::MatrixXd wraped2eigen(const MatrixWrapper::SymmetricMatrix &wraped);
-        void truePoseCallback(const nav_msgs::Odometry::ConstPtr &odom_msg);
-        void woCallback2(const wheel_odomConstPtr &odom);
+            // 堆顶为时间戳最早的
+            bool operator<(const SensorEvent &b) const { return stamp > b.stamp; }
+        };
+        template <class M, int TYPE>
+        void onSensor(const boost::shared_ptr<M const> &msg);
+        void fusionLoop(void);
+        // 叫醒等待中的融合线程：新消息入队、重定位结果、退出
+        void wakeFusion(void);
+        void dispatch(const SensorEvent &ev);
+        // 处理函数填写本次更新的记录，由 dispatch 补上时间后写入日志
+        void logUpdate(const Eigen::Vector3d &x, const Eigen::Matrix3d &P, const Eigen::Vector3d &z, uint32_t flags);
+#ifdef EKF_LATENCY_STATS
+        // 定时把各阶段延迟的区间分位数发到 /diagnostics
+        void reportLatency(const ros::WallTimerEvent &);
+#endif
+        // 定时把雷达、轮式的 NIS 统计发到 /diagnostics
+        void reportConsistency(const ros::WallTimerEvent &);
+
+        // 由场地线段生成重定位与扫描匹配用的似然场
+        void initFieldMaps(void);
+        void scanCallback(const sensor_msgs::LaserScan::ConstPtr &scan);
+        // 扫描匹配线程：每帧激光在 EKF 先验附近匹配，结果作为 lo 量测送进融合队列
+        void matchLoop(void);
+        // 全场重定位：在单独的线程里搜索，结果交给融合线程应用
+        bool relocalizeService(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
+        // 使用 stamp 之后的第一帧激光，任意线程可调用，已有请求未完成时忽略
+        void requestRelocalization(const ros::Time &stamp, const char *reason);
+        void relocLoop(void);
+        // 只在融合线程调用
+        void applyRelocalization(void);
 
         // 模式控制参数
-        bool use_wo, use_vo, use_lo, use_true_pose;
+        bool use_wo, use_vo, use_lo, use_true_pose, use_imu;
         bool broadcastTF;
         bool odom_noise_test;
         bool predict_test;
@@ -548,6 +856,11 @@ namespace estimation
         std::string output_topic;
         std::string true_pose_topic;
         std::string compensation_topic;
+        std::string imu_topic;
+        std::string extrapolated_topic;
+        double output_rate;       // 定频输出频率，0 关闭
+        double max_extrapolation; // 外推时长上限 (s)
+        double reorder_window;    // 融合线程等待乱序消息的时长 (s)
 
 
         double initPoseX, initPoseY, initPoseTheta;
@@ -558,7 +871,7 @@ namespace estimation
         bool received_true_pose_ = false;
 
         // 功能性变量
-        MatrixWrapper::ColumnVector filter_estimate_old_vec_;
+        Eigen::Vector3d filter_estimate_old_vec_;
         tf::Transform filter_estimate_old_;
         ros::Time filter_time_old_;
         unsigned int wo_callback_counter_, imu_callback_counter_, lo_callback_counter_, vo_callback_counter_, gps_callback_counter_, ekf_sent_counter_;
@@ -568,35 +881,102 @@ namespace estimation
         nav_msgs::Odometry latest_true_pose;
         nav_msgs::Odometry output_compensation;
         tf::Transform true_pose;
-        boost::mutex lo_mutex;
         tf::Transform m2o_comp;
         pose_fuser fuser;
+        ImuPredictor imu_predictor_;
+
+        struct Motion
+        {
+            double o2b[3]; // x y yaw
+            double vel[3]; // 机体系 vx vy wz
+            int64_t stamp; // ns
+        };
+        SeqLock<Motion> motion_; // 只由融合线程写
+        std::atomic<bool> output_running_;
+        std::thread output_thread_;
+
+        MpscQueue<SensorEvent> sensor_queue_;
+        std::atomic<bool> fusion_running_;
+        std::thread fusion_thread_;
+        std::mutex fusion_mutex_;
+        std::condition_variable fusion_cv_;
+        bool fusion_wake_; // fusion_mutex_ 保护，上次检查后有新事件
+
+#ifdef EKF_LATENCY_STATS
+        std::unique_ptr<LatencyStats> latency_;
+        int64_t update_done_ns_;        // 处理函数更新完成后标记（wall ns），0 表示不区分更新与发布
+        double latency_report_period;   // 汇报周期 (s)
+        double latency_warn;            // 端到端 p99 超过该值 (s) 时汇报 WARN
+        ros::WallTimer latency_timer_;
+#endif
+        ros::Publisher diag_pub;
+        double consistency_report_period; // 一致性汇报周期 (s)，0 关闭
+        double consistency_warn_rate;     // 一个汇报周期内的丢弃比例超过该值时汇报 WARN
+        ros::WallTimer consistency_timer_;
+        NisMonitor::Stats last_lidar_stats_, last_wheel_stats_; // 上次汇报时的计数，只由定时器访问
+
+        // 全场重定位，use_reloc 关闭时以下都不使用
+        bool use_reloc;
+        std::string scan_topic;
+        std::string reloc_topic;
+        double reloc_point_spacing; // 激光点抽稀间距 (m)
+        double reloc_lost_dist;     // lo 量测与估计相差超过此距离 (m) 或航向差超过 reloc_lost_yaw (rad) 记一次异常
+        double reloc_lost_yaw;
+        int reloc_lost_count;       // 连续异常次数达到此值时自动重定位，0 关闭
+        double reloc_collision_accel; // 水平加速度超过此值 (m/s^2) 视为碰撞并重定位，0 关闭，需要 use_imu
+        SE2 laser_mount_;           // base_footprint->laser
+        GlobalRelocalizer relocalizer_; // 只由重定位线程访问
+        int lo_outliers_;           // 只由融合线程访问
+
+        std::mutex reloc_mutex_; // 保护以下成员
+        std::condition_variable reloc_cv_;
+        sensor_msgs::LaserScan::ConstPtr latest_scan_;
+        bool reloc_requested_;
+        ros::Time reloc_after_;
+        uint64_t reloc_generation_; // 每完成一次搜索加一
+        bool reloc_found_;
+        std::string reloc_message_;
+        GlobalRelocalizer::Hypothesis reloc_result_;
+        ros::Time reloc_stamp_;
+        std::atomic<bool> reloc_pending_; // 有结果等待融合线程应用
+        std::atomic<bool> reloc_running_;
+        std::thread reloc_thread_;
+
+        // 内置扫描匹配，替代外部的 lo 位姿
+        bool use_scan_match;
+        std::string scan_match_topic;
+        double scan_match_point_spacing;
+        CorrelativeScanMatcher scan_matcher_; // 只由匹配线程访问
+        int match_failures_;                  // 只由匹配线程访问
+        std::mutex match_mutex_;
+        std::condition_variable match_cv_;
+        sensor_msgs::LaserScan::ConstPtr match_scan_; // 尚未匹配的最新一帧，匹配慢于激光时旧帧直接覆盖
+        std::atomic<bool> match_running_;
+        std::thread match_thread_;
+
+        // 二进制日志，log_dir 为空时关闭
+        std::string log_dir;
+        BinaryLogger logger_;
+        FilterLogRecord log_rec_; // 只由融合线程访问
+        bool log_pending_;
 
         // 通讯变量
         ros::NodeHandle node;
         ros::Publisher pose_pub;
         ros::Publisher compensation_pub;
-        ros::Subscriber wo_sub, vo_sub, lo_sub, true_pose_sub;
+        ros::Publisher extrapolated_pub;
+        ros::Subscriber wo_sub, vo_sub, lo_sub, true_pose_sub, imu_sub, scan_sub;
+        ros::Publisher reloc_pub, match_pub;
+        ros::ServiceServer reloc_srv;
         geometry_msgs::PoseWithCovarianceStamped output_;
         BR_transformer transformer;
         tf::TransformBroadcaster pose_broadcaster_;
 
-        // 滤波器相关模型和变量  pdf / model / ekf filter
-        BFL::LinearAnalyticSystemModelGaussianUncertainty *sys_model_;
-        BFL::LinearAnalyticConditionalGaussian *sys_pdf_;
-        BFL::LinearAnalyticSystemModelGaussianUncertainty *tmp_sys_model_;
-        BFL::LinearAnalyticConditionalGaussian *tmp_sys_pdf_;
-
-        BFL::LinearAnalyticConditionalGaussian *lo_meas_pdf_;
-        BFL::LinearAnalyticMeasurementModelGaussianUncertainty *lo_meas_model_;
-        BFL::LinearAnalyticConditionalGaussian *wo_meas_pdf_;
-        BFL::LinearAnalyticMeasurementModelGaussianUncertainty *wo_meas_model_;
-        BFL::LinearAnalyticConditionalGaussian *vo_meas_pdf_;
-        BFL::LinearAnalyticMeasurementModelGaussianUncertainty *vo_meas_model_;
-        BFL::Gaussian *prior_;
-        BFL::ExtendedKalmanFilter *filter_;
-        BFL::ExtendedKalmanFilter *tmpfilter_;
-        MatrixWrapper::SymmetricMatrix wo_covariance_, imu_covariance_, vo_covariance_, gps_covariance_, lo_covariance_;
+        // 滤波器相关模型和变量，系统模型 x = A x + B u，各传感器直接观测全状态
+        Eigen::Matrix3d sys_A_, sys_B_, sys_cov_;
+        Eigen::Matrix3d wo_meas_cov_, vo_meas_cov_, lo_meas_cov_;
+        FixedEKF<3> filter_;
+        FixedEKF<3> tmpfilter_;
 
         // 后续将淘汰
         tf::Transform wo_meas_, imu_meas_, vo_meas_, lo_meas_;
@@ -607,10 +987,8 @@ namespace estimation
         ros::Time wo_init_stamp_, imu_init_stamp_, vo_init_stamp_, gps_init_stamp_, lo_init_stamp_;
 
         double timeout_;
-        bool debug_, self_diagnose_;
-
-        // log files for debugging
-        std::ofstream wo_file_, imu_file_, vo_file_, gps_file_, corr_file_, time_file_, extra_file_;
+        bool debug_;         // 打印每帧量测的协方差与一致性检查结果
+        bool self_diagnose_; // 雷达、轮式的新息一致性检查与汇报
 
     }; // class
 
@@ -0,0 +1,238 @@
+#ifndef __FIELD_MAP_FILE_HPP
+#define __FIELD_MAP_FILE_HPP
+
+#include "ekf_pose_fusion/likelihood_field.hpp"
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace estimation
+{
+    // 预先生成的场地距离图文件，由 field_map_gen 离线生成
+    // 每层一个分辨率，存距离图 (m) 和按该层 sigma 算好的似然场，float 行优先，数据按 64 字节对齐
+    // 节点只读 mmap 整个文件，似然场直接引用文件里的页面：启动不用计算，多个进程共用同一份物理页
+    struct FieldMapHeader
+    {
+        char magic[8]; // "EKFFMAP"
+        uint32_t version;
+        uint32_t level_count;
+        uint32_t header_size; // sizeof(FieldMapHeader)
+        uint32_t level_size;  // sizeof(FieldMapLevel)
+        uint64_t file_size;
+        char reserved[32];
+    };
+    static_assert(sizeof(FieldMapHeader) == 64, "FieldMapHeader is a fixed 64 byte on-disk layout");
+
+    struct FieldMapLevel
+    {
+        double resolution;
+        double sigma;        // 似然场所用的 sigma
+        double origin_x, origin_y; // 第 (0, 0) 格左下角，map 系
+        double max_distance; // 距离图的截断值
+        int32_t width, height;
+        uint64_t distance_offset, likelihood_offset; // 相对文件开头
+    };
+    static_assert(sizeof(FieldMapLevel) == 64, "FieldMapLevel is a fixed 64 byte on-disk layout");
+
+    class FieldMapFile
+    {
+    public:
+        static const uint32_t VERSION = 1;
+
+        // 生成时每层的内容，距离图由调用者算好
+        struct LevelData
+        {
+            double resolution, sigma, origin_x, origin_y, max_distance;
+            int width, height;
+            std::vector<float> distance;
+        };
+
+        ~FieldMapFile()
+        {
+            if (map_)
+                munmap(map_, size_);
+        }
+        FieldMapFile(const FieldMapFile &) = delete;
+
+        // 只读映射并检查格式，失败时返回空指针，原因见 error
+        static std::shared_ptr<FieldMapFile> open(const std::string &path, std::string &error)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0)
+            {
+                error = path + ": " + strerror(errno);
+                if (fd >= 0)
+                    ::close(fd);
+                return nullptr;
+            }
+            size_t size = st.st_size;
+            void *map = size >= sizeof(FieldMapHeader) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+            ::close(fd);
+            if (map == MAP_FAILED)
+            {
+                error = path + ": " + (size < sizeof(FieldMapHeader) ? std::string("file too short") : std::string(strerror(errno)));
+                return nullptr;
+            }
+            std::shared_ptr<FieldMapFile> f(new FieldMapFile(static_cast<char *>(map), size));
+            if (!f->validate(error))
+            {
+                error = path + ": " + error;
+                return nullptr;
+            }
+            return f;
+        }
+
+        size_t levelCount() const { return header()->level_count; }
+        const FieldMapLevel &level(size_t i) const { return levels()[i]; }
+
+        // 分辨率相同的层，没有时返回 -1
+        int find(double resolution) const
+        {
+            for (size_t i = 0; i < levelCount(); ++i)
+                if (std::fabs(level(i).resolution - resolution) < 1e-9)
+                    return int(i);
+            return -1;
+        }
+
+        const float *distance(size_t i) const { return reinterpret_cast<const float *>(map_ + level(i).distance_offset); }
+        const float *likelihood(size_t i) const { return reinterpret_cast<const float *>(map_ + level(i).likelihood_offset); }
+
+        // 第 i 层的似然场：sigma 与生成时相同则直接引用文件页面，否则由距离图重新计算一份
+        // 返回 true 表示共享了文件页面
+        static bool likelihoodField(const std::shared_ptr<FieldMapFile> &file, size_t i, double sigma, LikelihoodField &out)
+        {
+            const FieldMapLevel &l = file->level(i);
+            if (std::fabs(l.sigma - sigma) < 1e-9)
+            {
+                // 别名构造：似然场持有整个文件的引用，文件在最后一个使用者释放后才 munmap
+                out.attach(std::shared_ptr<const float>(file, file->likelihood(i)), l.width, l.height, l.resolution, l.origin_x, l.origin_y);
+                return true;
+            }
+            out.fromDistance(file->distance(i), l.width, l.height, l.resolution, l.origin_x, l.origin_y, sigma);
+            return false;
+        }
+
+        // 先写临时文件再改名，正在使用旧文件的节点仍映射着旧的 inode，不受影响
+        static bool write(const std::string &path, const std::vector<LevelData> &data, std::string &error)
+        {
+            std::vector<FieldMapLevel> levels(data.size());
+            uint64_t offset = align(sizeof(FieldMapHeader) + data.size() * sizeof(FieldMapLevel));
+            for (size_t i = 0; i < data.size(); ++i)
+            {
+                const LevelData &d = data[i];
+                FieldMapLevel &l = levels[i];
+                memset(&l, 0, sizeof(l));
+                l.resolution = d.resolution;
+                l.sigma = d.sigma;
+                l.origin_x = d.origin_x;
+                l.origin_y = d.origin_y;
+                l.max_distance = d.max_distance;
+                l.width = d.width;
+                l.height = d.height;
+                uint64_t bytes = uint64_t(d.width) * d.height * sizeof(float);
+                l.distance_offset = offset;
+                offset = align(offset + bytes);
+                l.likelihood_offset = offset;
+                offset = align(offset + bytes);
+            }
+            FieldMapHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, "EKFFMAP", 8);
+            h.version = VERSION;
+            h.level_count = uint32_t(data.size());
+            h.header_size = sizeof(FieldMapHeader);
+            h.level_size = sizeof(FieldMapLevel);
+            h.file_size = offset;
+
+            std::string tmp = path + ".tmp";
+            FILE *fp = fopen(tmp.c_str(), "wb");
+            if (!fp)
+            {
+                error = tmp + ": " + strerror(errno);
+                return false;
+            }
+            bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+                      fwrite(levels.data(), sizeof(FieldMapLevel), levels.size(), fp) == levels.size();
+            std::vector<float> lik;
+            for (size_t i = 0; ok && i < data.size(); ++i)
+            {
+                size_t n = size_t(data[i].width) * data[i].height;
+                lik.resize(n);
+                likelihoodFromDistance(data[i].distance.data(), n, data[i].sigma, lik.data());
+                ok = fseek(fp, long(levels[i].distance_offset), SEEK_SET) == 0 &&
+                     fwrite(data[i].distance.data(), sizeof(float), n, fp) == n &&
+                     fseek(fp, long(levels[i].likelihood_offset), SEEK_SET) == 0 &&
+                     fwrite(lik.data(), sizeof(float), n, fp) == n;
+            }
+            // 末尾对齐的空洞也要占位，文件长度与 file_size 一致
+            ok = ok && fseek(fp, long(offset) - 1, SEEK_SET) == 0 && fputc(0, fp) != EOF;
+            ok = (fclose(fp) == 0) && ok;
+            if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+            {
+                error = path + ": " + strerror(errno);
+                remove(tmp.c_str());
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        FieldMapFile(char *map, size_t size) : map_(map), size_(size) {}
+
+        static uint64_t align(uint64_t n) { return (n + 63) & ~uint64_t(63); }
+
+        const FieldMapHeader *header() const { return reinterpret_cast<const FieldMapHeader *>(map_); }
+        const FieldMapLevel *levels() const { return reinterpret_cast<const FieldMapLevel *>(map_ + sizeof(FieldMapHeader)); }
+
+        bool validate(std::string &error) const
+        {
+            const FieldMapHeader *h = header();
+            if (memcmp(h->magic, "EKFFMAP", 8) != 0)
+            {
+                error = "not a field map file";
+                return false;
+            }
+            if (h->version != VERSION || h->header_size != sizeof(FieldMapHeader) || h->level_size != sizeof(FieldMapLevel))
+            {
+                char buf[96];
+                snprintf(buf, sizeof(buf), "field map version %u, this build reads version %u; regenerate it with field_map_gen",
+                         h->version, VERSION);
+                error = buf;
+                return false;
+            }
+            if (h->file_size != size_ || sizeof(FieldMapHeader) + uint64_t(h->level_count) * sizeof(FieldMapLevel) > size_)
+            {
+                error = "truncated field map file";
+                return false;
+            }
+            for (size_t i = 0; i < levelCount(); ++i)
+            {
+                const FieldMapLevel &l = level(i);
+                uint64_t bytes = uint64_t(l.width) * l.height * sizeof(float);
+                if (l.width <= 0 || l.height <= 0 || !(l.resolution > 0) ||
+                    l.distance_offset % 64 || l.likelihood_offset % 64 ||
+                    l.distance_offset + bytes > size_ || l.likelihood_offset + bytes > size_)
+                {
+                    error = "corrupt level table";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        char *map_;
+        size_t size_;
+    };
+}
+
+#endif
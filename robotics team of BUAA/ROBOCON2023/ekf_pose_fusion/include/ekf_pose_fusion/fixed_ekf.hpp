@@ -0,0 +1,90 @@
+#ifndef __FIXED_EKF_HPP
+#define __FIXED_EKF_HPP
+
+#include <eigen3/Eigen/Dense>
+
+namespace estimation
+{
+    // 定维 EKF：状态维数 N 与量测维数 M 都是编译期常量，所有矩阵在栈上，更新过程不申请堆内存
+    // 约定与 BFL 的 ExtendedKalmanFilter::Update(sys, u, meas, z) 一致：先 predict 再 update
+    // 非线性模型由调用者给出预测值与解析雅可比；角度类状态的新息需要调用者先归一化
+    template <int N>
+    class FixedEKF
+    {
+    public:
+        typedef Eigen::Matrix<double, N, 1> StateVec;
+        typedef Eigen::Matrix<double, N, N> StateCov;
+
+        FixedEKF()
+        {
+            x_.setZero();
+            P_.setIdentity();
+        }
+
+        void init(const StateVec &x, const StateCov &P)
+        {
+            x_ = x;
+            P_ = P;
+        }
+
+        // 线性预测 x = F x，P = F P F' + Q
+        void predict(const StateCov &F, const StateCov &Q)
+        {
+            x_ = F * x_;
+            P_ = F * P_ * F.transpose() + Q;
+        }
+
+        // 带控制量的线性预测 x = F x + B u
+        template <int U>
+        void predict(const StateCov &F, const Eigen::Matrix<double, N, U> &B, const Eigen::Matrix<double, U, 1> &u, const StateCov &Q)
+        {
+            x_ = F * x_ + B * u;
+            P_ = F * P_ * F.transpose() + Q;
+        }
+
+        // 非线性预测：fx = f(x)，F 为 f 在 x 处的雅可比
+        void predictNonlinear(const StateVec &fx, const StateCov &F, const StateCov &Q)
+        {
+            x_ = fx;
+            P_ = F * P_ * F.transpose() + Q;
+        }
+
+        // 量测更新，innovation = z - h(x)，H 为 h 在 x 处的雅可比
+        // 协方差用 Joseph 形式，保证对称正定；S 不正定时放弃本次更新并返回 false
+        template <int M>
+        bool update(const Eigen::Matrix<double, M, 1> &innovation, const Eigen::Matrix<double, M, N> &H, const Eigen::Matrix<double, M, M> &R)
+        {
+            Eigen::Matrix<double, N, M> PHt = P_ * H.transpose();
+            Eigen::Matrix<double, M, M> S = H * PHt + R;
+            Eigen::LLT<Eigen::Matrix<double, M, M>> llt(S);
+            if (llt.info() != Eigen::Success)
+                return false;
+            // K = P H' S^-1 = (S^-1 H P)'
+            Eigen::Matrix<double, N, M> K = llt.solve(PHt.transpose()).transpose();
+            x_ += K * innovation;
+            StateCov IKH = StateCov::Identity() - K * H;
+            P_ = IKH * P_ * IKH.transpose() + K * R * K.transpose();
+            P_ = 0.5 * (P_ + P_.transpose());
+            return true;
+        }
+
+        // 直接观测全部状态（H = I）
+        bool updateIdentity(const StateVec &innovation, const StateCov &R)
+        {
+            return update<N>(innovation, StateCov::Identity(), R);
+        }
+
+        StateVec &state() { return x_; }
+        const StateVec &state() const { return x_; }
+        StateCov &covariance() { return P_; }
+        const StateCov &covariance() const { return P_; }
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    private:
+        StateVec x_;
+        StateCov P_;
+    };
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef __FUSION_REPLAY_HPP
+#define __FUSION_REPLAY_HPP
+
+#include "ekf_pose_fusion/ekf_pose_fusion.hpp"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace estimation
+{
+    // 离线回放：把内存中的传感器序列按到达顺序喂给 BR_transformer + pose_fuser，
+    // 调用方式与 BR_pose_ekf 的 woCallback2 / newloCallback 相同，供基准和调参工具共用
+    struct ReplayEvent
+    {
+        double arrival;        // 到达时刻，决定处理顺序
+        ros::Time stamp;       // 数据时间戳
+        bool lidar;            // false 为轮式里程计 odom->base，true 为雷达 map->base
+        Eigen::Vector3d value; // x y yaw
+        Eigen::Matrix3d cov;   // 雷达量测协方差（消息中带的）
+
+        bool operator<(const ReplayEvent &b) const { return arrival < b.arrival || (arrival == b.arrival && lidar < b.lidar); }
+    };
+
+    // 真值轨迹，按时间戳排序，查询时线性插值
+    struct ReplayTruth
+    {
+        std::vector<ros::Time> stamp;
+        std::vector<Eigen::Vector3d> pose;
+
+        bool at(const ros::Time &t, Eigen::Vector3d &out) const
+        {
+            size_t i = std::upper_bound(stamp.begin(), stamp.end(), t) - stamp.begin();
+            if (i == stamp.size() && i > 0 && stamp.back() == t)
+            {
+                out = pose.back();
+                return true;
+            }
+            if (i == 0 || i == stamp.size())
+                return false;
+            double a = (t - stamp[i - 1]).toSec() / (stamp[i] - stamp[i - 1]).toSec();
+            out = pose[i - 1] + a * (pose[i] - pose[i - 1]);
+            double dyaw = pose[i](2) - pose[i - 1](2);
+            out(2) = pose[i - 1](2) + a * wrapAngle(dyaw);
+            return true;
+        }
+    };
+
+    struct ReplayConfig
+    {
+        double odom_noise_xy = 1e-3;
+        double odom_noise_yaw = 1e-3;
+        double odom_noise_min = 1e-8;
+        double lo_cov = 0;       // >0 时雷达协方差改用 diag(lo_cov, lo_cov, lo_cov)，否则用消息中的
+        double lo_cov_scale = 1; // 消息协方差的缩放
+        int history = 400;
+        int smoother_window = 0; // >0 时改用滑窗平滑后端，窗口节点数
+        int smoother_iterations = 3;
+        bool gating = true; // 新息一致性检查，与节点的 self_diagnose 相同
+    };
+
+    struct ReplayResult
+    {
+        double rmse_xy = 0, rmse_yaw = 0, max_xy = 0;
+        // 单次更新耗时，里程计与雷达分开统计
+        double odom_p50_us = 0, odom_p99_us = 0, lidar_p50_us = 0, lidar_p99_us = 0, max_us = 0;
+        size_t evaluated = 0, rejected = 0; // rejected 含过旧与未通过一致性检查的雷达量测
+        double wall = 0; // 整段回放耗时 s
+    };
+
+    // 取 p50 p99 (us)，max_us 取已有值与本组最大值中的较大者
+    inline void percentiles(std::vector<double> &ns, double &p50, double &p99, double &max_us)
+    {
+        if (ns.empty())
+            return;
+        std::sort(ns.begin(), ns.end());
+        p50 = ns[ns.size() / 2] / 1000.0;
+        p99 = ns[std::min(ns.size() - 1, size_t(0.99 * ns.size()))] / 1000.0;
+        max_us = std::max(max_us, ns.back() / 1000.0);
+    }
+
+    // transformer 需由调用方在主线程构造（构造时读参数），回放本身可在任意线程
+    inline ReplayResult runReplay(const std::vector<ReplayEvent> &events, const ReplayTruth &truth,
+                                  const ReplayConfig &cfg, BR_transformer &transformer)
+    {
+        ReplayResult res;
+        if (events.empty())
+            return res;
+
+        pose_fuser fuser(cfg.history > 1 ? cfg.history : 2);
+        fuser.odom_noise_xy = cfg.odom_noise_xy;
+        fuser.odom_noise_yaw = cfg.odom_noise_yaw;
+        fuser.odom_noise_min = cfg.odom_noise_min;
+        fuser.gating = cfg.gating;
+        if (cfg.smoother_window > 0)
+        {
+            fuser.backend = pose_fuser::SMOOTHER;
+            fuser.smoother_window = cfg.smoother_window;
+            fuser.smoother_iterations = cfg.smoother_iterations;
+        }
+
+        // 与 BR_pose_ekf 构造时相同：map2odom 为单位阵，o2b 取第一帧里程计，先验取真值（没有真值时取里程计）
+        ros::Time t0 = events.front().stamp;
+        Eigen::Vector3d o2b0 = Eigen::Vector3d::Zero(), prior = Eigen::Vector3d::Zero();
+        for (size_t i = 0; i < events.size(); ++i)
+            if (!events[i].lidar)
+            {
+                t0 = events[i].stamp;
+                o2b0 = prior = events[i].value;
+                break;
+            }
+        truth.at(t0, prior);
+        tf::Transform o2b0_tf, m2o0_tf, prior_tf;
+        ColumnVector2Transform(o2b0, o2b0_tf);
+        ColumnVector2Transform(prior, prior_tf);
+        m2o0_tf = prior_tf * o2b0_tf.inverse();
+        transformer.history.reset(transformer.history.capacity());
+        transformer.set_m2o(m2o0_tf, t0);
+        transformer.set_o2b(o2b0_tf, t0);
+        transformer.set_m2b_cov(Eigen::Matrix3d::Zero(), t0);
+        fuser.setTransformer(&transformer);
+        fuser.initFilter(prior_tf, t0);
+        transformer.setFuser(&fuser);
+
+        std::vector<double> odom_ns, lidar_ns;
+        odom_ns.reserve(events.size());
+        double se = 0, yaw_se = 0;
+        typedef std::chrono::steady_clock clock;
+        clock::time_point wall0 = clock::now();
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            const ReplayEvent &e = events[i];
+            if (e.stamp < t0)
+                continue;
+            SE2 meas(e.value);
+
+            clock::time_point c0 = clock::now();
+            if (!e.lidar)
+            {
+                transformer.set_o2b(meas, e.stamp);
+                fuser.addOdometry(meas, e.stamp);
+            }
+            else
+            {
+                PoseHistory::Sample frames;
+                transformer.lookup_frames(e.stamp, frames);
+                pose_factor::Ptr f = pose_factor::create();
+                // 池由所有线程共用，偶尔取不到就让一下
+                while (!f)
+                {
+                    std::this_thread::yield();
+                    f = pose_factor::create();
+                }
+                f->stamp = e.stamp;
+                f->woTrans = frames.pose(PoseHistory::O2B);
+                f->cov = cfg.lo_cov > 0 ? Eigen::Matrix3d(Eigen::Matrix3d::Identity() * cfg.lo_cov) : Eigen::Matrix3d(e.cov * cfg.lo_cov_scale);
+                f->measurement = meas;
+                if (!fuser.addMeasurements(f))
+                    ++res.rejected;
+            }
+            (e.lidar ? lidar_ns : odom_ns).push_back(std::chrono::duration<double, std::nano>(clock::now() - c0).count());
+
+            // 在每帧里程计（即输出时刻）评估：最新 map2odom * 当前 o2b
+            Eigen::Vector3d gt;
+            if (!e.lidar && truth.at(e.stamp, gt))
+            {
+                Eigen::Vector3d est = (SE2::fromTransform(transformer.get_m2o()) * meas).vec();
+                double d2 = (est - gt).head<2>().squaredNorm();
+                se += d2;
+                res.max_xy = std::max(res.max_xy, sqrt(d2));
+                double dyaw = est(2) - gt(2);
+                yaw_se += pow(wrapAngle(dyaw), 2);
+                ++res.evaluated;
+            }
+        }
+        res.wall = std::chrono::duration<double>(clock::now() - wall0).count();
+
+        if (res.evaluated)
+        {
+            res.rmse_xy = sqrt(se / res.evaluated);
+            res.rmse_yaw = sqrt(yaw_se / res.evaluated);
+        }
+        percentiles(odom_ns, res.odom_p50_us, res.odom_p99_us, res.max_us);
+        percentiles(lidar_ns, res.lidar_p50_us, res.lidar_p99_us, res.max_us);
+        return res;
+    }
+}
+
+#endif
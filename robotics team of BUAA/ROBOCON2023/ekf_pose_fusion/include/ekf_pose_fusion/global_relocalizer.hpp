@@ -0,0 +1,238 @@
+#ifndef __GLOBAL_RELOCALIZER_HPP
+#define __GLOBAL_RELOCALIZER_HPP
+
+#include "ekf_pose_fusion/likelihood_field.hpp"
+#include "ekf_pose_fusion/se2.hpp"
+#include <eigen3/Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace estimation
+{
+    // 全场重定位：在整张似然场上对 (x, y, yaw) 做多分辨率分支定界
+    // 第 h 层每格存原图 2^h x 2^h 窗口内的最大值，用它算出的得分是该窗口内所有位姿得分的上界，
+    // 上界不超过当前门限的整块直接剪掉。场地对称时得分相近的几个位姿都会返回，由调用者按先验挑选
+    class GlobalRelocalizer
+    {
+    public:
+        struct Options
+        {
+            int depth = 6;              // 最粗一层一格为 2^depth 个栅格
+            double min_score = 0.5;     // 平均似然低于此值的位姿不接受
+            double ambiguity = 0.9;     // 得分不低于最优的此比例的其它位姿也作为假设返回
+            double separation_xy = 0.5; // 位置差超过此值 (m) 或航向差超过 separation_yaw (rad) 算不同的假设
+            double separation_yaw = 0.5;
+            double max_range = 12.0;    // 只用于确定角度步长，最远点在一步旋转下移动不超过一格
+            double z_hit = 0.9;         // 协方差用的量测模型 z_hit * likelihood + z_rand
+            double z_rand = 0.1;
+            double independent_points = 30; // 相邻激光点误差相关，对数似然按这么多个独立点折算
+            int max_hypotheses = 8;
+        };
+
+        struct Hypothesis
+        {
+            SE2 pose;            // map->base_footprint
+            Eigen::Matrix3d cov; // x y yaw
+            double score;        // 平均似然 [0, 1]
+        };
+
+        Options options;
+
+        GlobalRelocalizer() : resolution_(0), width_(0), height_(0), best_(0) {}
+
+        bool ready() const { return !levels_.empty(); }
+
+        // 生成各层的最大值图，地图不变时只需调用一次
+        void setMap(const LikelihoodField &field)
+        {
+            field_ = field;
+            resolution_ = field.resolution();
+            width_ = field.width();
+            height_ = field.height();
+            buildMaxPyramid(field, options.depth, levels_);
+        }
+
+        // points 为 base_footprint 系下的激光点，返回按得分从高到低的假设个数，0 表示没有可信的位姿
+        size_t search(const std::vector<Eigen::Vector2d> &points, std::vector<Hypothesis> &out)
+        {
+            out.clear();
+            if (!ready() || points.empty())
+                return 0;
+            prepareAngles(points);
+            modes_.clear();
+            best_ = 0;
+
+            const int top = options.depth;
+            const int step = 1 << top;
+            std::vector<Candidate> roots;
+            roots.reserve(size_t(angles_) * ((width_ + step - 1) / step) * ((height_ + step - 1) / step));
+            for (int a = 0; a < angles_; ++a)
+                for (int y = 0; y < height_; y += step)
+                    for (int x = 0; x < width_; x += step)
+                        roots.push_back(Candidate{a, x, y, score(top, a, x, y)});
+            std::sort(roots.begin(), roots.end());
+            branch(top, roots);
+
+            std::sort(modes_.begin(), modes_.end());
+            for (const Candidate &m : modes_)
+            {
+                if (m.score < options.ambiguity * best_ || out.size() >= size_t(options.max_hypotheses))
+                    break;
+                out.push_back(refine(m));
+            }
+            return out.size();
+        }
+
+        // 某个位姿的平均似然，用于检查当前估计是否仍然可信
+        double evaluate(const std::vector<Eigen::Vector2d> &points, const SE2 &pose) const
+        {
+            if (!ready() || points.empty())
+                return 0;
+            double sum = 0;
+            for (const Eigen::Vector2d &p : points)
+                sum += field_.at(field_.cellX(pose.x + pose.c * p.x() - pose.s * p.y()),
+                                 field_.cellY(pose.y + pose.s * p.x() + pose.c * p.y()));
+            return sum / points.size();
+        }
+
+        int angleCount() const { return angles_; }
+
+    private:
+        // 机器人位于栅格 (x, y) 中心、航向为第 a 个角度
+        struct Candidate
+        {
+            int a, x, y;
+            float score; // 各点似然之和
+
+            // 得分高的排在前面
+            bool operator<(const Candidate &b) const { return score > b.score; }
+        };
+
+        // 角度步长取最远点旋转一步移动一格，每个角度下各点相对机器人所在格的偏移预先算好
+        void prepareAngles(const std::vector<Eigen::Vector2d> &points)
+        {
+            double r = 0;
+            for (const Eigen::Vector2d &p : points)
+                r = std::max(r, p.norm());
+            r = std::min(std::max(r, resolution_), options.max_range);
+            double step = std::acos(std::max(-1.0, 1 - resolution_ * resolution_ / (2 * r * r)));
+            angles_ = std::max(1, int(std::ceil(2 * M_PI / step)));
+            angle_step_ = 2 * M_PI / angles_;
+            points_ = int(points.size());
+            dx_.resize(size_t(angles_) * points_);
+            dy_.resize(size_t(angles_) * points_);
+            for (int a = 0; a < angles_; ++a)
+            {
+                double c = std::cos(a * angle_step_), s = std::sin(a * angle_step_);
+                for (int i = 0; i < points_; ++i)
+                {
+                    const Eigen::Vector2d &p = points[i];
+                    dx_[size_t(a) * points_ + i] = int(std::lround((c * p.x() - s * p.y()) / resolution_));
+                    dy_[size_t(a) * points_ + i] = int(std::lround((s * p.x() + c * p.y()) / resolution_));
+                }
+            }
+        }
+
+        float score(int depth, int a, int x, int y) const
+        {
+            const MaxLevel &l = levels_[depth];
+            const int *dx = &dx_[size_t(a) * points_];
+            const int *dy = &dy_[size_t(a) * points_];
+            float sum = 0;
+            for (int i = 0; i < points_; ++i)
+                sum += l.at(x + dx[i], y + dy[i]);
+            return sum;
+        }
+
+        float threshold() const
+        {
+            return float(std::max(options.min_score, options.ambiguity * best_) * points_);
+        }
+
+        // 深度优先、子节点按上界从高到低展开，先找到的好解让后面剪得更多
+        void branch(int depth, std::vector<Candidate> &cands)
+        {
+            for (const Candidate &c : cands)
+            {
+                if (c.score < threshold())
+                    break;
+                if (depth == 0)
+                {
+                    addLeaf(c);
+                    continue;
+                }
+                int s = 1 << (depth - 1);
+                std::vector<Candidate> children;
+                children.reserve(4);
+                for (int j = 0; j < 2; ++j)
+                    for (int i = 0; i < 2; ++i)
+                    {
+                        int x = c.x + i * s, y = c.y + j * s;
+                        if (x < width_ && y < height_)
+                            children.push_back(Candidate{c.a, x, y, score(depth - 1, c.a, x, y)});
+                    }
+                std::sort(children.begin(), children.end());
+                branch(depth - 1, children);
+            }
+        }
+
+        // 相近的叶子归为同一个假设，只保留其中得分最高的
+        void addLeaf(const Candidate &c)
+        {
+            double s = c.score / points_;
+            best_ = std::max(best_, s);
+            const double sep_xy = options.separation_xy / resolution_;
+            const int sep_a = std::max(1, int(options.separation_yaw / angle_step_));
+            for (Candidate &m : modes_)
+            {
+                int da = std::abs(m.a - c.a);
+                da = std::min(da, angles_ - da);
+                if (da <= sep_a && std::hypot(double(m.x - c.x), double(m.y - c.y)) <= sep_xy)
+                {
+                    if (c.score > m.score)
+                        m = c;
+                    return;
+                }
+            }
+            modes_.push_back(c);
+        }
+
+        // 最优格附近按似然加权，得到亚格精度的位姿和协方差
+        Hypothesis refine(const Candidate &m) const
+        {
+            const double lz = std::log(options.z_rand);
+            const double scale = std::min(1.0, options.independent_points / points_);
+            auto logl = [&](int i, int j, int k)
+            {
+                int a = ((m.a + k) % angles_ + angles_) % angles_;
+                const int *dx = &dx_[size_t(a) * points_];
+                const int *dy = &dy_[size_t(a) * points_];
+                double l = 0;
+                for (int p = 0; p < points_; ++p)
+                    l += std::log(options.z_rand + options.z_hit * levels_[0].at(m.x + i + dx[p], m.y + j + dy[p])) - lz;
+                return l * scale;
+            };
+            Eigen::Vector3d mean;
+            Hypothesis h;
+            likelihoodMoments(logl, resolution_, angle_step_, mean, h.cov);
+            h.pose = SE2(field_.worldX(m.x) + mean(0), field_.worldY(m.y) + mean(1), wrapAngle(m.a * angle_step_ + mean(2)));
+            h.score = m.score / points_;
+            return h;
+        }
+
+        LikelihoodField field_;
+        std::vector<MaxLevel> levels_;
+        double resolution_;
+        int width_, height_;
+
+        // 单次搜索的工作区
+        int angles_ = 0, points_ = 0;
+        double angle_step_ = 0;
+        std::vector<int> dx_, dy_;
+        std::vector<Candidate> modes_;
+        double best_;
+    };
+}
+
+#endif
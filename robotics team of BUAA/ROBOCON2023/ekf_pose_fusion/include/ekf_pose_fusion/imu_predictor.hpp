@@ -0,0 +1,102 @@
+#ifndef __IMU_PREDICTOR_HPP
+#define __IMU_PREDICTOR_HPP
+
+#include <ros/ros.h>
+#include <eigen3/Eigen/Dense>
+#include <cmath>
+#include "ekf_pose_fusion/fixed_ekf.hpp"
+#include "ekf_pose_fusion/se2.hpp"
+
+namespace estimation
+{
+    // 两帧轮式里程计之间用 IMU 积分外推 odom -> base_footprint
+    // 航向用陀螺 z 轴角速度积分；速度取最近一帧里程计的机体系速度，可选用加速度计修正
+    // 每帧里程计到达时 reset 回里程计位姿，积分误差不会跨帧累积
+    class ImuPredictor
+    {
+    public:
+        struct State
+        {
+            ros::Time stamp;
+            Eigen::Vector3d pose = Eigen::Vector3d::Zero(); // x y yaw，odom 系
+            Eigen::Vector2d vel = Eigen::Vector2d::Zero();  // 机体系速度
+            Eigen::Matrix3d P = Eigen::Matrix3d::Zero();    // 自上次 reset 以来的外推协方差
+        };
+
+        double gyro_noise = 1e-4;  // 角速度噪声功率谱密度 (rad/s)^2/Hz
+        double vel_noise = 1e-3;   // 速度随机游走 (m/s)^2/Hz
+        double max_dt = 0.05;      // 超过此间隔的 IMU 帧只更新时间戳，不积分
+        bool use_accel = false;
+
+        ImuPredictor() : reseted_(false), last_w_(0) {}
+
+        bool ready() const { return reseted_; }
+        const State &state() const { return state_; }
+
+        // 里程计（修正）到达：回到里程计位姿，速度取里程计 twist
+        void reset(const ros::Time &stamp, const Eigen::Vector3d &pose, const Eigen::Vector2d &body_vel)
+        {
+            // 比当前外推时刻还旧的里程计也要接受，之后的 IMU 帧会从这里重新积分
+            state_.stamp = stamp;
+            state_.pose = pose;
+            state_.vel = body_vel;
+            state_.P.setZero();
+            reseted_ = true;
+        }
+
+        // 返回 false 表示未 reset 或时间戳不递增，未积分
+        bool predict(const ros::Time &stamp, double gyro_z, const Eigen::Vector2d &accel = Eigen::Vector2d::Zero())
+        {
+            if (!reseted_ || stamp <= state_.stamp)
+                return false;
+            double dt = (stamp - state_.stamp).toSec();
+            state_.stamp = stamp;
+            if (dt > max_dt)
+            {
+                last_w_ = gyro_z;
+                return false;
+            }
+
+            // 中点法：航向取区间中点，转弯时比前向欧拉准
+            double &yaw = state_.pose(2);
+            double ym = yaw + 0.5 * gyro_z * dt;
+            double c = cos(ym), s = sin(ym);
+            double vx = state_.vel(0), vy = state_.vel(1);
+            if (use_accel)
+            {
+                // 机体系下 dv/dt = a - w x v，两个分量都用更新前的速度
+                const double vx0 = vx, vy0 = vy;
+                vx = vx0 + (accel(0) + gyro_z * vy0) * dt;
+                vy = vy0 + (accel(1) - gyro_z * vx0) * dt;
+                state_.vel << vx, vy;
+            }
+            Eigen::Vector3d fx(state_.pose(0) + (c * vx - s * vy) * dt,
+                               state_.pose(1) + (s * vx + c * vy) * dt,
+                               wrapAngle(yaw + gyro_z * dt));
+
+            Eigen::Matrix3d F = Eigen::Matrix3d::Identity();
+            F(0, 2) = -(s * vx + c * vy) * dt;
+            F(1, 2) = (c * vx - s * vy) * dt;
+            Eigen::Matrix3d Q = Eigen::Matrix3d::Zero();
+            Q(0, 0) = Q(1, 1) = vel_noise * dt * dt * dt + 1e-12;
+            Q(2, 2) = gyro_noise * dt + 1e-12;
+
+            ekf_.init(state_.pose, state_.P);
+            ekf_.predictNonlinear(fx, F, Q);
+            state_.pose = ekf_.state();
+            state_.P = ekf_.covariance();
+            last_w_ = gyro_z;
+            return true;
+        }
+
+        double angularVelocity() const { return last_w_; }
+
+    private:
+        bool reseted_;
+        double last_w_;
+        State state_;
+        FixedEKF<3> ekf_;
+    };
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef __INNOVATION_MONITOR_HPP
+#define __INNOVATION_MONITOR_HPP
+
+#include <eigen3/Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace estimation
+{
+    // 归一化新息平方 NIS = nu^T S^-1 nu，模型和噪声正确时服从自由度为量测维数的卡方分布
+    inline double normalizedInnovation(const Eigen::Vector3d &nu, const Eigen::Matrix3d &S)
+    {
+        Eigen::LDLT<Eigen::Matrix3d> ldlt(S);
+        if (ldlt.info() != Eigen::Success)
+            return INFINITY;
+        return nu.dot(ldlt.solve(nu));
+    }
+
+    // 卡方分布分位数的 Wilson-Hilferty 近似，z 为标准正态分位数；k >= 3 时误差在 1% 以内
+    inline double chiSquareQuantile(double k, double z)
+    {
+        double a = 2.0 / (9.0 * k);
+        double t = 1 - a + z * std::sqrt(a);
+        return k * t * t * t;
+    }
+
+    // 卡方门限：NIS 不超过 accept 直接融合，accept 与 reject 之间按 NIS / accept 放大量测协方差，超过 reject 丢弃
+    struct NisGate
+    {
+        enum Verdict
+        {
+            ACCEPT,
+            DOWNWEIGHT,
+            REJECT
+        };
+
+        double accept = 11.34; // 3 自由度卡方 99%
+        double reject = 21.11; // 3 自由度卡方 99.99%
+
+        // scale 为量测协方差的放大倍数
+        Verdict classify(double nis, double &scale) const
+        {
+            scale = 1;
+            if (nis <= accept)
+                return ACCEPT;
+            if (nis > reject)
+                return REJECT;
+            scale = nis / accept;
+            return DOWNWEIGHT;
+        }
+    };
+
+    // 单个传感器的 NIS 统计：最近 window 个未被丢弃的值的滑动平均，与累计的判定计数
+    // 窗口平均乘以个数服从 window * dof 自由度的卡方分布，落在 95% 双侧区间外说明噪声模型与实际不符
+    // 融合线程写，汇报定时器读
+    class NisMonitor
+    {
+    public:
+        struct Stats
+        {
+            uint64_t total = 0, accepted = 0, downweighted = 0, rejected = 0;
+            size_t count = 0;   // 窗口内的个数
+            double mean = 0;    // 窗口平均 NIS
+            double max = 0;     // 窗口内最大值
+            double last = 0;
+            double lower = 0, upper = 0; // 窗口平均的 95% 区间
+            bool consistent = true;
+        };
+
+        explicit NisMonitor(int dof = 3, size_t window = 50) : dof_(dof) { setWindow(window); }
+
+        void setWindow(size_t window)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            values_.assign(std::max<size_t>(window, 1), 0.0);
+            head_ = size_ = 0;
+        }
+
+        void reset()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            head_ = size_ = 0;
+            stats_ = Stats();
+        }
+
+        void record(double nis, NisGate::Verdict verdict)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.total;
+            if (verdict == NisGate::ACCEPT)
+                ++stats_.accepted;
+            else if (verdict == NisGate::DOWNWEIGHT)
+                ++stats_.downweighted;
+            else
+                ++stats_.rejected;
+            // 丢弃的是野值，不代表噪声模型，只计数
+            if (verdict == NisGate::REJECT || !std::isfinite(nis))
+                return;
+            stats_.last = nis;
+            if (size_ == values_.size())
+            {
+                head_ = (head_ + 1) % values_.size();
+                --size_;
+            }
+            values_[(head_ + size_) % values_.size()] = nis;
+            ++size_;
+        }
+
+        Stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Stats s = stats_;
+            s.count = size_;
+            if (size_ == 0)
+                return s;
+            double sum = 0, mx = 0;
+            for (size_t i = 0; i < size_; ++i)
+            {
+                double v = values_[(head_ + i) % values_.size()];
+                sum += v;
+                mx = std::max(mx, v);
+            }
+            double k = double(size_) * dof_;
+            s.mean = sum / size_;
+            s.max = mx;
+            s.lower = chiSquareQuantile(k, -1.96) / size_;
+            s.upper = chiSquareQuantile(k, 1.96) / size_;
+            s.consistent = s.mean >= s.lower && s.mean <= s.upper;
+            return s;
+        }
+
+    private:
+        int dof_;
+        mutable std::mutex mutex_;
+        std::vector<double> values_;
+        size_t head_ = 0, size_ = 0;
+        Stats stats_;
+    };
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef __LATENCY_STATS_HPP
+#define __LATENCY_STATS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// 编译期开关：未定义 EKF_LATENCY_STATS 时 EKF_LATENCY(...) 展开为空，不产生任何代码
+#ifdef EKF_LATENCY_STATS
+#define EKF_LATENCY(...) __VA_ARGS__
+#else
+#define EKF_LATENCY(...)
+#endif
+
+namespace estimation
+{
+    // 无锁延迟直方图：按 2 的幂分段，每段再线性细分 16 格，相对误差约 6%
+    // record 只有一次 relaxed fetch_add，任意线程可写；读者取快照后与上一次快照相减得到区间统计
+    class LatencyHistogram
+    {
+    public:
+        static const int SUB_BITS = 4;
+        static const int SUB = 1 << SUB_BITS;
+        static const int OCTAVES = 40; // 最大约 2^40 ns，约 18 分钟
+        static const int BUCKETS = (OCTAVES + 1) * SUB;
+
+        struct Snapshot
+        {
+            uint64_t count[BUCKETS];
+            uint64_t total;
+            int64_t max_ns;
+
+            Snapshot() : total(0), max_ns(0)
+            {
+                for (int i = 0; i < BUCKETS; ++i)
+                    count[i] = 0;
+            }
+            // 分位数 (ns)，取所在格的上沿
+            double percentile(double q) const
+            {
+                if (total == 0)
+                    return 0;
+                uint64_t rank = uint64_t(q * (total - 1)) + 1, acc = 0;
+                for (int i = 0; i < BUCKETS; ++i)
+                {
+                    acc += count[i];
+                    if (acc >= rank)
+                        return double(upper(i));
+                }
+                return double(upper(BUCKETS - 1));
+            }
+        };
+
+        LatencyHistogram()
+        {
+            for (int i = 0; i < BUCKETS; ++i)
+                count_[i].store(0, std::memory_order_relaxed);
+            max_ns_.store(0, std::memory_order_relaxed);
+        }
+        LatencyHistogram(const LatencyHistogram &) = delete;
+
+        void record(int64_t ns)
+        {
+            // 时钟不一致时可能为负，计入第一格
+            count_[index(ns > 0 ? uint64_t(ns) : 0)].fetch_add(1, std::memory_order_relaxed);
+            int64_t m = max_ns_.load(std::memory_order_relaxed);
+            while (ns > m && !max_ns_.compare_exchange_weak(m, ns, std::memory_order_relaxed))
+                ;
+        }
+
+        // 区间统计：out = 当前 - prev，并把当前累计值写回 prev；最大值读后清零
+        void collect(Snapshot &prev, Snapshot &out)
+        {
+            out.total = 0;
+            for (int i = 0; i < BUCKETS; ++i)
+            {
+                uint64_t c = count_[i].load(std::memory_order_relaxed);
+                out.count[i] = c - prev.count[i];
+                out.total += out.count[i];
+                prev.count[i] = c;
+            }
+            out.max_ns = max_ns_.exchange(0, std::memory_order_relaxed);
+        }
+
+        static int index(uint64_t ns)
+        {
+            if (ns < uint64_t(SUB))
+                return int(ns);
+            int msb = 63 - __builtin_clzll(ns);
+            int shift = msb - SUB_BITS;
+            int bucket = (shift + 1) * SUB + int((ns >> shift) & (SUB - 1));
+            return bucket < BUCKETS ? bucket : BUCKETS - 1;
+        }
+        static uint64_t upper(int i)
+        {
+            if (i < SUB)
+                return uint64_t(i);
+            int shift = i / SUB - 1;
+            return ((uint64_t(SUB + i % SUB) + 1) << shift) - 1;
+        }
+
+    private:
+        std::atomic<uint64_t> count_[BUCKETS];
+        std::atomic<int64_t> max_ns_;
+    };
+
+    // 每种传感器一组：时间戳 -> 回调入队 -> 融合线程取出 -> 更新完成 -> 发布完成，以及端到端
+    struct LatencyStats
+    {
+        enum Stage
+        {
+            TRANSPORT, // header.stamp 到回调入队（ros 时钟）
+            QUEUE,     // 入队到融合线程开始处理，含乱序等待窗口
+            UPDATE,    // 滤波更新
+            PUBLISH,   // 更新完成到位姿、补偿、tf 发出
+            TOTAL,     // header.stamp 到发出
+            STAGES
+        };
+        enum Source
+        {
+            WHEEL,
+            LASER,
+            VISUAL,
+            IMU,
+            TRUE_POSE,
+            OUTPUT, // 定频输出线程，只记 TOTAL：数据时间戳到外推结果发出
+            SOURCES
+        };
+
+        LatencyHistogram hist[SOURCES][STAGES];
+        LatencyHistogram::Snapshot last[SOURCES][STAGES]; // 只由汇报者访问
+
+        static const char *sourceName(int s)
+        {
+            static const char *names[SOURCES] = {"wheel", "laser", "visual", "imu", "true_pose", "output"};
+            return names[s];
+        }
+        static const char *stageName(int s)
+        {
+            static const char *names[STAGES] = {"transport", "queue", "update", "publish", "total"};
+            return names[s];
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef __LIKELIHOOD_FIELD_HPP
+#define __LIKELIHOOD_FIELD_HPP
+
+#include "ekf_pose_fusion/se2.hpp"
+#include <eigen3/Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace estimation
+{
+    // 场地上的一段墙、围栏或柱子边，map 系，单位 m
+    struct FieldSegment
+    {
+        double x1, y1, x2, y2;
+
+        double distance(double px, double py) const
+        {
+            double dx = x2 - x1, dy = y2 - y1;
+            double l2 = dx * dx + dy * dy;
+            double t = l2 > 0 ? ((px - x1) * dx + (py - y1) * dy) / l2 : 0;
+            t = std::min(1.0, std::max(0.0, t));
+            return std::hypot(px - x1 - t * dx, py - y1 - t * dy);
+        }
+    };
+
+    // 格中心到最近线段的距离，超过 max_distance 的记为 max_distance，只需要看线段附近
+    inline void segmentDistance(const std::vector<FieldSegment> &segments, double min_x, double min_y, int width, int height,
+                                double resolution, double max_distance, std::vector<float> &dist)
+    {
+        dist.assign(size_t(width) * height, float(max_distance));
+        for (const FieldSegment &s : segments)
+        {
+            int x0 = std::max(0, int(std::floor((std::min(s.x1, s.x2) - max_distance - min_x) / resolution)));
+            int x1 = std::min(width - 1, int(std::ceil((std::max(s.x1, s.x2) + max_distance - min_x) / resolution)));
+            int y0 = std::max(0, int(std::floor((std::min(s.y1, s.y2) - max_distance - min_y) / resolution)));
+            int y1 = std::min(height - 1, int(std::ceil((std::max(s.y1, s.y2) + max_distance - min_y) / resolution)));
+            for (int y = y0; y <= y1; ++y)
+                for (int x = x0; x <= x1; ++x)
+                {
+                    float &d = dist[size_t(y) * width + x];
+                    d = std::min(d, float(s.distance(min_x + (x + 0.5) * resolution, min_y + (y + 0.5) * resolution)));
+                }
+        }
+    }
+
+    // exp(-d^2 / 2 sigma^2)，超过 4 sigma 直接为 0
+    inline void likelihoodFromDistance(const float *dist, size_t n, double sigma, float *out)
+    {
+        const double k = -0.5 / (sigma * sigma);
+        const double reach = 4 * sigma;
+        for (size_t i = 0; i < n; ++i)
+            out[i] = dist[i] < reach ? float(std::exp(k * dist[i] * dist[i])) : 0.0f;
+    }
+
+    // 似然场：每格存 exp(-d^2 / 2 sigma^2)，d 为格中心到最近场地边界的距离
+    // 数据可以自己持有（由线段或距离图生成），也可以直接引用预先生成的地图文件，见 field_map_file.hpp
+    // 拷贝只复制指针，各个拷贝共享同一份格子
+    class LikelihoodField
+    {
+    public:
+        LikelihoodField() : origin_x_(0), origin_y_(0), resolution_(0.05), width_(0), height_(0) {}
+
+        // 覆盖 [min_x, max_x] x [min_y, max_y]，sigma 为激光点到边界的距离噪声
+        void build(const std::vector<FieldSegment> &segments, double min_x, double min_y, double max_x, double max_y,
+                   double resolution, double sigma)
+        {
+            int width = std::max(1, int(std::ceil((max_x - min_x) / resolution)));
+            int height = std::max(1, int(std::ceil((max_y - min_y) / resolution)));
+            std::vector<float> dist;
+            segmentDistance(segments, min_x, min_y, width, height, resolution, 4 * sigma, dist);
+            fromDistance(dist.data(), width, height, resolution, min_x, min_y, sigma);
+        }
+
+        // 由距离图生成，数据拷贝一份
+        void fromDistance(const float *dist, int width, int height, double resolution, double origin_x, double origin_y, double sigma)
+        {
+            size_t n = size_t(width) * height;
+            float *cells = new float[n];
+            likelihoodFromDistance(dist, n, sigma, cells);
+            attach(std::shared_ptr<const float>(cells, std::default_delete<float[]>()), width, height, resolution, origin_x, origin_y);
+        }
+
+        // 直接引用外部的格子，cells 的所有者负责数据的生命周期
+        void attach(std::shared_ptr<const float> cells, int width, int height, double resolution, double origin_x, double origin_y)
+        {
+            cells_ = cells;
+            width_ = width;
+            height_ = height;
+            resolution_ = resolution;
+            origin_x_ = origin_x;
+            origin_y_ = origin_y;
+        }
+
+        int width() const { return width_; }
+        int height() const { return height_; }
+        double resolution() const { return resolution_; }
+        double originX() const { return origin_x_; }
+        double originY() const { return origin_y_; }
+        bool empty() const { return !cells_; }
+
+        // 场地外为 0
+        float at(int x, int y) const
+        {
+            if (x < 0 || y < 0 || x >= width_ || y >= height_)
+                return 0.0f;
+            return cells_.get()[size_t(y) * width_ + x];
+        }
+        const float *data() const { return cells_.get(); }
+        const std::shared_ptr<const float> &shared() const { return cells_; }
+
+        // 格坐标与 map 坐标互换，格坐标取格中心
+        int cellX(double x) const { return int(std::floor((x - origin_x_) / resolution_)); }
+        int cellY(double y) const { return int(std::floor((y - origin_y_) / resolution_)); }
+        double worldX(double cx) const { return origin_x_ + (cx + 0.5) * resolution_; }
+        double worldY(double cy) const { return origin_y_ + (cy + 0.5) * resolution_; }
+
+    private:
+        double origin_x_, origin_y_, resolution_;
+        int width_, height_;
+        std::shared_ptr<const float> cells_;
+    };
+
+    // 多分辨率查找表的一层：每格存原图 2^h x 2^h 窗口 [x, x+2^h) x [y, y+2^h) 内的最大值
+    // 左下各多出 pad = 2^h - 1 格，使窗口部分落在场地外的位置也有值；第 0 层与似然场共用数据
+    struct MaxLevel
+    {
+        int pad, w, h;
+        std::shared_ptr<const float> v;
+
+        // 层外为 0
+        float at(int x, int y) const
+        {
+            x += pad;
+            y += pad;
+            if (x < 0 || y < 0 || x >= w || y >= h)
+                return 0.0f;
+            return v.get()[size_t(y) * w + x];
+        }
+        // 第 y 行 x = -pad 处的指针，调用者负责 y 与 x 的范围
+        const float *row(int y) const { return v.get() + size_t(y + pad) * w; }
+    };
+
+    // 第 h 层 (x, y) = max(第 h-1 层 (x, y), (x+s, y), (x, y+s), (x+s, y+s))，s = 2^(h-1)
+    // 用第 h 层算出的得分是该窗口内所有平移得分的上界，分支定界用它剪枝
+    inline void buildMaxPyramid(const LikelihoodField &field, int depth, std::vector<MaxLevel> &levels)
+    {
+        const int width = field.width(), height = field.height();
+        levels.assign(depth + 1, MaxLevel());
+        MaxLevel &base = levels[0];
+        base.pad = 0;
+        base.w = width;
+        base.h = height;
+        base.v = field.shared();
+        for (int h = 1; h <= depth; ++h)
+        {
+            const MaxLevel &prev = levels[h - 1];
+            MaxLevel &cur = levels[h];
+            int s = 1 << (h - 1);
+            cur.pad = (1 << h) - 1;
+            cur.w = width + cur.pad;
+            cur.h = height + cur.pad;
+            float *v = new float[size_t(cur.w) * cur.h];
+            for (int y = -cur.pad; y < height; ++y)
+                for (int x = -cur.pad; x < width; ++x)
+                    v[size_t(y + cur.pad) * cur.w + x + cur.pad] =
+                        std::max(std::max(prev.at(x, y), prev.at(x + s, y)), std::max(prev.at(x, y + s), prev.at(x + s, y + s)));
+            cur.v.reset(v, std::default_delete<float[]>());
+        }
+    }
+
+    // 在最优位姿附近 5x5x5 的邻域里按似然加权，得到亚格精度的偏移 mean 和协方差 cov
+    // logl(i, j, k) 为平移 (i, j) 格、旋转 k 个角度步长处的对数似然
+    template <class LogLikelihood>
+    void likelihoodMoments(LogLikelihood logl, double resolution, double angle_step, Eigen::Vector3d &mean, Eigen::Matrix3d &cov)
+    {
+        const int R = 2;
+        double l[2 * R + 1][2 * R + 1][2 * R + 1];
+        double lmax = -1e300;
+        for (int k = -R; k <= R; ++k)
+            for (int j = -R; j <= R; ++j)
+                for (int i = -R; i <= R; ++i)
+                {
+                    l[k + R][j + R][i + R] = logl(i, j, k);
+                    lmax = std::max(lmax, l[k + R][j + R][i + R]);
+                }
+        double wsum = 0;
+        Eigen::Matrix3d second = Eigen::Matrix3d::Zero();
+        mean.setZero();
+        for (int k = -R; k <= R; ++k)
+            for (int j = -R; j <= R; ++j)
+                for (int i = -R; i <= R; ++i)
+                {
+                    double w = std::exp(l[k + R][j + R][i + R] - lmax);
+                    Eigen::Vector3d d(i * resolution, j * resolution, k * angle_step);
+                    wsum += w;
+                    mean += w * d;
+                    second += w * d * d.transpose();
+                }
+        mean /= wsum;
+        cov = second / wsum - mean * mean.transpose();
+        // 离散化误差兜底
+        cov(0, 0) += resolution * resolution / 12;
+        cov(1, 1) += resolution * resolution / 12;
+        cov(2, 2) += angle_step * angle_step / 12;
+    }
+
+    // 激光帧转成 base_footprint 系下的点，mount 为 base_footprint->laser
+    // 按 min_spacing 抽稀：与上一个保留点距离不足的点丢掉，远处稀疏的点都保留
+    inline void scanToPoints(const std::vector<float> &ranges, double angle_min, double angle_increment,
+                             double range_min, double range_max, const SE2 &mount, double min_spacing,
+                             std::vector<Eigen::Vector2d> &out)
+    {
+        out.clear();
+        const double s2 = min_spacing * min_spacing;
+        // 逐点旋转用复数递推，不在循环里调三角函数
+        double c = std::cos(angle_min), s = std::sin(angle_min);
+        const double dc = std::cos(angle_increment), ds = std::sin(angle_increment);
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            double r = ranges[i];
+            if (std::isfinite(r) && r >= range_min && r <= range_max)
+            {
+                double lx = r * c, ly = r * s;
+                Eigen::Vector2d v(mount.x + mount.c * lx - mount.s * ly, mount.y + mount.s * lx + mount.c * ly);
+                if (out.empty() || (v - out.back()).squaredNorm() >= s2)
+                    out.push_back(v);
+            }
+            double nc = c * dc - s * ds;
+            s = s * dc + c * ds;
+            c = nc;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef __MPSC_QUEUE_HPP
+#define __MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace estimation
+{
+    // 定容量无锁队列，多生产者单消费者（Vyukov 有界队列）
+    // 每个槽位带序号：序号等于写位置时可写，等于写位置 + 1 时可读
+    // 生产者之间只竞争一次 CAS，消费者不与生产者共享任何锁；满时 push 返回 false
+    template <class T>
+    class MpscQueue
+    {
+        struct Cell
+        {
+            std::atomic<size_t> seq;
+            T data;
+        };
+
+    public:
+        explicit MpscQueue(size_t capacity = 1024)
+        {
+            size_t cap = 2;
+            while (cap < capacity)
+                cap <<= 1;
+            mask_ = cap - 1;
+            cells_.reset(new Cell[cap]);
+            for (size_t i = 0; i < cap; ++i)
+                cells_[i].seq.store(i, std::memory_order_relaxed);
+            tail_.store(0, std::memory_order_relaxed);
+            head_ = 0;
+        }
+        MpscQueue(const MpscQueue &) = delete;
+
+        size_t capacity() const { return mask_ + 1; }
+
+        // 任意线程
+        bool push(const T &v)
+        {
+            Cell *cell;
+            size_t pos = tail_.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                cell = &cells_[pos & mask_];
+                size_t seq = cell->seq.load(std::memory_order_acquire);
+                intptr_t dif = intptr_t(seq) - intptr_t(pos);
+                if (dif == 0)
+                {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (dif < 0)
+                {
+                    return false; // 满
+                }
+                else
+                {
+                    pos = tail_.load(std::memory_order_relaxed);
+                }
+            }
+            cell->data = v;
+            cell->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // 仅消费者线程
+        bool pop(T &v)
+        {
+            Cell &cell = cells_[head_ & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            if (intptr_t(seq) - intptr_t(head_ + 1) < 0)
+                return false; // 空，或生产者还没写完
+            v = cell.data;
+            cell.data = T(); // 释放槽位里持有的资源（如消息的 shared_ptr）
+            cell.seq.store(head_ + mask_ + 1, std::memory_order_release);
+            ++head_;
+            return true;
+        }
+
+    private:
+        std::unique_ptr<Cell[]> cells_;
+        size_t mask_;
+        std::atomic<size_t> tail_; // 生产者共享
+        char pad_[64];             // 生产者与消费者的位置分开缓存行
+        size_t head_;              // 只有消费者访问
+    };
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef __OBJECT_POOL_HPP
+#define __OBJECT_POOL_HPP
+
+#include <array>
+#include <mutex>
+
+namespace estimation
+{
+    // 定容量对象池：对象一次性分配在池内，acquire/release 只移动空闲表，不再申请堆内存
+    // 池空时 acquire 返回 nullptr，由调用者决定丢弃还是等待
+    template <class T, int Capacity>
+    class ObjectPool
+    {
+    public:
+        ObjectPool()
+        {
+            for (int i = 0; i < Capacity; ++i)
+                free_[i] = &objs_[i];
+            nfree_ = Capacity;
+        }
+        ObjectPool(const ObjectPool &) = delete;
+
+        T *acquire()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (nfree_ == 0)
+                return nullptr;
+            return free_[--nfree_];
+        }
+
+        void release(T *obj)
+        {
+            if (!obj)
+                return;
+            *obj = T(); // 归还时复位，下次取出是干净的对象
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_[nfree_++] = obj;
+        }
+
+        int available()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return nfree_;
+        }
+
+    private:
+        std::array<T, Capacity> objs_;
+        std::array<T *, Capacity> free_;
+        int nfree_;
+        std::mutex mutex_;
+    };
+}
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef __POSE_HISTORY_HPP
+#define __POSE_HISTORY_HPP
+
+#include <tf/tf.h>
+#include <eigen3/Eigen/Dense>
+#include "ekf_pose_fusion/se2.hpp"
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+namespace estimation
+{
+    // 按时间索引的 SE(2) 位姿历史，结构体数组改为数组结构体：每个量一段连续内存
+    // 每一行是一个时间戳，保存所有坐标系在该时刻的值，一次二分查找即可插值出全部坐标系
+    // 某个坐标系在一行中没有被显式设置时沿用之前的值（保持），之后补设时向后刷新被保持的行
+    class PoseHistory
+    {
+    public:
+        enum Frame
+        {
+            M2O = 0,       // map -> odom
+            O2B = 1,       // odom -> base_footprint
+            TRUE_POSE = 2, // 仿真真值 map -> base_footprint
+            FRAME_NUM = 3
+        };
+        static const int COV_BIT = 1 << FRAME_NUM; // map -> base_footprint 协方差
+
+        struct Pose2
+        {
+            double x = 0, y = 0, yaw = 0;
+        };
+        // 查询结果
+        struct Sample
+        {
+            ros::Time stamp;
+            Pose2 frame[FRAME_NUM];
+            Eigen::Matrix3d cov = Eigen::Matrix3d::Zero();
+
+            tf::Transform transform(Frame f) const { return toTransform(frame[f]); }
+            SE2 pose(Frame f) const { return SE2(frame[f].x, frame[f].y, frame[f].yaw); }
+        };
+
+        explicit PoseHistory(size_t capacity = 4096) { reset(capacity); }
+
+        void reset(size_t capacity)
+        {
+            capacity_ = capacity > 1 ? capacity : 2;
+            stamp_.assign(capacity_, 0);
+            for (int f = 0; f < FRAME_NUM; ++f)
+            {
+                x_[f].assign(capacity_, 0);
+                y_[f].assign(capacity_, 0);
+                yaw_[f].assign(capacity_, 0);
+            }
+            cov_.assign(capacity_ * 9, 0);
+            set_.assign(capacity_, 0);
+            head_ = size_ = 0;
+        }
+
+        size_t size() const { return size_; }
+        size_t capacity() const { return capacity_; }
+        ros::Time latest() const { return size_ ? toTime(stamp_[idx(size_ - 1)]) : ros::Time(); }
+        ros::Time oldest() const { return size_ ? toTime(stamp_[idx(0)]) : ros::Time(); }
+
+        // 比全部历史都旧且缓冲已满时返回 false
+        bool insert(Frame f, const ros::Time &stamp, double x, double y, double yaw)
+        {
+            size_t r;
+            if (!row(stamp, r))
+                return false;
+            size_t i = idx(r);
+            x_[f][i] = x;
+            y_[f][i] = y;
+            yaw_[f][i] = yaw;
+            set_[i] |= 1 << f;
+            // 向后刷新保持的值
+            for (size_t k = r + 1; k < size_; ++k)
+            {
+                size_t j = idx(k);
+                if (set_[j] & (1 << f))
+                    break;
+                x_[f][j] = x;
+                y_[f][j] = y;
+                yaw_[f][j] = yaw;
+            }
+            return true;
+        }
+        bool insert(Frame f, const ros::Time &stamp, const tf::Transform &t)
+        {
+            return insert(f, stamp, SE2::fromTransform(t));
+        }
+        bool insert(Frame f, const ros::Time &stamp, const SE2 &p)
+        {
+            return insert(f, stamp, p.x, p.y, p.yaw());
+        }
+
+        bool setCovariance(const ros::Time &stamp, const Eigen::Matrix3d &cov)
+        {
+            size_t r;
+            if (!row(stamp, r))
+                return false;
+            size_t i = idx(r);
+            covAt(i) = cov;
+            set_[i] |= COV_BIT;
+            for (size_t k = r + 1; k < size_; ++k)
+            {
+                size_t j = idx(k);
+                if (set_[j] & COV_BIT)
+                    break;
+                covAt(j) = cov;
+            }
+            return true;
+        }
+
+        // stamp 为 0 时取最新；超出历史范围返回 false
+        bool lookup(const ros::Time &stamp, Sample &out) const
+        {
+            if (size_ == 0)
+                return false;
+            if (stamp.isZero())
+            {
+                fill(idx(size_ - 1), idx(size_ - 1), 0, out);
+                out.stamp = latest();
+                return true;
+            }
+            int64_t t = stamp.toNSec();
+            size_t r = upperBound(t);
+            if (r == 0 || (r == size_ && stamp_[idx(size_ - 1)] != t))
+                return false;
+            size_t i0 = idx(r - 1);
+            if (stamp_[i0] == t || r == size_)
+            {
+                fill(i0, i0, 0, out);
+            }
+            else
+            {
+                size_t i1 = idx(r);
+                fill(i0, i1, double(t - stamp_[i0]) / double(stamp_[i1] - stamp_[i0]), out);
+            }
+            out.stamp = stamp;
+            return true;
+        }
+
+        static tf::Transform toTransform(const Pose2 &p)
+        {
+            return SE2(p.x, p.y, p.yaw).toTransform();
+        }
+
+    private:
+        size_t idx(size_t r) const { return (head_ + r) % capacity_; }
+        Eigen::Map<Eigen::Matrix3d> covAt(size_t i) { return Eigen::Map<Eigen::Matrix3d>(&cov_[i * 9]); }
+        Eigen::Map<const Eigen::Matrix3d> covAt(size_t i) const { return Eigen::Map<const Eigen::Matrix3d>(&cov_[i * 9]); }
+        static ros::Time toTime(int64_t ns)
+        {
+            ros::Time t;
+            t.fromNSec(ns);
+            return t;
+        }
+        // 第一个 stamp > t 的行
+        size_t upperBound(int64_t t) const
+        {
+            size_t lo = 0, hi = size_;
+            while (lo < hi)
+            {
+                size_t mid = (lo + hi) / 2;
+                if (t < stamp_[idx(mid)])
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            return lo;
+        }
+
+        void fill(size_t i0, size_t i1, double a, Sample &out) const
+        {
+            for (int f = 0; f < FRAME_NUM; ++f)
+            {
+                out.frame[f].x = x_[f][i0] + a * (x_[f][i1] - x_[f][i0]);
+                out.frame[f].y = y_[f][i0] + a * (y_[f][i1] - y_[f][i0]);
+                out.frame[f].yaw = wrapAngle(yaw_[f][i0] + a * wrapAngle(yaw_[f][i1] - yaw_[f][i0]));
+            }
+            // 正定矩阵的凸组合仍正定
+            out.cov = (1 - a) * covAt(i0) + a * covAt(i1);
+        }
+
+        void copyRow(size_t from, size_t to)
+        {
+            stamp_[to] = stamp_[from];
+            for (int f = 0; f < FRAME_NUM; ++f)
+            {
+                x_[f][to] = x_[f][from];
+                y_[f][to] = y_[f][from];
+                yaw_[f][to] = yaw_[f][from];
+            }
+            std::copy(&cov_[from * 9], &cov_[from * 9] + 9, &cov_[to * 9]);
+            set_[to] = set_[from];
+        }
+
+        // 找到或插入时间戳为 stamp 的行，新行的各坐标系值由相邻行插值（或保持最新值）
+        bool row(const ros::Time &stamp, size_t &r)
+        {
+            int64_t t = stamp.toNSec();
+            size_t pos = upperBound(t);
+            if (pos > 0 && stamp_[idx(pos - 1)] == t)
+            {
+                r = pos - 1;
+                return true;
+            }
+            Sample s;
+            bool has_prev = pos > 0;
+            if (has_prev)
+            {
+                if (pos < size_)
+                    fill(idx(pos - 1), idx(pos), double(t - stamp_[idx(pos - 1)]) / double(stamp_[idx(pos)] - stamp_[idx(pos - 1)]), s);
+                else
+                    fill(idx(pos - 1), idx(pos - 1), 0, s);
+            }
+            else if (size_)
+            {
+                fill(idx(0), idx(0), 0, s);
+            }
+            if (size_ == capacity_)
+            {
+                if (pos == 0)
+                    return false;
+                head_ = (head_ + 1) % capacity_;
+                --size_;
+                --pos;
+            }
+            for (size_t k = size_; k > pos; --k)
+                copyRow(idx(k - 1), idx(k));
+            size_t i = idx(pos);
+            stamp_[i] = t;
+            for (int f = 0; f < FRAME_NUM; ++f)
+            {
+                x_[f][i] = s.frame[f].x;
+                y_[f][i] = s.frame[f].y;
+                yaw_[f][i] = s.frame[f].yaw;
+            }
+            covAt(i) = s.cov;
+            set_[i] = 0;
+            ++size_;
+            r = pos;
+            return true;
+        }
+
+        size_t capacity_, head_, size_;
+        std::vector<int64_t> stamp_;
+        std::vector<double> x_[FRAME_NUM], y_[FRAME_NUM], yaw_[FRAME_NUM];
+        std::vector<double> cov_; // 每行 9 个，列主序
+        std::vector<uint8_t> set_; // 每行中显式设置过的坐标系
+    };
+}
+
+#endif
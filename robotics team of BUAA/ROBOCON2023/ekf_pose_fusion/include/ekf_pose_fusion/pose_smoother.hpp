@@ -0,0 +1,311 @@
+#ifndef __POSE_SMOOTHER_HPP
+#define __POSE_SMOOTHER_HPP
+
+#include <ros/time.h>
+#include <eigen3/Eigen/Dense>
+#include "ekf_pose_fusion/se2.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace estimation
+{
+    // 固定滞后的滑窗位姿图平滑，pose_fuser 的另一种后端
+    // 每个雷达量测一个节点，状态为该时刻的 map->base_footprint (x, y, yaw)；
+    // 相邻节点之间是轮式里程计的相对位姿因子，节点自身是雷达的一元因子，最旧的节点上是边缘化留下的先验
+    // 图是一条链，正规方程为块三对角，按 3x3 块做前向消元、回代，每次迭代 O(窗口长度)
+    class SlidingWindowSmoother
+    {
+    public:
+        struct Options
+        {
+            int window = 20;         // 窗口内最多的节点数，超出后边缘化最旧的
+            int max_iterations = 3;  // 每次加入量测后的高斯牛顿迭代上限
+            double tolerance = 1e-6; // 增量小于此值时提前结束
+            // 与 pose_fuser 的里程计过程噪声含义相同：每米、每弧度增加的方差，以及每步的基础方差
+            double odom_noise_xy = 1e-3;
+            double odom_noise_yaw = 1e-3;
+            double odom_noise_min = 1e-8;
+        };
+
+        struct Node
+        {
+            ros::Time stamp;
+            SE2 o2b;           // 该时刻的 odom->base_footprint
+            Eigen::Vector3d x; // map->base_footprint 估计
+            Eigen::Matrix3d P; // 窗口内的边缘协方差
+            bool has_meas;
+            Eigen::Vector3d z;
+            Eigen::Matrix3d R;
+            Eigen::Vector3d nu; // 加入时量测与里程计预测之差
+            Eigen::Matrix3d slip; // 到前一节点的里程计因子额外的协方差（前一节点系），判定打滑时非零
+        };
+
+        Options options;
+
+        SlidingWindowSmoother() : iterations_(0) {}
+
+        // 以给定位姿和协方差重新开始，窗口中只剩一个带先验的节点
+        void reset(const ros::Time &stamp, const SE2 &o2b, const Eigen::Vector3d &x, const Eigen::Matrix3d &P)
+        {
+            nodes_.clear();
+            Node n;
+            n.stamp = stamp;
+            n.o2b = o2b;
+            n.x = x;
+            n.P = P;
+            n.has_meas = false;
+            n.z.setZero();
+            n.R.setZero();
+            n.nu.setZero();
+            n.slip.setZero();
+            nodes_.push_back(n);
+            prior_mean_ = x;
+            prior_info_ = P.inverse();
+        }
+
+        bool empty() const { return nodes_.empty(); }
+        size_t size() const { return nodes_.size(); }
+        const Node &node(size_t i) const { return nodes_[i]; }
+        const Node &latest() const { return nodes_.back(); }
+        // 最近一次 add 用掉的迭代次数
+        int iterations() const { return iterations_; }
+
+        // 时间戳恰好为 stamp 的节点下标，没有时返回 -1
+        int find(const ros::Time &stamp) const
+        {
+            size_t pos = upperBound(stamp);
+            return pos > 0 && nodes_[pos - 1].stamp == stamp ? int(pos - 1) : -1;
+        }
+
+        // 前一节点按里程计增量外推到 stamp 时刻，协方差与 EKF 的预测相同；早于窗口时返回 false
+        bool predict(const ros::Time &stamp, const SE2 &o2b, Eigen::Vector3d &x, Eigen::Matrix3d &P) const
+        {
+            if (nodes_.empty() || stamp < nodes_.front().stamp)
+                return false;
+            const Node &prev = nodes_[upperBound(stamp) - 1];
+            SE2 delta = prev.o2b.between(o2b);
+            x = (SE2(prev.x) * delta).vec();
+            // 复合对 prev.x 的雅可比，与 pose_fuser::propagate 的 F 相同
+            Eigen::Matrix3d F = Eigen::Matrix3d::Identity();
+            F(0, 2) = prev.x(1) - x(1);
+            F(1, 2) = x(0) - prev.x(0);
+            P = F * prev.P * F.transpose() + odomCovariance(delta);
+            return true;
+        }
+
+        // 加入 stamp 时刻的量测，o2b 为同一时刻的里程计；早于窗口中最旧的节点时返回 false
+        // slip 为到前一节点的里程计因子额外的协方差，一般为零；插到已有节点之间时与后一节点的 slip 按时间拆分
+        bool add(const ros::Time &stamp, const SE2 &o2b, const Eigen::Vector3d &z, const Eigen::Matrix3d &R,
+                 const Eigen::Matrix3d &slip = Eigen::Matrix3d::Zero())
+        {
+            if (nodes_.empty() || stamp < nodes_.front().stamp)
+                return false;
+            size_t pos = upperBound(stamp);
+            // 初值：前一节点按里程计增量外推
+            const Node &prev = nodes_[pos - 1];
+            Node n;
+            n.stamp = stamp;
+            n.o2b = o2b;
+            n.x = (SE2(prev.x) * prev.o2b.between(o2b)).vec();
+            n.P.setZero();
+            n.has_meas = true;
+            n.z = z;
+            n.R = R;
+            n.nu = boxminus(z, n.x);
+            n.slip = slip;
+            if (pos < nodes_.size())
+            {
+                // 乱序插到两节点之间：后一节点的打滑协方差原本作用在 prev -> next 整段上，
+                // 按时间比例拆到 prev -> n、n -> next 两段，后一段转到新节点系下
+                Node &next = nodes_[pos];
+                double a = (stamp - prev.stamp).toSec() / (next.stamp - prev.stamp).toSec();
+                Eigen::Matrix3d J = Eigen::Matrix3d::Identity();
+                J.topLeftCorner<2, 2>() = Eigen::Rotation2Dd(-prev.o2b.between(o2b).yaw()).toRotationMatrix();
+                n.slip += a * next.slip;
+                next.slip = (1 - a) * J * next.slip * J.transpose();
+            }
+            nodes_.insert(nodes_.begin() + pos, n);
+
+            optimize();
+            while (nodes_.size() > size_t(std::max(2, options.window)))
+                marginalizeFront();
+            return true;
+        }
+
+    private:
+        size_t upperBound(const ros::Time &stamp) const
+        {
+            size_t lo = 0, hi = nodes_.size();
+            while (lo < hi)
+            {
+                size_t mid = (lo + hi) / 2;
+                if (stamp < nodes_[mid].stamp)
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            return lo;
+        }
+
+        Eigen::Matrix3d odomCovariance(const SE2 &delta) const
+        {
+            Eigen::Matrix3d Q = Eigen::Matrix3d::Zero();
+            Q(0, 0) = Q(1, 1) = options.odom_noise_min + options.odom_noise_xy * std::hypot(delta.x, delta.y);
+            Q(2, 2) = options.odom_noise_min + options.odom_noise_yaw * std::fabs(delta.yaw());
+            return Q;
+        }
+
+        // 节点 i -> i+1 的里程计因子：残差、对两端的雅可比和信息矩阵
+        void odomFactor(size_t i, Eigen::Vector3d &r, Eigen::Matrix3d &A, Eigen::Matrix3d &B, Eigen::Matrix3d &W) const
+        {
+            const Node &a = nodes_[i], &b = nodes_[i + 1];
+            SE2 meas = a.o2b.between(b.o2b);
+            // 预测的相对位姿：a 系下看到的 b
+            r = boxminus(SE2(a.x).between(SE2(b.x)).vec(), meas.vec());
+            betweenJacobians(a.x, b.x, A, B);
+            W = (odomCovariance(meas) + b.slip).inverse();
+        }
+
+        // 在当前估计处线性化，填充块三对角正规方程：D_i 对角块，U_i 为 (i, i+1) 块，g 为梯度
+        void linearize()
+        {
+            const size_t n = nodes_.size();
+            D_.assign(n, Eigen::Matrix3d::Zero());
+            U_.assign(n, Eigen::Matrix3d::Zero());
+            g_.assign(n, Eigen::Vector3d::Zero());
+            Eigen::Vector3d r = boxminus(nodes_[0].x, prior_mean_);
+            D_[0] += prior_info_;
+            g_[0] += prior_info_ * r;
+            for (size_t i = 0; i < n; ++i)
+            {
+                const Node &nd = nodes_[i];
+                if (nd.has_meas)
+                {
+                    Eigen::Matrix3d W = nd.R.inverse();
+                    D_[i] += W;
+                    g_[i] += W * boxminus(nd.x, nd.z);
+                }
+                if (i + 1 < n)
+                {
+                    Eigen::Matrix3d A, B, W;
+                    odomFactor(i, r, A, B, W);
+                    Eigen::Matrix3d AtW = A.transpose() * W, BtW = B.transpose() * W;
+                    D_[i] += AtW * A;
+                    D_[i + 1] += BtW * B;
+                    U_[i] += AtW * B;
+                    g_[i] += AtW * r;
+                    g_[i + 1] += BtW * r;
+                }
+            }
+        }
+
+        // 块三对角的前向消元与回代，解 H dx = -g；S_i 为消去前 i 个节点后第 i 个节点的舒尔补
+        void solve()
+        {
+            const size_t n = nodes_.size();
+            S_.resize(n);
+            y_.resize(n);
+            dx_.resize(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                Eigen::Matrix3d S = D_[i];
+                Eigen::Vector3d y = -g_[i];
+                if (i > 0)
+                {
+                    // L = U_{i-1}^T S_{i-1}^{-1}
+                    Eigen::Matrix3d Lt = S_[i - 1].solve(U_[i - 1]);
+                    S -= Lt.transpose() * U_[i - 1];
+                    y -= Lt.transpose() * y_[i - 1];
+                }
+                S_[i].compute(S);
+                y_[i] = y;
+            }
+            for (size_t k = n; k-- > 0;)
+            {
+                Eigen::Vector3d rhs = y_[k];
+                if (k + 1 < n)
+                    rhs -= U_[k] * dx_[k + 1];
+                dx_[k] = S_[k].solve(rhs);
+            }
+        }
+
+        void optimize()
+        {
+            iterations_ = 0;
+            for (int it = 0; it < std::max(1, options.max_iterations); ++it)
+            {
+                linearize();
+                solve();
+                ++iterations_;
+                double step = 0;
+                for (size_t i = 0; i < nodes_.size(); ++i)
+                {
+                    nodes_[i].x = boxplus(nodes_[i].x, dx_[i]);
+                    step = std::max(step, dx_[i].cwiseAbs().maxCoeff());
+                }
+                if (step < options.tolerance)
+                    break;
+            }
+            covariances();
+        }
+
+        // 由最后一次消元的舒尔补反向递推各节点的边缘协方差，与 RTS 平滑相同的形式
+        void covariances()
+        {
+            const size_t n = nodes_.size();
+            const Eigen::Matrix3d I = Eigen::Matrix3d::Identity();
+            nodes_[n - 1].P = S_[n - 1].solve(I);
+            for (size_t k = n - 1; k-- > 0;)
+            {
+                Eigen::Matrix3d G = S_[k].solve(U_[k]);
+                Eigen::Matrix3d Pk = S_[k].solve(I) + G * nodes_[k + 1].P * G.transpose();
+                nodes_[k].P = 0.5 * (Pk + Pk.transpose());
+            }
+        }
+
+        // 边缘化最旧的节点：它的先验、量测和到下一节点的里程计因子在当前估计处线性化，
+        // 舒尔补后成为下一节点上的高斯先验
+        void marginalizeFront()
+        {
+            const Node &n0 = nodes_[0];
+            Eigen::Matrix3d H00 = prior_info_;
+            Eigen::Vector3d g0 = prior_info_ * boxminus(n0.x, prior_mean_);
+            if (n0.has_meas)
+            {
+                Eigen::Matrix3d W = n0.R.inverse();
+                H00 += W;
+                g0 += W * boxminus(n0.x, n0.z);
+            }
+            Eigen::Vector3d r;
+            Eigen::Matrix3d A, B, W;
+            odomFactor(0, r, A, B, W);
+            H00 += A.transpose() * W * A;
+            g0 += A.transpose() * W * r;
+            Eigen::Matrix3d H01 = A.transpose() * W * B;
+            Eigen::Matrix3d H11 = B.transpose() * W * B;
+            Eigen::Vector3d g1 = B.transpose() * W * r;
+
+            Eigen::LDLT<Eigen::Matrix3d> H00f(H00);
+            Eigen::Matrix3d info = H11 - H01.transpose() * H00f.solve(H01);
+            Eigen::Vector3d grad = g1 - H01.transpose() * H00f.solve(g0);
+            info = 0.5 * (info + info.transpose());
+            // 先验 0.5 (x1 - m)^T info (x1 - m) 与线性化后的 0.5 d^T info d + grad^T d 在 x1 附近相同
+            prior_info_ = info;
+            prior_mean_ = boxplus(nodes_[1].x, -info.ldlt().solve(grad));
+            nodes_.erase(nodes_.begin());
+        }
+
+        std::vector<Node> nodes_;
+        Eigen::Vector3d prior_mean_; // 最旧节点上的先验
+        Eigen::Matrix3d prior_info_;
+        int iterations_;
+
+        // 求解的工作区
+        std::vector<Eigen::Matrix3d> D_, U_;
+        std::vector<Eigen::Vector3d> g_, y_, dx_;
+        std::vector<Eigen::LLT<Eigen::Matrix3d>> S_;
+    };
+}
+
+#endif
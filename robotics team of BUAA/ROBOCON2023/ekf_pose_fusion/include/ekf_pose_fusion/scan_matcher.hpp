@@ -0,0 +1,231 @@
+#ifndef __SCAN_MATCHER_HPP
+#define __SCAN_MATCHER_HPP
+
+#include "ekf_pose_fusion/likelihood_field.hpp"
+#include "ekf_pose_fusion/se2.hpp"
+#include <eigen3/Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace estimation
+{
+    // dst[0, n) += src[0, n)，一次 4 个 float
+    inline void addRow(float *dst, const float *src, int n)
+    {
+        int i = 0;
+#if defined(__SSE2__)
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+#elif defined(__ARM_NEON)
+        for (; i + 4 <= n; i += 4)
+            vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+#endif
+        for (; i < n; ++i)
+            dst[i] += src[i];
+    }
+
+    // 激光与场地似然场的相关匹配，在 EKF 先验附近的窗口里找最优位姿
+    // 两级查找表：粗层每格为 2^coarse_bits x 2^coarse_bits 块内的最大值，给出整块平移的得分上界；
+    // 上界高于当前最优的块再在细层上逐格打分。固定角度下同一点对一块内相邻平移查的是细层同一行的连续格子，
+    // 所以一块的得分按行累加，用 SIMD 一次加 4 个候选
+    class CorrelativeScanMatcher
+    {
+    public:
+        struct Options
+        {
+            double window_xy = 0.3;   // 平移搜索半径 (m)
+            double window_yaw = 0.15; // 航向搜索半径 (rad)
+            int coarse_bits = 3;      // 粗层一块 2^coarse_bits 格
+            double min_score = 0.4;   // 平均似然低于此值认为匹配失败
+            double max_range = 12.0;  // 只用于确定角度步长
+            double z_hit = 0.9;
+            double z_rand = 0.1;
+            double independent_points = 30; // 对数似然按这么多个独立点折算，见 GlobalRelocalizer
+        };
+
+        struct Result
+        {
+            SE2 pose;            // map->base_footprint
+            Eigen::Matrix3d cov; // x y yaw
+            double score;        // 平均似然 [0, 1]
+        };
+
+        Options options;
+
+        CorrelativeScanMatcher() : resolution_(0), width_(0), height_(0), blocks_evaluated_(0) {}
+
+        bool ready() const { return !levels_.empty(); }
+
+        void setMap(const LikelihoodField &field)
+        {
+            field_ = field;
+            resolution_ = field.resolution();
+            width_ = field.width();
+            height_ = field.height();
+            buildMaxPyramid(field, options.coarse_bits, levels_);
+        }
+
+        // points 为 base_footprint 系下的激光点，prior 为同一时刻的 map->base_footprint
+        // 得分低于 min_score 时返回 false，result 中仍是窗口内的最优位姿
+        bool match(const std::vector<Eigen::Vector2d> &points, const SE2 &prior, Result &result)
+        {
+            if (!ready() || points.empty())
+                return false;
+            prepare(points, prior);
+
+            // 粗层：每个角度、每块平移一个上界
+            const int B = 1 << options.coarse_bits;
+            const MaxLevel &coarse = levels_[options.coarse_bits];
+            coarse_.clear();
+            for (int a = 0; a < angles_; ++a)
+            {
+                const int *bx = &bx_[size_t(a) * points_];
+                const int *by = &by_[size_t(a) * points_];
+                for (int ty = -window_; ty <= window_; ty += B)
+                    for (int tx = -window_; tx <= window_; tx += B)
+                    {
+                        float sum = 0;
+                        for (int i = 0; i < points_; ++i)
+                            sum += coarse.at(bx[i] + tx, by[i] + ty);
+                        coarse_.push_back(Block{a, tx, ty, sum});
+                    }
+            }
+            std::sort(coarse_.begin(), coarse_.end());
+
+            // 细层：按上界从高到低展开，上界不超过当前最优时后面的块都不用看
+            float best = -1;
+            int best_a = 0, best_x = 0, best_y = 0;
+            acc_.resize(size_t(B) * B);
+            blocks_evaluated_ = 0;
+            for (const Block &b : coarse_)
+            {
+                if (b.bound <= best)
+                    break;
+                scoreBlock(b, B);
+                ++blocks_evaluated_;
+                for (int j = 0; j < B && b.ty + j <= window_; ++j)
+                    for (int i = 0; i < B && b.tx + i <= window_; ++i)
+                        if (acc_[j * B + i] > best)
+                        {
+                            best = acc_[j * B + i];
+                            best_a = b.a;
+                            best_x = b.tx + i;
+                            best_y = b.ty + j;
+                        }
+            }
+            refine(best_a, best_x, best_y, prior, result);
+            result.score = best / points_;
+            return result.score >= options.min_score;
+        }
+
+        // 上一次匹配中细层打分的块数，用于观察剪枝效果
+        int blocksEvaluated() const { return blocks_evaluated_; }
+        int angleCount() const { return angles_; }
+
+    private:
+        // 第 a 个角度下平移 [tx, tx+B) x [ty, ty+B) 的一块
+        struct Block
+        {
+            int a, tx, ty;
+            float bound;
+
+            bool operator<(const Block &b) const { return bound > b.bound; }
+        };
+
+        // 角度步长取最远点旋转一步移动一格；每个角度下各点在零平移时所在的格子预先算好
+        void prepare(const std::vector<Eigen::Vector2d> &points, const SE2 &prior)
+        {
+            double r = 0;
+            for (const Eigen::Vector2d &p : points)
+                r = std::max(r, p.norm());
+            r = std::min(std::max(r, resolution_), options.max_range);
+            angle_step_ = std::acos(std::max(-1.0, 1 - resolution_ * resolution_ / (2 * r * r)));
+            half_angles_ = int(std::ceil(options.window_yaw / angle_step_));
+            // 协方差邻域在边上多算两个角度
+            const int margin = 2;
+            angles_ = 2 * half_angles_ + 1;
+            window_ = std::max(1, int(std::ceil(options.window_xy / resolution_)));
+            points_ = int(points.size());
+            const int total = angles_ + 2 * margin;
+            bx_all_.resize(size_t(total) * points_);
+            by_all_.resize(size_t(total) * points_);
+            for (int a = 0; a < total; ++a)
+            {
+                SE2 rot(0, 0, prior.yaw() + (a - margin - half_angles_) * angle_step_);
+                for (int i = 0; i < points_; ++i)
+                {
+                    const Eigen::Vector2d &p = points[i];
+                    bx_all_[size_t(a) * points_ + i] = field_.cellX(prior.x + rot.c * p.x() - rot.s * p.y());
+                    by_all_[size_t(a) * points_ + i] = field_.cellY(prior.y + rot.s * p.x() + rot.c * p.y());
+                }
+            }
+            bx_ = bx_all_.data() + size_t(margin) * points_;
+            by_ = by_all_.data() + size_t(margin) * points_;
+        }
+
+        // 一块 B x B 个平移的细层得分写到 acc_，场地外的部分为 0
+        void scoreBlock(const Block &b, int B)
+        {
+            std::fill(acc_.begin(), acc_.end(), 0.0f);
+            const MaxLevel &fine = levels_[0];
+            const int *bx = &bx_[size_t(b.a) * points_];
+            const int *by = &by_[size_t(b.a) * points_];
+            for (int i = 0; i < points_; ++i)
+            {
+                int x0 = bx[i] + b.tx;
+                int lo = std::max(0, -x0), hi = std::min(B, width_ - x0);
+                if (lo >= hi)
+                    continue;
+                for (int j = 0; j < B; ++j)
+                {
+                    int y = by[i] + b.ty + j;
+                    if (y < 0 || y >= height_)
+                        continue;
+                    addRow(&acc_[j * B + lo], fine.row(y) + x0 + lo, hi - lo);
+                }
+            }
+        }
+
+        // 最优平移、角度附近按似然加权，得到亚格精度的位姿和协方差
+        void refine(int a, int tx, int ty, const SE2 &prior, Result &result) const
+        {
+            const double lz = std::log(options.z_rand);
+            const double scale = std::min(1.0, options.independent_points / points_);
+            auto logl = [&](int i, int j, int k)
+            {
+                const int *bx = &bx_[size_t(a + k) * points_];
+                const int *by = &by_[size_t(a + k) * points_];
+                double l = 0;
+                for (int p = 0; p < points_; ++p)
+                    l += std::log(options.z_rand + options.z_hit * field_.at(bx[p] + tx + i, by[p] + ty + j)) - lz;
+                return l * scale;
+            };
+            Eigen::Vector3d mean;
+            likelihoodMoments(logl, resolution_, angle_step_, mean, result.cov);
+            result.pose = SE2(prior.x + tx * resolution_ + mean(0), prior.y + ty * resolution_ + mean(1),
+                              wrapAngle(prior.yaw() + (a - half_angles_) * angle_step_ + mean(2)));
+        }
+
+        LikelihoodField field_;
+        std::vector<MaxLevel> levels_;
+        double resolution_;
+        int width_, height_;
+
+        // 单次匹配的工作区
+        int angles_ = 0, half_angles_ = 0, window_ = 0, points_ = 0;
+        double angle_step_ = 0;
+        std::vector<int> bx_all_, by_all_;
+        const int *bx_ = nullptr, *by_ = nullptr; // 指向 bx_all_ 中第 0 个搜索角度
+        std::vector<Block> coarse_;
+        std::vector<float> acc_;
+        int blocks_evaluated_;
+    };
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef __SE2_HPP
+#define __SE2_HPP
+
+#include <tf/tf.h>
+#include <geometry_msgs/Pose.h>
+#include <eigen3/Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+namespace estimation
+{
+    // 归一化到 [-pi, pi)，常数时间，输入再大（或是 inf/nan）也不会死循环
+    inline double wrapAngle(double a)
+    {
+        return a - 2 * M_PI * std::floor((a + M_PI) * (0.5 / M_PI));
+    }
+    // 与 ref 相差不超过 pi 的等价角，用于新息与插值
+    inline double nearestAngle(double a, double ref)
+    {
+        return ref + wrapAngle(a - ref);
+    }
+
+    // SE(2) 位姿：平移 + 单位复数 (c, s) 表示的旋转
+    // 复合、求逆、相对位姿都只有乘加，不经过 tf::Quaternion / getYaw / setRPY
+    // 只在进出 ROS 消息和 tf 时转换一次
+    struct SE2
+    {
+        double x, y, c, s;
+
+        SE2() : x(0), y(0), c(1), s(0) {}
+        SE2(double x_, double y_, double yaw) : x(x_), y(y_), c(std::cos(yaw)), s(std::sin(yaw)) {}
+        explicit SE2(const Eigen::Vector3d &v) : SE2(v(0), v(1), v(2)) {}
+
+        // 只取绕 z 轴的旋转：旋转矩阵第一列 (1 - 2(qy^2 + qz^2), 2(qx qy + qw qz)) 归一化
+        static SE2 fromQuaternion(double px, double py, double qx, double qy, double qz, double qw)
+        {
+            SE2 r;
+            r.x = px;
+            r.y = py;
+            double c = 1 - 2 * (qy * qy + qz * qz), s = 2 * (qx * qy + qw * qz);
+            double n = std::sqrt(c * c + s * s);
+            if (n > 0)
+            {
+                r.c = c / n;
+                r.s = s / n;
+            }
+            return r;
+        }
+        static SE2 fromTransform(const tf::Transform &t)
+        {
+            const tf::Vector3 &o = t.getOrigin();
+            tf::Quaternion q = t.getRotation();
+            return fromQuaternion(o.x(), o.y(), q.x(), q.y(), q.z(), q.w());
+        }
+        static SE2 fromPose(const geometry_msgs::Pose &p)
+        {
+            return fromQuaternion(p.position.x, p.position.y, p.orientation.x, p.orientation.y, p.orientation.z, p.orientation.w);
+        }
+
+        // 半角公式求四元数，qw 取非负
+        void quaternion(double &qz, double &qw) const
+        {
+            qw = std::sqrt(std::max(0.0, 0.5 * (1 + c)));
+            qz = std::copysign(std::sqrt(std::max(0.0, 0.5 * (1 - c))), s);
+        }
+        tf::Transform toTransform() const
+        {
+            double qz, qw;
+            quaternion(qz, qw);
+            return tf::Transform(tf::Quaternion(0, 0, qz, qw), tf::Vector3(x, y, 0));
+        }
+        void toPose(geometry_msgs::Pose &p) const
+        {
+            p.position.x = x;
+            p.position.y = y;
+            p.position.z = 0;
+            p.orientation.x = p.orientation.y = 0;
+            quaternion(p.orientation.z, p.orientation.w);
+        }
+
+        double yaw() const { return std::atan2(s, c); }
+        Eigen::Vector3d vec() const { return Eigen::Vector3d(x, y, yaw()); }
+
+        // 复合，顺手把旋转重新单位化（一阶），长时间累乘也不漂
+        SE2 operator*(const SE2 &b) const
+        {
+            SE2 r;
+            r.x = x + c * b.x - s * b.y;
+            r.y = y + s * b.x + c * b.y;
+            double rc = c * b.c - s * b.s, rs = s * b.c + c * b.s;
+            double k = 1.5 - 0.5 * (rc * rc + rs * rs);
+            r.c = rc * k;
+            r.s = rs * k;
+            return r;
+        }
+        SE2 inverse() const
+        {
+            SE2 r;
+            r.c = c;
+            r.s = -s;
+            r.x = -c * x - s * y;
+            r.y = s * x - c * y;
+            return r;
+        }
+        // this^-1 * b：b 在本位姿坐标系下的表示，即里程计增量
+        SE2 between(const SE2 &b) const
+        {
+            SE2 r;
+            double dx = b.x - x, dy = b.y - y;
+            r.x = c * dx + s * dy;
+            r.y = -s * dx + c * dy;
+            r.c = c * b.c + s * b.s;
+            r.s = c * b.s - s * b.c;
+            return r;
+        }
+    };
+
+    // 滤波状态 (x, y, yaw) 在 R^2 x SO(2) 上的 boxplus / boxminus
+    // 与现有预测、观测雅可比的参数化一致，航向始终保持在 [-pi, pi)
+    inline Eigen::Vector3d boxplus(const Eigen::Vector3d &x, const Eigen::Vector3d &d)
+    {
+        return Eigen::Vector3d(x(0) + d(0), x(1) + d(1), wrapAngle(x(2) + d(2)));
+    }
+    inline Eigen::Vector3d boxminus(const Eigen::Vector3d &a, const Eigen::Vector3d &b)
+    {
+        return Eigen::Vector3d(a(0) - b(0), a(1) - b(1), wrapAngle(a(2) - b(2)));
+    }
+    // SE2(a).between(SE2(b)) 对 a、b 的雅可比
+    inline void betweenJacobians(const Eigen::Vector3d &a, const Eigen::Vector3d &b, Eigen::Matrix3d &Ja, Eigen::Matrix3d &Jb)
+    {
+        double c = std::cos(a(2)), s = std::sin(a(2));
+        double dx = b(0) - a(0), dy = b(1) - a(1);
+        Ja << -c, -s, -s * dx + c * dy,
+            s, -c, -c * dx - s * dy,
+            0, 0, -1;
+        Jb << c, s, 0,
+            -s, c, 0,
+            0, 0, 1;
+    }
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __SEQLOCK_HPP
+#define __SEQLOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace estimation
+{
+    // 顺序锁：写者不会被读者阻塞，读者不加锁，读到写了一半的数据时重读
+    // 数据按 64 位字存成 atomic，避免非原子读写的数据竞争；T 必须可平凡拷贝
+    // 只支持单写者，多个写者之间需要调用者自行互斥
+    template <class T>
+    class SeqLock
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+        static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    public:
+        SeqLock() : seq_(0)
+        {
+            for (size_t i = 0; i < WORDS; ++i)
+                words_[i].store(0, std::memory_order_relaxed);
+        }
+        SeqLock(const SeqLock &) = delete;
+
+        void store(const T &v)
+        {
+            uint64_t buf[WORDS] = {};
+            memcpy(buf, &v, sizeof(T));
+            uint32_t s = seq_.load(std::memory_order_relaxed);
+            seq_.store(s + 1, std::memory_order_relaxed); // 奇数：正在写
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < WORDS; ++i)
+                words_[i].store(buf[i], std::memory_order_relaxed);
+            seq_.store(s + 2, std::memory_order_release);
+        }
+
+        T load() const
+        {
+            uint64_t buf[WORDS];
+            uint32_t s0, s1;
+            do
+            {
+                s0 = seq_.load(std::memory_order_acquire);
+                while (s0 & 1)
+                {
+                    std::this_thread::yield();
+                    s0 = seq_.load(std::memory_order_acquire);
+                }
+                for (size_t i = 0; i < WORDS; ++i)
+                    buf[i] = words_[i].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                s1 = seq_.load(std::memory_order_relaxed);
+            } while (s0 != s1);
+            T v;
+            memcpy(&v, buf, sizeof(T));
+            return v;
+        }
+
+        // 每次写入加 2，可用来判断数据是否更新过
+        uint32_t version() const { return seq_.load(std::memory_order_acquire); }
+
+    private:
+        std::atomic<uint32_t> seq_;
+        std::atomic<uint64_t> words_[WORDS];
+    };
+}
+
+#endif
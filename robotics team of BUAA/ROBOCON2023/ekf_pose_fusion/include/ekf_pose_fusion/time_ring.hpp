@@ -0,0 +1,89 @@
+#ifndef __TIME_RING_HPP
+#define __TIME_RING_HPP
+
+#include <vector>
+#include <cstddef>
+
+namespace estimation
+{
+    // 按时间戳有序的定容量环形缓冲，容量在构造时确定，满了之后覆盖最旧的元素
+    // T 需要有可比较的 stamp 成员；下标 0 为最旧，size()-1 为最新
+    template <class T>
+    class TimeRing
+    {
+    public:
+        explicit TimeRing(size_t capacity = 256) { reset(capacity); }
+
+        void reset(size_t capacity)
+        {
+            buf_.assign(capacity ? capacity : 1, T());
+            head_ = size_ = 0;
+        }
+
+        size_t size() const { return size_; }
+        size_t capacity() const { return buf_.size(); }
+        bool empty() const { return size_ == 0; }
+        void clear() { head_ = size_ = 0; }
+
+        T &operator[](size_t i) { return buf_[(head_ + i) % buf_.size()]; }
+        const T &operator[](size_t i) const { return buf_[(head_ + i) % buf_.size()]; }
+        T &front() { return (*this)[0]; }
+        T &back() { return (*this)[size_ - 1]; }
+
+        void push_back(const T &v)
+        {
+            if (size_ == buf_.size())
+                popFront();
+            buf_[(head_ + size_) % buf_.size()] = v;
+            ++size_;
+        }
+
+        // 插入到下标 pos 之前，之后的元素后移；满时先丢弃最旧的一个
+        // 返回插入后元素的下标
+        size_t insert(size_t pos, const T &v)
+        {
+            if (size_ == buf_.size())
+            {
+                if (pos == 0)
+                    return size_; // 比缓冲中所有元素都旧，直接丢弃
+                popFront();
+                --pos;
+            }
+            for (size_t i = size_; i > pos; --i)
+                buf_[(head_ + i) % buf_.size()] = buf_[(head_ + i - 1) % buf_.size()];
+            buf_[(head_ + pos) % buf_.size()] = v;
+            ++size_;
+            return pos;
+        }
+
+        void popFront()
+        {
+            if (size_ == 0)
+                return;
+            head_ = (head_ + 1) % buf_.size();
+            --size_;
+        }
+
+        // 第一个 stamp > t 的下标，没有则返回 size()
+        template <class Stamp>
+        size_t upperBound(const Stamp &t) const
+        {
+            size_t lo = 0, hi = size_;
+            while (lo < hi)
+            {
+                size_t mid = (lo + hi) / 2;
+                if (t < (*this)[mid].stamp)
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            return lo;
+        }
+
+    private:
+        std::vector<T> buf_;
+        size_t head_, size_;
+    };
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef __WORKER_POOL_HPP
+#define __WORKER_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace uncertain_tf
+{
+    // 常驻的工作线程，按块并行执行 [0, n)：每次调用不再创建、回收线程
+    // 调用线程也参与计算；同一时刻只执行一批，并发的调用排队；在工作线程里再次调用时直接串行执行
+    // 任一块抛出的异常在整批结束后由调用线程重新抛出，不会在工作线程里 terminate
+    class WorkerPool
+    {
+    public:
+        typedef std::function<void(size_t, size_t)> Task;
+
+        // threads 为参与计算的总线程数（含调用线程）
+        explicit WorkerPool(unsigned int threads) : stop_(false), generation_(0)
+        {
+            for (unsigned int i = 1; i < threads; ++i)
+                workers_.emplace_back(&WorkerPool::loop, this);
+        }
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            cond_.notify_all();
+            for (size_t i = 0; i < workers_.size(); ++i)
+                workers_[i].join();
+        }
+
+        WorkerPool(const WorkerPool &) = delete;
+
+        unsigned int size() const { return workers_.size() + 1; }
+
+        // 分成 chunks 块执行 f(begin, end)，全部完成后返回
+        void run(size_t n, size_t chunks, const Task &f)
+        {
+            if (n == 0)
+                return;
+            chunks = std::max<size_t>(1, std::min(chunks, n));
+            if (workers_.empty() || chunks == 1 || insidePool())
+            {
+                f(0, n);
+                return;
+            }
+            std::lock_guard<std::mutex> run_lock(run_mutex_);
+            std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+            batch->f = &f;
+            batch->n = n;
+            batch->chunk = (n + chunks - 1) / chunks;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                batch_ = batch;
+                ++generation_;
+            }
+            cond_.notify_all();
+            work(*batch);
+            {
+                std::unique_lock<std::mutex> lock(batch->mutex);
+                batch->cond.wait(lock, [&] { return batch->done == batch->n; });
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                batch_.reset();
+            }
+            if (batch->error)
+                std::rethrow_exception(batch->error);
+        }
+
+    private:
+        // 每批独立的状态：迟到的线程拿到的是已领完的旧批次，不会碰到新一批
+        struct Batch
+        {
+            const Task *f = nullptr;
+            size_t n = 0, chunk = 1;
+            std::atomic<size_t> next{0}, done{0};
+            std::mutex mutex;
+            std::condition_variable cond;
+            std::exception_ptr error;
+        };
+
+        static bool &insidePool()
+        {
+            thread_local bool inside = false;
+            return inside;
+        }
+
+        static void work(Batch &b)
+        {
+            bool &inside = insidePool();
+            bool was_inside = inside;
+            inside = true;
+            while (true)
+            {
+                size_t begin = b.next.fetch_add(b.chunk);
+                if (begin >= b.n)
+                    break;
+                size_t end = std::min(b.n, begin + b.chunk);
+                try
+                {
+                    (*b.f)(begin, end);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(b.mutex);
+                    if (!b.error)
+                        b.error = std::current_exception();
+                }
+                if (b.done.fetch_add(end - begin) + (end - begin) == b.n)
+                {
+                    std::lock_guard<std::mutex> lock(b.mutex);
+                    b.cond.notify_all();
+                }
+            }
+            inside = was_inside;
+        }
+
+        void loop()
+        {
+            uint64_t seen = 0;
+            while (true)
+            {
+                std::shared_ptr<Batch> batch;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cond_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                    if (stop_)
+                        return;
+                    seen = generation_;
+                    batch = batch_;
+                }
+                if (batch)
+                    work(*batch);
+            }
+        }
+
+        std::vector<std::thread> workers_;
+        std::mutex run_mutex_; // 一次只执行一批
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::shared_ptr<Batch> batch_;
+        bool stop_;
+        uint64_t generation_;
+    };
+}
+
+#endif
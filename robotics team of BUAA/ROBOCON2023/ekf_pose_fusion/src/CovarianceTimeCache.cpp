@@ -7,20 +7,17 @@ using namespace tf;
 using namespace uncertain_tf;
 using namespace std;
 
-CovarianceStorage::CovarianceStorage(const MatrixXd &data, ros::Time stamp, CompactFrameID frame_id, CompactFrameID child_frame_id)
-    : covariance_(data), stamp_(stamp), frame_id_(frame_id), child_frame_id_(child_frame_id_)
+template <int N>
+CovarianceTimeCacheT<N>::CovarianceTimeCacheT(ros::Duration max_storage_time, size_t capacity)
+    : max_storage_time_(max_storage_time), ring_(capacity ? capacity : 1), head_(0), size_(0)
 {
 }
 
-CovarianceTimeCache::CovarianceTimeCache(ros::Duration max_storage_time)
-    : max_storage_time_(max_storage_time)
+template <int N>
+bool CovarianceTimeCacheT<N>::getData(ros::Time time, Storage &data_out, std::string *error_str)
 {
-}
-
-bool CovarianceTimeCache::getData(ros::Time time, CovarianceStorage &data_out, std::string *error_str)
-{
-    const CovarianceStorage *p_temp_1 = NULL;
-    const CovarianceStorage *p_temp_2 = NULL;
+    const Storage *p_temp_1 = NULL;
+    const Storage *p_temp_2 = NULL;
 
     int num_nodes = findClosest(p_temp_1, p_temp_2, time, error_str);
     if (num_nodes == 0)
@@ -33,15 +30,7 @@ bool CovarianceTimeCache::getData(ros::Time time, CovarianceStorage &data_out, s
     }
     else if (num_nodes == 2)
     {
-        // if( p_temp_1->frame_id_ == p_temp_2->frame_id_)
-        //{
-        // TODO 协方差的插值
         interpolate(*p_temp_1, *p_temp_2, time, data_out);
-        //}
-        // else
-        //{
-        //    data_out = *p_temp_1;
-        //}
     }
     else
     {
@@ -53,68 +42,77 @@ bool CovarianceTimeCache::getData(ros::Time time, CovarianceStorage &data_out, s
     return true;
 }
 
-bool CovarianceTimeCache::insertData(const CovarianceStorage &new_data)
+template <int N>
+size_t CovarianceTimeCacheT<N>::lowerBound(const ros::Time &time) const
 {
-    // std::cout << "insertData new_data.stamp_ " << new_data.stamp_ << endl;
-    auto storage_it = storage_.begin();
-
-    if (storage_it != storage_.end())
+    size_t lo = 0, hi = size_;
+    while (lo < hi)
     {
-        if (storage_it->stamp_ > new_data.stamp_ + max_storage_time_)
-            return false;
+        size_t mid = (lo + hi) / 2;
+        if (at(mid).stamp_ < time)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return lo;
+}
 
-    // 从begin->end，时间依次逐渐变小，即时间最新的在begin
-    while (storage_it != storage_.end())
-    {
-        if (storage_it->stamp_ <= new_data.stamp_)
-            break;
-        storage_it++;
-    }
+template <int N>
+bool CovarianceTimeCacheT<N>::insertData(const Storage &new_data)
+{
+    if (size_ && getLatestTimestamp() > new_data.stamp_ + max_storage_time_)
+        return false;
 
+    size_t pos = lowerBound(new_data.stamp_);
     // 找到一帧和输入data时间戳相同的，报告重复
-    if (storage_it != storage_.end() && storage_it->stamp_ == new_data.stamp_)
-    {
-
+    if (pos < size_ && at(pos).stamp_ == new_data.stamp_)
         return false;
-    }
-    else
+
+    if (size_ == ring_.size())
     {
-        storage_.insert(storage_it, new_data);
+        // 已满：比所有数据都旧的直接丢弃，否则挤掉最旧的一帧
+        if (pos == 0)
+            return false;
+        head_ = (head_ + 1) % ring_.size();
+        --size_;
+        --pos;
     }
-
-    std::cout << "storage size " << storage_.size() << endl;
+    // 通常是按时间顺序追加，pos == size_，不需要搬移
+    for (size_t i = size_; i > pos; --i)
+        at(i) = at(i - 1);
+    at(pos) = new_data;
+    ++size_;
 
     pruneList();
     return true;
 }
 
-void CovarianceTimeCache::clearList()
+template <int N>
+void CovarianceTimeCacheT<N>::clearList()
 {
-    storage_.clear();
+    head_ = size_ = 0;
 }
 
-uint8_t CovarianceTimeCache::findClosest(const CovarianceStorage *&one, const CovarianceStorage *&two, ros::Time target_time, std::string *error_str)
+template <int N>
+uint8_t CovarianceTimeCacheT<N>::findClosest(const Storage *&one, const Storage *&two, ros::Time target_time, std::string *error_str)
 {
     // No values stored
-    if (storage_.empty())
+    if (size_ == 0)
     {
-        // createEmptyException(error_str);
         return 0;
     }
 
     // If time == 0 return the latest
     if (target_time.isZero())
     {
-        one = &storage_.front();
+        one = &at(size_ - 1);
         return 1;
     }
 
     // One value stored
-    if (++storage_.begin() == storage_.end())
+    if (size_ == 1)
     {
-        // CovarianceStorage& ts = *storage_.begin();
-        const CovarianceStorage &ts = *storage_.begin();
+        const Storage &ts = at(0);
         if (ts.stamp_ == target_time)
         {
             one = &ts;
@@ -122,70 +120,70 @@ uint8_t CovarianceTimeCache::findClosest(const CovarianceStorage *&one, const Co
         }
         else
         {
-            // createExtrapolationException1(target_time, ts.stamp_, error_str);
             return 0;
         }
     }
 
-    ros::Time latest_time = (*storage_.begin()).stamp_;
-    ros::Time earliest_time = (*(storage_.rbegin())).stamp_;
+    ros::Time latest_time = getLatestTimestamp();
+    ros::Time earliest_time = getOldestTimestamp();
 
-    if (target_time == latest_time)
-    {
-        one = &(*storage_.begin());
-        return 1;
-    }
-    else if (target_time == earliest_time)
-    {
-        one = &(*storage_.rbegin());
-        return 1;
-    }
     // Catch cases that would require extrapolation
-    else if (target_time > latest_time)
+    if (target_time > latest_time)
     {
-        // createExtrapolationException2(target_time, latest_time, error_str);
         ROS_ERROR_STREAM("tar: " << target_time << "  latest: " << latest_time << endl);
         ROS_ERROR("EXTRAPOLATION TO FUTURE REQ");
         return 0;
     }
     else if (target_time < earliest_time)
     {
-        // createExtrapolationException3(target_time, earliest_time, error_str);
         ROS_ERROR("EXTRAPOLATION TO PAST REQ");
         ROS_ERROR_STREAM(target_time << ", " << earliest_time);
         return 0;
     }
 
-    // Create a temporary object to compare to when searching the lower bound via std::set
-    CovarianceStorage tmp;
-    tmp.stamp_ = target_time;
-
-    // Find the first value equal or higher than the target value
-    L_CovarianceStorage::iterator storage_it =
-        std::lower_bound(
-            storage_.begin(),
-            storage_.end(),
-            tmp, std::greater<CovarianceStorage>());
+    size_t pos = lowerBound(target_time);
+    if (at(pos).stamp_ == target_time)
+    {
+        one = &at(pos);
+        return 1;
+    }
 
     // Finally the case were somewhere in the middle  Guarenteed no extrapolation :-)
-    two = &*(storage_it);   // Older
-    one = &*(--storage_it); // Newer
+    one = &at(pos);     // Newer
+    two = &at(pos - 1); // Older
 
     return 2;
 }
 
-void CovarianceTimeCache::interpolate(const CovarianceStorage &one, const CovarianceStorage &two, ros::Time time, CovarianceStorage &output)
+template <int N>
+void CovarianceTimeCacheT<N>::interpolate(const Storage &one, const Storage &two, ros::Time time, Storage &output)
 {
-    output = two; // TODO
+    // one 较新，two 较旧
+    output = one;
+    output.stamp_ = time;
+    if ((one.stamp_ - two.stamp_).toNSec() < MIN_INTERPOLATION_DISTANCE)
+        return;
+    double ratio = (time - two.stamp_).toSec() / (one.stamp_ - two.stamp_).toSec();
+    // 正定矩阵的凸组合仍是正定的，线性插值即可保持正定，不需要分解
+    output.covariance_ = (1.0 - ratio) * two.covariance_ + ratio * one.covariance_;
+    output.covariance_ = 0.5 * (output.covariance_ + output.covariance_.transpose());
 }
 
 // 用于维护修剪时间序列，删除超过最大储存时间的内容
-void CovarianceTimeCache::pruneList()
+template <int N>
+void CovarianceTimeCacheT<N>::pruneList()
 {
-    ros::Time latest_time = storage_.begin()->stamp_;
+    ros::Time latest_time = getLatestTimestamp();
 
-    while (!storage_.empty() && storage_.back().stamp_ + max_storage_time_ < latest_time)
+    while (size_ && at(0).stamp_ + max_storage_time_ < latest_time)
     {
-        storage_.pop_back();
+        head_ = (head_ + 1) % ring_.size();
+        --size_;
     }
 }
+
+namespace uncertain_tf
+{
+    template class CovarianceTimeCacheT<3>;
+    template class CovarianceTimeCacheT<6>;
+}
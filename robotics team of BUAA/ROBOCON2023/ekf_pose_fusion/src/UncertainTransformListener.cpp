@@ -1,4 +1,6 @@
 #include "ekf_pose_fusion/UncertainTransformListener.h"
+#include <atomic>
+#include <thread>
 
 using namespace Eigen;
 using namespace tf;
@@ -10,15 +12,38 @@ namespace uncertain_tf
 {
 
     UncertainTransformListener::UncertainTransformListener(ros::Duration max_cache_time, bool spin_thread)
+        : num_threads_(0), ut_alpha_(1.0), ut_beta_(2.0), ut_kappa_(0.0)
     {
         message_subscriber_utf_ = node_.subscribe<ekf_pose_fusion::utfMessage>("/tf_uncertainty", 100, boost::bind(&UncertainTransformListener::subscription_callback, this, _1));
         ROS_INFO("SUBSCRIBER SET UP");
-        VectorXd m(6);
-        MatrixXd c(6, 6);
-        emn_ = new EigenMultivariateNormal<double, 6>(m, c);
         univ_ = new UnivariateNormal<double>(1, 0);
     }
 
+    BatchNormalSampler<6> &UncertainTransformListener::threadSampler()
+    {
+        static std::atomic<uint64_t> seed_counter(1);
+        thread_local BatchNormalSampler<6> sampler(seed_counter.fetch_add(1) * 0x9E3779B97F4A7C15ULL);
+        return sampler;
+    }
+
+    void UncertainTransformListener::parallelFor(size_t n, const WorkerPool::Task &f)
+    {
+        unsigned int threads = num_threads_ ? num_threads_ : std::thread::hardware_concurrency();
+        if (threads < 2 || n < PARALLEL_MIN_SAMPLES)
+        {
+            f(size_t(0), n);
+            return;
+        }
+        WorkerPool *pool;
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            if (!pool_ || pool_->size() != threads)
+                pool_.reset(new WorkerPool(threads));
+            pool = pool_.get();
+        }
+        pool->run(n, threads, f);
+    }
+
     VectorXd UncertainTransformListener::calculateSampleMean(const MatrixXd &x)
     {
         return x.colwise().sum() / x.rows();
@@ -33,7 +58,7 @@ namespace uncertain_tf
         return true;
     }
 
-    MatrixXd UncertainTransformListener::sampleSetTFtoMatrixXd(std::vector<tf::StampedTransform> sampleset)
+    MatrixXd UncertainTransformListener::sampleSetTFtoMatrixXd(const std::vector<tf::StampedTransform> &sampleset)
     {
         MatrixXd ret(sampleset.size(), 6);
         for (size_t n = 0; n < sampleset.size(); ++n)
@@ -48,19 +73,9 @@ namespace uncertain_tf
     {
         // cout << "SAMPLING" << endl << endl << "Mean" << endl << mean_ << endl << "Cov" << endl << cov_ << endl;
 
-        // EigenMultivariateNormal<double, 6> emn(mean_.transpose(),cov_);
-        emn_->setMean(mean_.transpose());
-        emn_->setCovar(cov_);
-
-        Matrix<double, 6, 1> nextSample;
-        MatrixXd ret(mean_.rows(), n);
-
-        for (size_t i = 0; i < n; ++i)
-        {
-            emn_->nextSample(nextSample);
-            ret.col(i) = nextSample;
-        }
-
+        // 因子按协方差缓存，n 个样本一次矩阵乘法
+        BatchNormalSampler<6>::Samples ret;
+        threadSampler().sample(mean_, cov_, n, ret);
         return ret;
     }
 
@@ -68,8 +83,12 @@ namespace uncertain_tf
     {
         VectorXd mean_ = transformTFToVectorXd(mean);
         MatrixXd samples = sampleFromMeanCov(mean_, cov, n);
-        for (int i = 0; i < samples.cols(); i++)
-            output.push_back(transformVectorXdToTF(samples.col(i).transpose()));
+        size_t base = output.size();
+        output.resize(base + samples.cols());
+        parallelFor(samples.cols(), [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; i++)
+                output[base + i] = transformVectorXdToTF(samples.col(i));
+        });
     }
 
     tf::Transform UncertainTransformListener::sampleFromMeanCov(const tf::Transform &mean, const MatrixXd &cov)
@@ -120,22 +139,17 @@ namespace uncertain_tf
                   << " (" << rel.getRotation().x() << " , " << rel.getRotation().y() << " , " << rel.getRotation().z() << " , " << rel.getRotation().w() << ")" << endl;
     }
 
-    void UncertainTransformListener::sampleTransform(const std::string &target_frame, const std::string &source_frame,
-                                                     const ros::Time &time, std::vector<StampedTransform> &output, size_t n)
+    bool UncertainTransformListener::lookupChain(const std::string &target_frame, const std::string &source_frame,
+                                                 const ros::Time &time, StampedTransform &mean, std::vector<ChainLink> &chain)
     {
-        // ROS_INFO("START SAMPLING");
-
-        ros::Time start = ros::Time::now();
-
-        StampedTransform mean;
         try
         {
             ((const tf::TransformListener *)this)->lookupTransform(target_frame, source_frame, time, mean);
         }
         catch (tf::TransformException ex)
         {
-            ROS_ERROR("UncertainTransformListener::sampleTransform caught exception: %s", ex.what());
-            return;
+            ROS_ERROR("UncertainTransformListener::lookupChain caught exception: %s", ex.what());
+            return false;
         }
 
         std::list<std::string> source_parents;
@@ -179,92 +193,107 @@ namespace uncertain_tf
 
         // source -> common parent
 
-        std::string last_frame_init = source_parents.front();
+        std::string last_frame = source_parents.front();
 
         source_parents.pop_front();
         target_parents.pop_back();
 
-        std::vector<std::vector<tf::Transform>> chain_sampled_transforms;
-
-        std::string last_frame = last_frame_init;
-
-        // std::cout << "Sample" << k << last_frame << endl;
-
-        // tf::Transform acc;
-        // acc.setOrigin(tf::Vector3(0,0,0));
-        // acc.setRotation(tf::Quaternion(0,0,0,1));
-
-        tf::Transform zeroMean;
-        zeroMean.setOrigin(tf::Vector3(0, 0, 0));
-        zeroMean.setRotation(tf::Quaternion(0, 0, 0, 1));
-
         for (std::list<std::string>::iterator it = source_parents.begin(); it != source_parents.end(); ++it)
         {
             const std::string &current_frame = *it;
 
+            ChainLink link;
             StampedTransform rel;
             ((const tf::TransformListener *)this)->lookupTransform(current_frame, last_frame, time, rel);
+            link.rel = rel;
+            link.inverse = false;
 
-            CovarianceStorage cs;
+            CovarianceStorage6 cs;
             // REMIND 重要语句
-            getCovariance(lookupOrInsertFrameNumber(last_frame))->getData(time, cs);
+            {
+                boost::recursive_mutex::scoped_lock lock(cov_mutex_);
+                getCovariance(lookupOrInsertFrameNumber(last_frame))->getData(time, cs);
+            }
+            link.cov = cs.covariance_;
+            link.certain = isZero(link.cov);
+            chain.push_back(link);
 
             last_frame = current_frame;
-
-            std::vector<tf::Transform> samples;
-            chain_sampled_transforms.push_back(samples);
-
-            if (isZero(cs.covariance_))
-                chain_sampled_transforms.back().push_back(zeroMean);
-            else
-                sampleFromMeanCov(zeroMean, cs.covariance_, chain_sampled_transforms.back(), n);
-
-            for (std::vector<tf::Transform>::iterator jt = chain_sampled_transforms.back().begin(); jt != chain_sampled_transforms.back().end(); ++jt)
-                *jt = rel * (*jt);
         }
 
         // common parent -> target
         for (std::list<std::string>::reverse_iterator it = target_parents.rbegin(); it != target_parents.rend(); ++it)
         {
             const std::string &current_frame = *it;
+
+            ChainLink link;
             StampedTransform rel;
             ((const tf::TransformListener *)this)->lookupTransform(last_frame, current_frame, time, rel); // lookup inverse frame, where we can sample and then invert again
+            link.rel = rel;
+            link.inverse = true; // when walking down, we invert the transforms
 
-            CovarianceStorage cs;
-            getCovariance(lookupOrInsertFrameNumber(current_frame))->getData(time, cs);
+            CovarianceStorage6 cs;
+            {
+                boost::recursive_mutex::scoped_lock lock(cov_mutex_);
+                getCovariance(lookupOrInsertFrameNumber(current_frame))->getData(time, cs);
+            }
+            link.cov = cs.covariance_;
+            link.certain = isZero(link.cov);
+            chain.push_back(link);
 
             last_frame = current_frame;
-            std::vector<tf::Transform> samples;
-            chain_sampled_transforms.push_back(samples);
+        }
+        return true;
+    }
 
-            if (isZero(cs.covariance_))
-                chain_sampled_transforms.back().push_back(zeroMean);
-            else
-                sampleFromMeanCov(zeroMean, cs.covariance_, chain_sampled_transforms.back(), n);
+    void UncertainTransformListener::sampleTransform(const std::string &target_frame, const std::string &source_frame,
+                                                     const ros::Time &time, std::vector<StampedTransform> &output, size_t n)
+    {
+        // ROS_INFO("START SAMPLING");
 
-            for (std::vector<tf::Transform>::iterator jt = chain_sampled_transforms.back().begin(); jt != chain_sampled_transforms.back().end(); ++jt)
-                *jt = (rel * (*jt)).inverse(); // when walking down, we invert the transforms
+        ros::Time start = ros::Time::now();
 
-            last_frame = current_frame;
-        }
+        StampedTransform mean;
+        std::vector<ChainLink> chain;
+        if (!lookupChain(target_frame, source_frame, time, mean, chain))
+            return;
+
+        tf::Transform zeroMean;
+        zeroMean.setOrigin(tf::Vector3(0, 0, 0));
+        zeroMean.setRotation(tf::Quaternion(0, 0, 0, 1));
 
-        for (unsigned int smp = 0; smp < n; ++smp)
+        std::vector<std::vector<tf::Transform>> chain_sampled_transforms(chain.size());
+        for (size_t c = 0; c < chain.size(); ++c)
         {
+            if (chain[c].certain)
+                chain_sampled_transforms[c].push_back(zeroMean);
+            else
+                sampleFromMeanCov(zeroMean, chain[c].cov, chain_sampled_transforms[c], n);
 
-            tf::Transform acc;
-            acc.setOrigin(tf::Vector3(0, 0, 0));
-            acc.setRotation(tf::Quaternion(0, 0, 0, 1));
+            for (std::vector<tf::Transform>::iterator jt = chain_sampled_transforms[c].begin(); jt != chain_sampled_transforms[c].end(); ++jt)
+                *jt = chain[c].inverse ? (chain[c].rel * (*jt)).inverse() : chain[c].rel * (*jt);
+        }
 
-            for (unsigned int chain = 0; chain < chain_sampled_transforms.size(); ++chain)
+        // 各样本沿链相乘互不相关，分块并行
+        size_t base = output.size();
+        output.resize(base + n, mean);
+        parallelFor(n, [&](size_t b, size_t e) {
+            for (size_t smp = b; smp < e; ++smp)
             {
-                if (chain_sampled_transforms[chain].size() == 1)
-                    acc = chain_sampled_transforms[chain][0] * acc;
-                else
-                    acc = chain_sampled_transforms[chain][smp] * acc;
+                tf::Transform acc;
+                acc.setOrigin(tf::Vector3(0, 0, 0));
+                acc.setRotation(tf::Quaternion(0, 0, 0, 1));
+
+                for (unsigned int chain = 0; chain < chain_sampled_transforms.size(); ++chain)
+                {
+                    if (chain_sampled_transforms[chain].size() == 1)
+                        acc = chain_sampled_transforms[chain][0] * acc;
+                    else
+                        acc = chain_sampled_transforms[chain][smp] * acc;
+                }
+                output[base + smp].setData(acc);
             }
-            mean.setData(acc);
-            output.push_back(mean);
-        }
+        });
 
         // ROS_INFO("DONE SAMPLING %f", (ros::Time::now() - start).toSec());
     }
@@ -304,38 +333,173 @@ namespace uncertain_tf
         // UnivariateNormal<double> univ(time_mean.toSec(),time_variance.toSec());
         univ_->setMean(time_mean.toSec());
         univ_->setVar(time_variance.toSec());
+        std::vector<double> times(n);
         for (size_t k = 0; k < n; k++)
+            univ_->nextSample(times[k]);
+        sampleAtTimes(target_frame, source_frame, times, output);
+    }
+
+    void UncertainTransformListener::sampleTransformUniformTime(const std::string &target_frame, const std::string &source_frame,
+                                                                const ros::Time &time_start, const ros::Time &time_end, std::vector<StampedTransform> &output, size_t n)
+    {
+        double time_step = (time_end - time_start).toSec() / n;
+        std::vector<double> times(n);
+        for (size_t k = 0; k < n; k++)
+            times[k] = time_start.toSec() + k * time_step;
+        sampleAtTimes(target_frame, source_frame, times, output);
+    }
+
+    tf::Transform UncertainTransformListener::composeChain(const std::vector<ChainLink> &chain, size_t link, const VectorXd &delta)
+    {
+        tf::Transform acc;
+        acc.setIdentity();
+        for (size_t c = 0; c < chain.size(); ++c)
         {
-            double act_time;
-            univ_->nextSample(act_time);
-            try
+            tf::Transform t = chain[c].rel;
+            if (c == link)
+                t = t * transformVectorXdToTF(delta);
+            acc = (chain[c].inverse ? t.inverse() : t) * acc;
+        }
+        return acc;
+    }
+
+    tf::Transform UncertainTransformListener::sampleChain(const std::vector<ChainLink> &chain)
+    {
+        BatchNormalSampler<6> &sampler = threadSampler();
+        BatchNormalSampler<6>::Samples delta;
+        tf::Transform acc;
+        acc.setIdentity();
+        for (size_t c = 0; c < chain.size(); ++c)
+        {
+            tf::Transform t = chain[c].rel;
+            if (!chain[c].certain)
             {
-                UncertainTransformListener::sampleTransform(target_frame, source_frame, ros::Time(act_time), output, 1);
+                sampler.sample(BatchNormalSampler<6>::Vector::Zero(), chain[c].cov, 1, delta);
+                t = t * transformVectorXdToTF(delta.col(0));
             }
-            catch (tf::TransformException ex)
+            acc = (chain[c].inverse ? t.inverse() : t) * acc;
+        }
+        return acc;
+    }
+
+    bool UncertainTransformListener::unscentedTransform(const std::vector<ChainLink> &chain, tf::Transform &mean, MatrixXd &cov)
+    {
+        // 只有带协方差的环节进入联合噪声，各环节独立，联合协方差的平方根是分块对角的
+        std::vector<size_t> uncertain;
+        for (size_t c = 0; c < chain.size(); ++c)
+            if (!chain[c].certain)
+                uncertain.push_back(c);
+
+        VectorXd zero = VectorXd::Zero(6);
+        mean = composeChain(chain, chain.size(), zero);
+        cov = MatrixXd::Zero(6, 6);
+        if (uncertain.empty())
+            return true;
+
+        const double L = 6.0 * uncertain.size();
+        const double lambda = ut_alpha_ * ut_alpha_ * (L + ut_kappa_) - L;
+        const double scale = sqrt(L + lambda);
+        const double wm0 = lambda / (L + lambda);
+        const double wc0 = wm0 + (1 - ut_alpha_ * ut_alpha_ + ut_beta_);
+        const double wi = 0.5 / (L + lambda);
+
+        // 每个 sigma 点只扰动一个环节：分块对角平方根的第 k 列只在所属环节上非零
+        size_t m = 2 * size_t(L) + 1;
+        MatrixXd ys(6, m);
+        ys.col(0) = transformTFToVectorXd(mean);
+        for (size_t u = 0; u < uncertain.size(); ++u)
+        {
+            const BatchNormalSampler<6>::Matrix &S = threadSampler().factor(chain[uncertain[u]].cov);
+            for (int k = 0; k < 6; ++k)
             {
-                // ROS_ERROR("s f %s",ex.what());
+                size_t j = 1 + 2 * (6 * u + k);
+                ys.col(j) = transformTFToVectorXd(composeChain(chain, uncertain[u], scale * S.col(k)));
+                ys.col(j + 1) = transformTFToVectorXd(composeChain(chain, uncertain[u], -scale * S.col(k)));
             }
         }
+        // 角度相对中心点展开，避免跨 ±pi 时平均出错
+        for (size_t j = 1; j < m; ++j)
+            for (int a = 3; a < 6; ++a)
+                ys(a, j) = ys(a, 0) + atan2(sin(ys(a, j) - ys(a, 0)), cos(ys(a, j) - ys(a, 0)));
+
+        VectorXd y = wm0 * ys.col(0);
+        for (size_t j = 1; j < m; ++j)
+            y += wi * ys.col(j);
+        VectorXd d = ys.col(0) - y;
+        cov = wc0 * d * d.transpose();
+        for (size_t j = 1; j < m; ++j)
+        {
+            d = ys.col(j) - y;
+            cov += wi * d * d.transpose();
+        }
+        mean = transformVectorXdToTF(y);
+        return true;
     }
 
-    void UncertainTransformListener::sampleTransformUniformTime(const std::string &target_frame, const std::string &source_frame,
-                                                                const ros::Time &time_start, const ros::Time &time_end, std::vector<StampedTransform> &output, size_t n)
+    bool UncertainTransformListener::unscentedTransform(const std::string &target_frame, const std::string &source_frame,
+                                                        const ros::Time &time, StampedTransform &mean, MatrixXd &cov)
     {
-        double time_step = (time_end - time_start).toSec() / n;
-        double act_time = time_start.toSec();
-        for (size_t k = 0; k < n; k++)
+        std::vector<ChainLink> chain;
+        if (!lookupChain(target_frame, source_frame, time, mean, chain))
+            return false;
+        tf::Transform m;
+        unscentedTransform(chain, m, cov);
+        mean.setData(m);
+        return true;
+    }
+
+    bool UncertainTransformListener::unscentedTransform(const std::string &target_frame, const ros::Time &target_time,
+                                                        const std::string &source_frame, const ros::Time &source_time,
+                                                        const std::string &fixed_frame, StampedTransform &mean, MatrixXd &cov)
+    {
+        // 两段链首尾相接：source -> fixed（source_time），fixed -> target（target_time）
+        std::vector<ChainLink> chain, target_chain;
+        StampedTransform fixed_to_source;
+        if (!lookupChain(fixed_frame, source_frame, source_time, fixed_to_source, chain) ||
+            !lookupChain(target_frame, fixed_frame, target_time, mean, target_chain))
+            return false;
+        chain.insert(chain.end(), target_chain.begin(), target_chain.end());
+        tf::Transform m;
+        unscentedTransform(chain, m, cov);
+        mean.setData(m);
+        mean.frame_id_ = target_frame;
+        mean.child_frame_id_ = source_frame;
+        return true;
+    }
+
+    void UncertainTransformListener::sampleAtTimes(const std::string &target_frame, const std::string &source_frame,
+                                                   const std::vector<double> &times, std::vector<StampedTransform> &output)
+    {
+        // 查链要读 tf 缓存和协方差缓存，在调用线程里逐个做完，查询失败的时刻跳过
+        // 工作线程只拿查好的链采样相乘，不再碰共享的缓存
+        std::vector<StampedTransform> means;
+        std::vector<std::vector<ChainLink>> chains;
+        means.reserve(times.size());
+        chains.reserve(times.size());
+        for (size_t k = 0; k < times.size(); k++)
         {
+            StampedTransform mean;
+            std::vector<ChainLink> chain;
             try
             {
-                UncertainTransformListener::sampleTransform(target_frame, source_frame, ros::Time(act_time), output, 1);
+                if (!lookupChain(target_frame, source_frame, ros::Time(times[k]), mean, chain))
+                    continue;
             }
             catch (tf::TransformException ex)
             {
-                //
+                // ROS_ERROR("s f %s",ex.what());
+                continue;
             }
-            act_time += time_step;
+            means.push_back(mean);
+            chains.push_back(std::move(chain));
         }
+
+        size_t base = output.size();
+        output.insert(output.end(), means.begin(), means.end());
+        parallelFor(chains.size(), [&](size_t b, size_t e) {
+            for (size_t k = b; k < e; k++)
+                output[base + k].setData(sampleChain(chains[k]));
+        });
     }
 
 } // namespace uncertain_tf
@@ -11,12 +11,14 @@ using namespace std;
 namespace uncertain_tf
 {
 
-    CovarianceTimeCache *UncertainTransformer::getCovariance(unsigned int frame_id)
+    CovarianceTimeCache6 *UncertainTransformer::getCovariance(unsigned int frame_id)
     {
         if (frame_id == 0) /// @todo check larger values too
             return NULL;
         else
         {
+            // 回调线程插入、采样线程查询，扩容和新建缓存都要在锁内
+            boost::recursive_mutex::scoped_lock lock(cov_mutex_);
             while (frame_id >= covariances_.size())
                 covariances_.push_back(NULL); // thats a hack
 
@@ -24,17 +26,15 @@ namespace uncertain_tf
             if (covariances_[frame_id] == NULL)
             {
                 // std::cout << "creating new CovarianceTimeCache for id " << frame_id << endl;
-                covariances_[frame_id] = new CovarianceTimeCache(ros::Duration(10)); //! TODO : set actual max storage time
-                MatrixXd cov(6, 6);
-                cov.setZero();
-                covariances_[frame_id]->insertData(CovarianceStorage(cov, ros::Time(0))); //, frame_id));
+                covariances_[frame_id] = new CovarianceTimeCache6(ros::Duration(10)); //! TODO : set actual max storage time
+                covariances_[frame_id]->insertData(CovarianceStorage6(CovarianceStorage6::Matrix::Zero(), ros::Time(0))); //, frame_id));
             }
             return covariances_[frame_id];
         }
     };
     CompactFrameID UncertainTransformer::lookupOrInsertFrameNumber(const std::string &frame_str)
     {
-        tf2_buffer_ptr_->_lookupOrInsertFrameNumber(frame_str);
+        return tf2_buffer_ptr_->_lookupOrInsertFrameNumber(frame_str);
     }
 
     bool UncertainTransformer::setCovariance(const StampedCovariance &cov)
@@ -51,7 +51,7 @@ namespace uncertain_tf
             boost::recursive_mutex::scoped_lock lock(cov_mutex_);
             CompactFrameID frame_number = lookupOrInsertFrameNumber(mapped_covariance.frame_id_); //! this is different from the standard tf where we keep a vector of [child_frame_id]
 
-            CovarianceTimeCache *covariance = getCovariance(frame_number);
+            CovarianceTimeCache6 *covariance = getCovariance(frame_number);
             /*if (covariance == NULL)
             {
                 std::cout << "creating new CovarianceTimeCache for id " << frame_number << endl;
@@ -59,7 +59,7 @@ namespace uncertain_tf
                 covariance = covariances_[frame_number];
             }*/
 
-            if (!covariance->insertData(CovarianceStorage(mapped_covariance, cov.stamp_))) // ,lookupOrInsertFrameNumber(mapped_covariance.frame_id_))))
+            if (!covariance->insertData(CovarianceStorage6(CovarianceStorage6::Matrix(mapped_covariance), cov.stamp_))) // ,lookupOrInsertFrameNumber(mapped_covariance.frame_id_))))
             {
                 ROS_INFO("ERROR in cov-insert");
                 return false;
@@ -1,8 +1,8 @@
 #include "ekf_pose_fusion/ekf_pose_fusion.hpp"
 #include <thread>
+#include <chrono>
 #include <random>
-using namespace MatrixWrapper;
-using namespace BFL;
+#include <ctime>
 using namespace tf;
 using namespace std;
 using namespace ros;
@@ -11,12 +11,24 @@ using namespace ros;
 namespace estimation
 {
     BR_pose_ekf::BR_pose_ekf(int fuse_list_length)
-        : prior_(NULL),
-          filter_(NULL),
-          filter_inited(false),
+        : filter_inited(false),
           wo_inited(false),
           vo_inited(false),
-          lo_inited(false)
+          lo_inited(false),
+          imu_callback_counter_(0),
+          output_running_(false),
+          sensor_queue_(1024),
+          fusion_running_(false),
+          fusion_wake_(false),
+          lo_outliers_(0),
+          reloc_requested_(false),
+          reloc_generation_(0),
+          reloc_found_(false),
+          reloc_pending_(false),
+          reloc_running_(false),
+          match_failures_(0),
+          match_running_(false),
+          log_pending_(false)
 
     {
         getParams();
@@ -25,197 +37,692 @@ namespace estimation
         // TODO 系统协方差调整
         // 并找到控制量输入的窗口
         // 思考应当将速度测量量作为控制量还是观测
-        ColumnVector sysNoise_Mu(3);
-        sysNoise_Mu = 0;
-        SymmetricMatrix sysNoise_Cov(3);
-        sysNoise_Cov = 0;
-        Matrix A(3, 3);
-        A = 0;
-        A(1, 1) = 1.0;
-        A(2, 2) = 1.0;
-        A(3, 3) = 1.0;
-        Matrix B(3, 3);
-        B = 0;
-        B(1, 1) = 1.0;
-        B(2, 1) = 1.0;
-        B(3, 3) = 1.0;
-
-        vector<Matrix> AB(2);
-        AB[0] = A;
-        AB[1] = B;
-
-        for (unsigned int i = 1; i <= 2; i++)
-            sysNoise_Cov(i, i) = pow(0.03, 2);
-        sysNoise_Cov(3, 3) = pow(0.11, 2);
-
-        Gaussian system_Uncertainty(sysNoise_Mu, sysNoise_Cov);
-        sys_pdf_ = new LinearAnalyticConditionalGaussian(AB, system_Uncertainty);
-        sys_model_ = new LinearAnalyticSystemModelGaussianUncertainty(sys_pdf_);
-        tmp_sys_pdf_ = new LinearAnalyticConditionalGaussian(AB, system_Uncertainty);
-        tmp_sys_model_ = new LinearAnalyticSystemModelGaussianUncertainty(tmp_sys_pdf_);
+        sys_A_.setIdentity();
+        sys_B_.setZero();
+        sys_B_(0, 0) = 1.0;
+        sys_B_(1, 0) = 1.0;
+        sys_B_(2, 2) = 1.0;
+        sys_cov_.setZero();
+        for (unsigned int i = 0; i < 2; i++)
+            sys_cov_(i, i) = pow(0.03, 2);
+        sys_cov_(2, 2) = pow(0.11, 2);
 
         // create MEASUREMENT MODEL ODOM
         // wheel_odom概率模型创建
-        ColumnVector measNoiseOdom_Mu(3);
-        measNoiseOdom_Mu = 0;
-        SymmetricMatrix measNoiseOdom_Cov(3);
-        measNoiseOdom_Cov = 0;
-        for (unsigned int i = 1; i <= 3; i++)
-            measNoiseOdom_Cov(i, i) = pow(0.008, 2);
-        Gaussian measurement_Uncertainty_Odom(measNoiseOdom_Mu, measNoiseOdom_Cov);
-        Matrix Hodom(3, 3);
-        Hodom = 0;
-        Hodom(1, 1) = 1;
-        Hodom(2, 2) = 1;
-        Hodom(3, 3) = 1;
-        wo_meas_pdf_ = new LinearAnalyticConditionalGaussian(Hodom, measurement_Uncertainty_Odom);
-        wo_meas_model_ = new LinearAnalyticMeasurementModelGaussianUncertainty(wo_meas_pdf_);
+        wo_meas_cov_ = Eigen::Matrix3d::Identity() * pow(0.008, 2);
 
         // create MEASUREMENT MODEL VO
         // 视觉定位数据
-        ColumnVector measNoiseVo_Mu(3);
-        measNoiseVo_Mu = 0;
-        SymmetricMatrix measNoiseVo_Cov(3);
-        measNoiseVo_Cov = 0;
-        for (unsigned int i = 1; i <= 3; i++)
-            measNoiseVo_Cov(i, i) = 1;
-        Gaussian measurement_Uncertainty_Vo(measNoiseVo_Mu, measNoiseVo_Cov);
-        Matrix Hvo(3, 3);
-        Hvo = 0;
-        Hvo(1, 1) = 1;
-        Hvo(2, 2) = 1;
-        Hvo(3, 3) = 1;
-
-        vo_meas_pdf_ = new LinearAnalyticConditionalGaussian(Hvo, measurement_Uncertainty_Vo);
-        vo_meas_model_ = new LinearAnalyticMeasurementModelGaussianUncertainty(vo_meas_pdf_);
+        vo_meas_cov_ = Eigen::Matrix3d::Identity();
 
         // create MEASUREMENT MODEL LO
-        ColumnVector measNoiseLo_Mu(3);
-        measNoiseLo_Mu = 0;
-        SymmetricMatrix measNoiseLo_Cov(3);
-        measNoiseLo_Cov = 0;
-        for (unsigned int i = 1; i <= 2; i++)
-            measNoiseLo_Cov(i, i) = pow(0.001, 2);
-        measNoiseLo_Cov(3, 3) = 9e-7;
-        Gaussian measurement_Uncertainty_Lo(measNoiseLo_Mu, measNoiseLo_Cov);
-        Matrix Hlo(3, 3);
-        Hlo = 0;
-        Hlo(1, 1) = 1;
-        Hlo(2, 2) = 1;
-        Hlo(3, 3) = 1;
-
-        Eigen::MatrixXd defult_cov;
-        lo_meas_pdf_ = new LinearAnalyticConditionalGaussian(Hlo, measurement_Uncertainty_Lo);
-        lo_meas_model_ = new LinearAnalyticMeasurementModelGaussianUncertainty(lo_meas_pdf_);
+        lo_meas_cov_.setZero();
+        for (unsigned int i = 0; i < 2; i++)
+            lo_meas_cov_(i, i) = pow(0.001, 2);
+        lo_meas_cov_(2, 2) = 9e-7;
+
+        // 零协方差表示还没有估计，setPrior 时会跳过
+        Eigen::Matrix3d defult_cov = Eigen::Matrix3d::Zero();
 
         transformer.set_m2o(0, 0, 0, Time::now());
         transformer.set_o2b(initPoseX, initPoseY, initPoseTheta, Time::now());
         transformer.set_m2b_cov(defult_cov, Time::now());
 
+#ifdef EKF_LATENCY_STATS
+        latency_.reset(new LatencyStats());
+        update_done_ns_ = 0;
+#endif
+        if (use_reloc || use_scan_match)
+            initFieldMaps();
         initTalkers();
-        initialize(transformer.map2odom * transformer.odom2basefootprint, Time::now());
+        tf::StampedTransform m2o, o2b;
+        transformer.get_frames(m2o, o2b);
+        initialize(m2o * o2b, Time::now());
         fuser.setTransformer(&transformer);
-        fuser.initFilter(transformer.map2odom * transformer.odom2basefootprint, Time::now());
+        fuser.initFilter(m2o * o2b, Time::now());
         transformer.setFuser(&fuser);
+
+        if (!log_dir.empty())
+        {
+            char name[64];
+            time_t now = time(NULL);
+            strftime(name, sizeof(name), "/ekf_%Y%m%d_%H%M%S.bin", localtime(&now));
+            if (logger_.open(log_dir + name))
+                ROS_INFO("logging filter updates to %s%s", log_dir.c_str(), name);
+            else
+                ROS_ERROR("cannot open filter log: %s", logger_.error().c_str());
+        }
+        fusion_running_ = true;
+        fusion_thread_ = std::thread(&BR_pose_ekf::fusionLoop, this);
+        if (use_reloc)
+        {
+            reloc_running_ = true;
+            reloc_thread_ = std::thread(&BR_pose_ekf::relocLoop, this);
+        }
+        if (use_scan_match)
+        {
+            match_running_ = true;
+            match_thread_ = std::thread(&BR_pose_ekf::matchLoop, this);
+        }
+        if (output_rate > 0)
+        {
+            output_running_ = true;
+            output_thread_ = std::thread(&BR_pose_ekf::outputLoop, this);
+        }
     }
 
     BR_pose_ekf::~BR_pose_ekf()
     {
-        if (filter_)
-            delete filter_;
-        if (prior_)
-            delete prior_;
+        output_running_ = false;
+        if (output_thread_.joinable())
+            output_thread_.join();
+        {
+            std::lock_guard<std::mutex> lock(reloc_mutex_);
+            reloc_running_ = false;
+        }
+        reloc_cv_.notify_all();
+        if (reloc_thread_.joinable())
+            reloc_thread_.join();
+        {
+            std::lock_guard<std::mutex> lock(match_mutex_);
+            match_running_ = false;
+        }
+        match_cv_.notify_all();
+        if (match_thread_.joinable())
+            match_thread_.join();
+        fusion_running_ = false;
+        wakeFusion();
+        if (fusion_thread_.joinable())
+            fusion_thread_.join();
+        logger_.close();
+    };
+
+    template <class M, int TYPE>
+    void BR_pose_ekf::onSensor(const boost::shared_ptr<M const> &msg)
+    {
+        SensorEvent ev;
+        ev.type = SensorEvent::Type(TYPE);
+        ev.stamp = msg->header.stamp;
+        ev.arrival = ros::WallTime::now().toNSec();
+        EKF_LATENCY(ev.stamp_age = (ros::Time::now() - ev.stamp).toNSec());
+        ev.msg = msg;
+        if (!sensor_queue_.push(ev))
+            ROS_WARN_THROTTLE(1, "sensor queue full, message dropped");
+        else
+            wakeFusion();
+    }
 
-        if (use_wo)
+    void BR_pose_ekf::wakeFusion(void)
+    {
         {
-            delete wo_meas_model_;
-            delete wo_meas_pdf_;
+            std::lock_guard<std::mutex> lock(fusion_mutex_);
+            fusion_wake_ = true;
         }
-        if (use_vo)
+        fusion_cv_.notify_one();
+    }
+
+    void BR_pose_ekf::fusionLoop(void)
+    {
+        // 等待 reorder_window 后按时间戳顺序处理，窗口内晚到的更早消息会排到前面
+        // 超出窗口的乱序由 pose_fuser 的状态历史重放处理
+        // 没有事件时阻塞等待：有待处理消息时等到堆顶那条出窗口，否则等新消息（每 100ms 检查一次 ros::ok）
+        std::vector<SensorEvent> pending;
+        const int64_t window = int64_t(reorder_window * 1e9);
+        SensorEvent ev;
+        while (fusion_running_ && ros::ok())
         {
-            delete vo_meas_model_;
-            delete vo_meas_pdf_;
+            if (reloc_pending_.load(std::memory_order_acquire))
+                applyRelocalization();
+            while (sensor_queue_.pop(ev))
+            {
+                pending.push_back(ev);
+                std::push_heap(pending.begin(), pending.end());
+            }
+            int64_t now = ros::WallTime::now().toNSec();
+            while (!pending.empty() && pending.front().arrival + window <= now)
+            {
+                std::pop_heap(pending.begin(), pending.end());
+                dispatch(pending.back());
+                pending.pop_back();
+            }
+
+            std::unique_lock<std::mutex> lock(fusion_mutex_);
+            if (!fusion_wake_)
+            {
+                std::chrono::nanoseconds timeout = std::chrono::milliseconds(100);
+                if (!pending.empty())
+                    timeout = std::min(timeout, std::chrono::nanoseconds(std::max<int64_t>(0, pending.front().arrival + window - now)));
+                fusion_cv_.wait_for(lock, timeout, [this] { return fusion_wake_; });
+            }
+            fusion_wake_ = false;
         }
+    }
 
-        if (use_lo)
+    void BR_pose_ekf::dispatch(const SensorEvent &ev)
+    {
+        const bool logging = logger_.isOpen();
+#ifdef EKF_LATENCY_STATS
+        int64_t start = ros::WallTime::now().toNSec();
+        update_done_ns_ = 0;
+#else
+        int64_t start = logging ? ros::WallTime::now().toNSec() : 0;
+#endif
+        log_pending_ = false;
+        switch (ev.type)
         {
-            delete lo_meas_model_;
-            delete lo_meas_pdf_;
+        case SensorEvent::WHEEL:
+            woCallback2(boost::static_pointer_cast<nav_msgs::Odometry const>(ev.msg));
+            break;
+        case SensorEvent::LASER:
+            newloCallback(boost::static_pointer_cast<geometry_msgs::PoseWithCovarianceStamped const>(ev.msg));
+            break;
+        case SensorEvent::VISUAL:
+            voCallback(boost::static_pointer_cast<geometry_msgs::PoseWithCovarianceStamped const>(ev.msg));
+            break;
+        case SensorEvent::IMU:
+            imuCallback(boost::static_pointer_cast<sensor_msgs::Imu const>(ev.msg));
+            break;
+        case SensorEvent::TRUE_POSE:
+            truePoseCallback(boost::static_pointer_cast<nav_msgs::Odometry const>(ev.msg));
+            break;
         }
+#ifdef EKF_LATENCY_STATS
+        // 类型与 LatencyStats::Source 前五项一一对应；没有标记更新完成的处理函数不单独统计发布阶段
+        static_assert(int(SensorEvent::TRUE_POSE) == int(LatencyStats::TRUE_POSE), "SensorEvent::Type must match LatencyStats::Source");
+        int64_t end = ros::WallTime::now().toNSec();
+        LatencyHistogram *h = latency_->hist[ev.type];
+        h[LatencyStats::TRANSPORT].record(ev.stamp_age);
+        h[LatencyStats::QUEUE].record(start - ev.arrival);
+        if (update_done_ns_)
+        {
+            h[LatencyStats::UPDATE].record(update_done_ns_ - start);
+            h[LatencyStats::PUBLISH].record(end - update_done_ns_);
+        }
+        else
+        {
+            h[LatencyStats::UPDATE].record(end - start);
+        }
+        h[LatencyStats::TOTAL].record(ev.stamp_age + end - ev.arrival);
+#endif
+        if (logging && log_pending_)
+        {
+            log_rec_.type = ev.type;
+            log_rec_.stamp_ns = ev.stamp.toNSec();
+            log_rec_.arrival_ns = ev.arrival;
+            log_rec_.start_ns = start;
+            log_rec_.end_ns = ros::WallTime::now().toNSec();
+            Eigen::Vector3d m2o;
+            decomposeTransform(transformer.get_m2o(), m2o);
+            for (int i = 0; i < 3; ++i)
+                log_rec_.m2o[i] = m2o(i);
+            logger_.write(log_rec_);
+        }
+    }
 
-        delete sys_pdf_;
-        delete sys_model_;
-    };
+    void BR_pose_ekf::logUpdate(const Eigen::Vector3d &x, const Eigen::Matrix3d &P, const Eigen::Vector3d &z, uint32_t flags)
+    {
+        if (!logger_.isOpen())
+            return;
+        memset(&log_rec_, 0, sizeof(log_rec_));
+        log_rec_.flags = flags;
+        for (int i = 0; i < 3; ++i)
+        {
+            log_rec_.x[i] = x(i);
+            log_rec_.z[i] = z(i);
+        }
+        FilterLogRecord::packCov(P.data(), log_rec_.P);
+        log_pending_ = true;
+    }
 
-    void BR_pose_ekf::initTalkers(void)
+#ifdef EKF_LATENCY_STATS
+    void BR_pose_ekf::reportLatency(const ros::WallTimerEvent &)
     {
-        if (use_lo)
+        diagnostic_msgs::DiagnosticArray arr;
+        arr.header.stamp = ros::Time::now();
+        LatencyHistogram::Snapshot window;
+        for (int src = 0; src < LatencyStats::SOURCES; ++src)
+        {
+            diagnostic_msgs::DiagnosticStatus st;
+            st.name = ros::this_node::getName() + ": " + LatencyStats::sourceName(src) + " latency";
+            st.hardware_id = ros::this_node::getName();
+            st.level = diagnostic_msgs::DiagnosticStatus::OK;
+            st.message = "ok";
+            for (int stage = 0; stage < LatencyStats::STAGES; ++stage)
+            {
+                latency_->hist[src][stage].collect(latency_->last[src][stage], window);
+                if (window.total == 0)
+                    continue;
+                char buf[128];
+                snprintf(buf, sizeof(buf), "n %llu p50 %.1f p90 %.1f p99 %.1f max %.1f",
+                         (unsigned long long)window.total, window.percentile(0.5) / 1e3, window.percentile(0.9) / 1e3,
+                         window.percentile(0.99) / 1e3, window.max_ns / 1e3);
+                diagnostic_msgs::KeyValue kv;
+                kv.key = std::string(LatencyStats::stageName(stage)) + " (us)";
+                kv.value = buf;
+                st.values.push_back(kv);
+                if (stage == LatencyStats::TOTAL)
+                {
+                    double p99 = window.percentile(0.99) / 1e9;
+                    st.message = p99 > latency_warn ? "end-to-end p99 over limit" : "ok";
+                    if (p99 > latency_warn)
+                        st.level = diagnostic_msgs::DiagnosticStatus::WARN;
+                }
+            }
+            if (!st.values.empty())
+                arr.status.push_back(st);
+        }
+        diag_pub.publish(arr);
+    }
+#endif
+
+    static void consistencyStatus(const std::string &name, const NisMonitor::Stats &now, NisMonitor::Stats &last,
+                                  double warn_rate, diagnostic_msgs::DiagnosticStatus &st)
+    {
+        st.name = ros::this_node::getName() + ": " + name + " consistency";
+        st.hardware_id = ros::this_node::getName();
+        st.level = diagnostic_msgs::DiagnosticStatus::OK;
+        st.message = "ok";
+        // 丢弃比例按本周期的增量算，累计值反映不出刚发生的故障
+        uint64_t total = now.total - last.total, rejected = now.rejected - last.rejected;
+        uint64_t downweighted = now.downweighted - last.downweighted;
+        last = now;
+        double rate = total ? double(rejected) / total : 0.0;
+        char buf[128];
+        auto add = [&](const char *key)
+        {
+            diagnostic_msgs::KeyValue kv;
+            kv.key = key;
+            kv.value = buf;
+            st.values.push_back(kv);
+        };
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)total);
+        add("checked");
+        snprintf(buf, sizeof(buf), "%llu (%.1f%%)", (unsigned long long)rejected, rate * 100);
+        add("rejected");
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)downweighted);
+        add("downweighted");
+        snprintf(buf, sizeof(buf), "%.2f [%.2f %.2f] n %zu", now.mean, now.lower, now.upper, now.count);
+        add("mean NIS [95% bounds]");
+        snprintf(buf, sizeof(buf), "%.2f", now.max);
+        add("max NIS");
+        if (now.count > 1 && !now.consistent)
+        {
+            st.level = diagnostic_msgs::DiagnosticStatus::WARN;
+            st.message = now.mean > now.upper ? "innovation larger than covariance, noise underestimated"
+                                              : "innovation smaller than covariance, noise overestimated";
+        }
+        if (total && rate > warn_rate)
         {
+            st.level = diagnostic_msgs::DiagnosticStatus::WARN;
+            st.message = "rejection rate over limit";
+        }
+    }
 
-            // lo_sub = node.subscribe(
-            //     lo_topic, 1, &BR_pose_ekf::loCallback, this);
+    void BR_pose_ekf::reportConsistency(const ros::WallTimerEvent &)
+    {
+        diagnostic_msgs::DiagnosticArray arr;
+        arr.header.stamp = ros::Time::now();
+        arr.status.resize(2);
+        // 轮式的“丢弃”为确认的打滑
+        consistencyStatus("laser", fuser.lidar_nis.stats(), last_lidar_stats_, consistency_warn_rate, arr.status[0]);
+        consistencyStatus("wheel", fuser.wheel_nis.stats(), last_wheel_stats_, consistency_warn_rate, arr.status[1]);
+        diag_pub.publish(arr);
+    }
 
-            ros::CallbackQueue *cbque = new ros::CallbackQueue();
+    void BR_pose_ekf::initTalkers(void)
+    {
+        // 回调只入队，放在全局队列上由 main 中的 spinner 调用即可
+        ros::TransportHints hints = ros::TransportHints().tcpNoDelay().udp();
+        if (use_lo)
+            lo_sub = node.subscribe(lo_topic, 10, &BR_pose_ekf::onSensor<geometry_msgs::PoseWithCovarianceStamped, SensorEvent::LASER>, this, hints);
+        if (use_vo)
+            vo_sub = node.subscribe(vo_topic, 10, &BR_pose_ekf::onSensor<geometry_msgs::PoseWithCovarianceStamped, SensorEvent::VISUAL>, this, hints);
+        if (use_wo)
+            wo_sub = node.subscribe(wo_topic, 10, &BR_pose_ekf::onSensor<nav_msgs::Odometry, SensorEvent::WHEEL>, this, hints);
+        if (use_imu)
+            imu_sub = node.subscribe(imu_topic, 50, &BR_pose_ekf::onSensor<sensor_msgs::Imu, SensorEvent::IMU>, this, hints);
+        if (use_true_pose)
+            true_pose_sub = node.subscribe(true_pose_topic, 10, &BR_pose_ekf::onSensor<nav_msgs::Odometry, SensorEvent::TRUE_POSE>, this, hints);
 
-            ros::SubscribeOptions ops =
-                ros::SubscribeOptions::create<geometry_msgs::PoseWithCovarianceStamped>(
-                    lo_topic,                                           // topic name
-                    1,                                                  // queue length
-                    boost::bind(&BR_pose_ekf::newloCallback, this, _1), // callback
-                    ros::VoidPtr(),                                     // tracked object, we don't need one thus NULL
-                    cbque);
-            ops.allow_concurrent_callbacks = false;
-            ops.transport_hints = ros::TransportHints().tcpNoDelay().udp();
-            // // subscribe
-            lo_sub = node.subscribe(ops);
+        pose_pub = node.advertise<geometry_msgs::PoseWithCovarianceStamped>(output_topic, 1);
+        compensation_pub = node.advertise<nav_msgs::Odometry>(compensation_topic, 1);
+        if (output_rate > 0)
+            extrapolated_pub = node.advertise<ekf_pose_fusion::ExtrapolatedPose>(extrapolated_topic, 1);
+        bool report_consistency = self_diagnose_ && consistency_report_period > 0;
+#ifdef EKF_LATENCY_STATS
+        if (latency_report_period > 0 || report_consistency)
+#else
+        if (report_consistency)
+#endif
+            diag_pub = node.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+#ifdef EKF_LATENCY_STATS
+        if (latency_report_period > 0)
+            latency_timer_ = node.createWallTimer(ros::WallDuration(latency_report_period), &BR_pose_ekf::reportLatency, this);
+#endif
+        if (report_consistency)
+            consistency_timer_ = node.createWallTimer(ros::WallDuration(consistency_report_period), &BR_pose_ekf::reportConsistency, this);
+        if (use_reloc || use_scan_match)
+            scan_sub = node.subscribe(scan_topic, 1, &BR_pose_ekf::scanCallback, this, hints);
+        if (use_scan_match)
+            match_pub = node.advertise<geometry_msgs::PoseWithCovarianceStamped>(scan_match_topic, 1);
+        if (use_reloc)
+        {
+            reloc_pub = node.advertise<geometry_msgs::PoseWithCovarianceStamped>(reloc_topic, 1);
+            reloc_srv = node.advertiseService("relocalize", &BR_pose_ekf::relocalizeService, this);
+        }
+    }
 
-            // spawn async spinner with 1 thread, running on our custom queue
-            ros::AsyncSpinner *async_spinner = new ros::AsyncSpinner(1, cbque);
+    void BR_pose_ekf::initFieldMaps(void)
+    {
+        ros::NodeHandle n_pri("~");
+        // 优先用 field_map_gen 预先生成的文件，只读映射，不用在启动时计算；缺少的分辨率再由线段生成
+        std::string map_file;
+        n_pri.param<std::string>("field_map_file", map_file, "");
+        std::shared_ptr<FieldMapFile> file;
+        if (!map_file.empty())
+        {
+            std::string error;
+            file = FieldMapFile::open(map_file, error);
+            if (!file)
+                ROS_ERROR("cannot load field map, falling back to field_segments: %s", error.c_str());
+        }
 
-            // start the spinner
-            async_spinner->start();
+        // 场地边界、围栏和柱子按线段给出：field_segments: [[x1, y1, x2, y2], ...]，map 系
+        std::vector<FieldSegment> segments;
+        XmlRpc::XmlRpcValue list;
+        if (n_pri.getParam("field_segments", list) && list.getType() == XmlRpc::XmlRpcValue::TypeArray)
+        {
+            for (int i = 0; i < list.size(); ++i)
+            {
+                XmlRpc::XmlRpcValue &seg = list[i];
+                if (seg.getType() != XmlRpc::XmlRpcValue::TypeArray || seg.size() != 4)
+                {
+                    ROS_ERROR("field_segments[%d] should be [x1, y1, x2, y2], ignored", i);
+                    continue;
+                }
+                double v[4];
+                for (int k = 0; k < 4; ++k)
+                    v[k] = seg[k].getType() == XmlRpc::XmlRpcValue::TypeInt ? double(int(seg[k])) : double(seg[k]);
+                segments.push_back(FieldSegment{v[0], v[1], v[2], v[3]});
+            }
         }
-        if (use_vo)
+        if (segments.empty() && !file)
         {
-            vo_sub = node.subscribe(
-                vo_topic, 1, &BR_pose_ekf::voCallback, this);
+            ROS_ERROR("neither field_map_file nor field_segments is given, relocalization and scan matching disabled");
+            use_reloc = false;
+            use_scan_match = false;
+            return;
         }
-        if (use_wo)
+        double min_x = 1e9, min_y = 1e9, max_x = -1e9, max_y = -1e9;
+        for (const FieldSegment &s : segments)
         {
-            // wo_sub = node.subscribe(
-            //     wo_topic, 1, &BR_pose_ekf::woCallback2, this);
+            min_x = std::min(min_x, std::min(s.x1, s.x2));
+            min_y = std::min(min_y, std::min(s.y1, s.y2));
+            max_x = std::max(max_x, std::max(s.x1, s.x2));
+            max_y = std::max(max_y, std::max(s.y1, s.y2));
+        }
+        // 与 field_map_gen 的 margin 默认值一致
+        const double margin = 0.5;
+        auto load = [&](const char *name, double resolution, double sigma, LikelihoodField &field) -> bool
+        {
+            ros::WallTime t0 = ros::WallTime::now();
+            int level = file ? file->find(resolution) : -1;
+            if (level >= 0)
+            {
+                bool shared = FieldMapFile::likelihoodField(file, level, sigma, field);
+                ROS_INFO("%s field: %dx%d cells from %s (%s) in %.1f ms", name, field.width(), field.height(),
+                         map_file.c_str(), shared ? "mapped" : "sigma differs, recomputed",
+                         (ros::WallTime::now() - t0).toSec() * 1e3);
+                return true;
+            }
+            if (file)
+                ROS_WARN("%s has no %.3f m level for %s, building it from field_segments", map_file.c_str(), resolution, name);
+            if (segments.empty())
+            {
+                ROS_ERROR("%s field unavailable: no matching level and field_segments is empty", name);
+                return false;
+            }
+            field.build(segments, min_x - margin, min_y - margin, max_x + margin, max_y + margin, resolution, sigma);
+            ROS_INFO("%s field: %zu segments, %dx%d cells, built in %.1f ms", name, segments.size(),
+                     field.width(), field.height(), (ros::WallTime::now() - t0).toSec() * 1e3);
+            return true;
+        };
 
-            // ros::SubscribeOptions ops;
-            // ops.init<nav_msgs::Odometry>(wo_topic, 1, boost::bind(&BR_pose_ekf::woCallback, this, _1));
-            // ops.allow_concurrent_callbacks = true;
-            // wo_sub = node.subscribe(ops);
+        // 重定位搜全场用粗一些的栅格，扫描匹配只在先验附近搜，用细栅格
+        if (use_reloc)
+        {
+            double resolution, sigma;
+            n_pri.param<double>("reloc_resolution", resolution, 0.05);
+            n_pri.param<double>("reloc_sigma", sigma, 0.05);
+            LikelihoodField field;
+            if (load("relocalization", resolution, sigma, field))
+                relocalizer_.setMap(field);
+            else
+                use_reloc = false;
+        }
+        if (use_scan_match)
+        {
+            double resolution, sigma;
+            n_pri.param<double>("scan_match_resolution", resolution, 0.02);
+            n_pri.param<double>("scan_match_sigma", sigma, 0.03);
+            LikelihoodField field;
+            if (load("scan match", resolution, sigma, field))
+                scan_matcher_.setMap(field);
+            else
+                use_scan_match = false;
+        }
+    }
 
-            ros::CallbackQueue *cbque = new ros::CallbackQueue();
+    void BR_pose_ekf::scanCallback(const sensor_msgs::LaserScan::ConstPtr &scan)
+    {
+        if (use_scan_match)
+        {
+            std::lock_guard<std::mutex> lock(match_mutex_);
+            match_scan_ = scan;
+            match_cv_.notify_one();
+        }
+        if (use_reloc)
+        {
+            std::lock_guard<std::mutex> lock(reloc_mutex_);
+            latest_scan_ = scan;
+            if (reloc_requested_)
+                reloc_cv_.notify_all();
+        }
+    }
 
-            ros::SubscribeOptions ops =
-                ros::SubscribeOptions::create<nav_msgs::Odometry>(
-                    wo_topic,                                         // topic name
-                    1,                                                // queue length
-                    boost::bind(&BR_pose_ekf::woCallback2, this, _1), // callback
-                    ros::VoidPtr(),                                   // tracked object, we don't need one thus NULL
-                    cbque);
-            // // subscribe
-            ops.allow_concurrent_callbacks = true;
-            ops.transport_hints = ros::TransportHints().tcpNoDelay().udp();
+    void BR_pose_ekf::matchLoop(void)
+    {
+        std::vector<Eigen::Vector2d> points;
+        CorrelativeScanMatcher::Result result;
+        while (true)
+        {
+            sensor_msgs::LaserScan::ConstPtr scan;
+            {
+                std::unique_lock<std::mutex> lock(match_mutex_);
+                match_cv_.wait(lock, [this]
+                               { return !match_running_ || match_scan_; });
+                if (!match_running_)
+                    return;
+                scan.swap(match_scan_);
+            }
+            scanToPoints(scan->ranges, scan->angle_min, scan->angle_increment, scan->range_min, scan->range_max,
+                         laser_mount_, scan_match_point_spacing, points);
+
+            // 先验取扫描时刻的融合结果
+            PoseHistory::Sample frames;
+            transformer.lookup_frames(scan->header.stamp, frames);
+            SE2 prior = frames.pose(PoseHistory::M2O) * frames.pose(PoseHistory::O2B);
+            if (!scan_matcher_.match(points, prior, result))
+            {
+                ROS_WARN_THROTTLE(1, "scan match score %.2f below scan_match_min_score", result.score);
+                if (reloc_lost_count > 0 && ++match_failures_ >= reloc_lost_count)
+                {
+                    requestRelocalization(scan->header.stamp, "scan matching keeps failing");
+                    match_failures_ = 0;
+                }
+                continue;
+            }
+            match_failures_ = 0;
+
+            geometry_msgs::PoseWithCovarianceStamped::Ptr out(new geometry_msgs::PoseWithCovarianceStamped);
+            out->header.frame_id = map_frame;
+            out->header.stamp = scan->header.stamp;
+            result.pose.toPose(out->pose.pose);
+            const int idx[3] = {0, 1, 5};
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++)
+                    out->pose.covariance[6 * idx[i] + idx[j]] = result.cov(i, j);
+            match_pub.publish(out);
+            onSensor<geometry_msgs::PoseWithCovarianceStamped, SensorEvent::LASER>(out);
+        }
+    }
 
-            wo_sub = node.subscribe(ops);
+    void BR_pose_ekf::requestRelocalization(const ros::Time &stamp, const char *reason)
+    {
+        if (!use_reloc)
+            return;
+        std::lock_guard<std::mutex> lock(reloc_mutex_);
+        if (reloc_requested_)
+            return;
+        reloc_requested_ = true;
+        reloc_after_ = stamp;
+        ROS_WARN("relocalization requested: %s", reason);
+        reloc_cv_.notify_all();
+    }
 
-            ros::AsyncSpinner *async_spinner = new ros::AsyncSpinner(1, cbque);
-            async_spinner->start();
+    bool BR_pose_ekf::relocalizeService(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res)
+    {
+        if (!use_reloc)
+        {
+            res.success = false;
+            res.message = "relocalization is disabled";
+            return true;
         }
-        if (use_true_pose)
+        uint64_t generation;
         {
-            true_pose_sub = node.subscribe(
-                true_pose_topic, 1, &BR_pose_ekf::truePoseCallback, this, ros::TransportHints().tcpNoDelay().udp());
+            std::lock_guard<std::mutex> lock(reloc_mutex_);
+            generation = reloc_generation_;
         }
+        requestRelocalization(ros::Time::now(), "service call");
+        std::unique_lock<std::mutex> lock(reloc_mutex_);
+        if (!reloc_cv_.wait_for(lock, std::chrono::seconds(1), [&]
+                                { return reloc_generation_ != generation; }))
+        {
+            res.success = false;
+            res.message = "no scan received on " + scan_topic;
+            return true;
+        }
+        res.success = reloc_found_;
+        res.message = reloc_message_;
+        return true;
+    }
 
-        pose_pub = node.advertise<geometry_msgs::PoseWithCovarianceStamped>(output_topic, 1);
-        compensation_pub = node.advertise<nav_msgs::Odometry>(compensation_topic, 1);
+    void BR_pose_ekf::relocLoop(void)
+    {
+        std::vector<Eigen::Vector2d> points;
+        std::vector<GlobalRelocalizer::Hypothesis> hyps;
+        while (true)
+        {
+            sensor_msgs::LaserScan::ConstPtr scan;
+            {
+                std::unique_lock<std::mutex> lock(reloc_mutex_);
+                reloc_cv_.wait(lock, [this]
+                               { return !reloc_running_ || (reloc_requested_ && latest_scan_ && latest_scan_->header.stamp >= reloc_after_); });
+                if (!reloc_running_)
+                    return;
+                scan = latest_scan_;
+            }
+
+            ros::WallTime t0 = ros::WallTime::now();
+            scanToPoints(scan->ranges, scan->angle_min, scan->angle_increment, scan->range_min, scan->range_max,
+                         laser_mount_, reloc_point_spacing, points);
+            relocalizer_.search(points, hyps);
+            double ms = (ros::WallTime::now() - t0).toSec() * 1e3;
+
+            // 扫描时刻的当前估计，用来在对称的假设中挑选，以及判断是否真的需要重置
+            PoseHistory::Sample frames;
+            transformer.lookup_frames(scan->header.stamp, frames);
+            SE2 est = frames.pose(PoseHistory::M2O) * frames.pose(PoseHistory::O2B);
+
+            char buf[256];
+            bool found = !hyps.empty(), reset = false;
+            size_t pick = 0;
+            if (!found)
+            {
+                snprintf(buf, sizeof(buf), "no pose scored above reloc_min_score (%zu points, %.1f ms)", points.size(), ms);
+            }
+            else
+            {
+                // 场地对称，得分相近的假设取离当前估计最近的
+                double best = 1e300;
+                for (size_t i = 0; i < hyps.size(); ++i)
+                {
+                    SE2 d = est.between(hyps[i].pose);
+                    double dist = hypot(d.x, d.y) + fabs(d.yaw());
+                    if (dist < best)
+                    {
+                        best = dist;
+                        pick = i;
+                    }
+                }
+                const GlobalRelocalizer::Hypothesis &h = hyps[pick];
+                SE2 d = est.between(h.pose);
+                reset = hypot(d.x, d.y) > reloc_lost_dist || fabs(d.yaw()) > reloc_lost_yaw;
+                snprintf(buf, sizeof(buf), "%s (%.3f, %.3f, %.3f) score %.2f, %zu symmetric candidates, %.1f ms",
+                         reset ? "relocalized to" : "estimate confirmed at", h.pose.x, h.pose.y, h.pose.yaw(), h.score, hyps.size(), ms);
+
+                geometry_msgs::PoseWithCovarianceStamped out;
+                out.header.frame_id = map_frame;
+                out.header.stamp = scan->header.stamp;
+                h.pose.toPose(out.pose.pose);
+                const int idx[3] = {0, 1, 5};
+                for (int i = 0; i < 3; i++)
+                    for (int j = 0; j < 3; j++)
+                        out.pose.covariance[6 * idx[i] + idx[j]] = h.cov(i, j);
+                reloc_pub.publish(out);
+            }
+            if (found)
+                ROS_WARN("%s", buf);
+            else
+                ROS_ERROR("relocalization failed: %s", buf);
+
+            std::lock_guard<std::mutex> lock(reloc_mutex_);
+            if (reset)
+            {
+                reloc_result_ = hyps[pick];
+                reloc_stamp_ = scan->header.stamp;
+                reloc_pending_.store(true, std::memory_order_release);
+                wakeFusion();
+            }
+            reloc_found_ = found;
+            reloc_message_ = buf;
+            reloc_requested_ = false;
+            ++reloc_generation_;
+            reloc_cv_.notify_all();
+        }
+    }
+
+    void BR_pose_ekf::applyRelocalization(void)
+    {
+        GlobalRelocalizer::Hypothesis h;
+        ros::Time stamp;
+        {
+            std::lock_guard<std::mutex> lock(reloc_mutex_);
+            h = reloc_result_;
+            stamp = reloc_stamp_;
+            reloc_pending_ = false;
+        }
+        // 搜索得到的是扫描时刻的 map->base_footprint，用该时刻的 odom->base_footprint 换算出 map->odom
+        PoseHistory::Sample frames;
+        transformer.lookup_frames(stamp, frames);
+        SE2 m2o = h.pose * frames.pose(PoseHistory::O2B).inverse();
+        tf::StampedTransform o2b = transformer.get_o2b();
+        transformer.set_m2o(m2o, o2b.stamp_);
+        tf::Transform prior = m2o.toTransform() * o2b;
+        fuser.initFilter(prior, o2b.stamp_, h.cov);
+        initialize(prior, o2b.stamp_);
+        transformer.set_m2b_cov(h.cov, o2b.stamp_);
+        lo_outliers_ = 0;
     }
 
     void BR_pose_ekf::truePoseCallback(const nav_msgs::Odometry::ConstPtr &odom_msg)
@@ -223,50 +730,42 @@ namespace estimation
         assert(use_true_pose);
         latest_true_pose = *odom_msg;
         tf::poseMsgToTF(latest_true_pose.pose.pose, true_pose);
-        transformer.true_pose_list.insertData(tf::TransformStorage(tf::StampedTransform(true_pose, odom_msg->header.stamp, odom_msg->header.frame_id, odom_msg->child_frame_id), 1, 3));
+        transformer.insert_true_pose(true_pose, odom_msg->header.stamp);
         if (!received_true_pose_)
         {
             received_true_pose_ = true;
         }
 
-        std::cout << "lo** ined" << std::endl;
-        if (odom_msg->header.stamp < fuser.last_filt_time)
-            return;
+        ROS_DEBUG_STREAM("lo in: " << odom_msg->header.stamp);
 
         lo_stamp_ = odom_msg->header.stamp;
         poseMsgToTF(odom_msg->pose.pose, lo_meas_);
-        MatrixWrapper::ColumnVector noise(3);
+        Eigen::Vector3d noise;
         tf::Transform noitf;
         std::default_random_engine generator(rand());
         std::normal_distribution<double> distribution(0.0, 0.03);
+        noise(0) = distribution(generator);
         noise(1) = distribution(generator);
         noise(2) = distribution(generator);
-        noise(3) = distribution(generator);
-        cout << "noise: " << noise << endl;
+        cout << "noise: " << noise.transpose() << endl;
         ColumnVector2Transform(noise, noitf);
         lo_meas_ *= noitf;
 
-        TransformStorage o2b, tp;
-        if (!transformer.o2b_list.getData(lo_stamp_, o2b))
-        {
-            transformer.o2b_list.getData(Time(0), o2b);
+        PoseHistory::Sample frames;
+        if (!transformer.lookup_frames(lo_stamp_, frames))
             ROS_ERROR("no lo stamp find");
-        };
 
-        if (!transformer.true_pose_list.getData(lo_stamp_, tp))
+        pose_factor::Ptr lo_factor = pose_factor::create();
+        if (!lo_factor)
         {
-            transformer.true_pose_list.getData(Time(0), tp);
+            ROS_WARN_THROTTLE(1, "pose_factor pool exhausted, measurement dropped");
+            return;
         }
-
-        tf::Transform o2bTran(o2b.rotation_, o2b.translation_);
-        tf::Transform tpTran(tp.rotation_, tp.translation_);
-
-        pose_factor::Ptr lo_factor(new pose_factor());
         lo_factor->stamp = lo_stamp_;
-        lo_factor->woTrans = o2bTran;
+        lo_factor->woTrans = frames.pose(PoseHistory::O2B);
         lo_factor->cov = Eigen::Matrix3d::Identity() * 3e-7;
 
-        lo_factor->measurement = lo_meas_;
+        lo_factor->measurement = SE2::fromTransform(lo_meas_);
         fuser.addMeasurements(lo_factor);
 
         // poseTFToMsg(lo_meas_, output_.pose.pose);
@@ -286,6 +785,7 @@ namespace estimation
         n_pri.param<bool>("use_vo", use_vo, false);
         n_pri.param<bool>("use_lo", use_lo, false);
         n_pri.param<bool>("use_true_pose", use_true_pose, false);
+        n_pri.param<bool>("use_imu", use_imu, false);
         n_pri.param<bool>("predict_test", predict_test, false);
         n_pri.param<bool>("broadcastTF", broadcastTF, true);
         n_pri.param<bool>("odom_noise_test", odom_noise_test, false);
@@ -296,6 +796,17 @@ namespace estimation
         n_pri.param<string>("wo_topic", wo_topic, "wheel_odom");
         n_pri.param<string>("vo_topic", vo_topic, "visual_odom");
         n_pri.param<string>("true_pose_topic", true_pose_topic, "/ground_truth/state");
+        n_pri.param<string>("imu_topic", imu_topic, "imu");
+        n_pri.param<string>("extrapolated_topic", extrapolated_topic, "BR_Pose_fixed");
+        // 定频输出：开启后 compensation 也改由输出线程发布
+        n_pri.param<double>("output_rate", output_rate, 0.0);
+        n_pri.param<double>("max_extrapolation", max_extrapolation, 0.1);
+        n_pri.param<double>("reorder_window", reorder_window, 0.002);
+        n_pri.param<string>("log_dir", log_dir, "");
+#ifdef EKF_LATENCY_STATS
+        n_pri.param<double>("latency_report_period", latency_report_period, 1.0);
+        n_pri.param<double>("latency_warn", latency_warn, 0.02);
+#endif
         // 待会儿看看fuse之前的先验值是不是odom值，输入值是不是对
         n_pri.param<string>("output_topic", output_topic, "BR_Pose");
         n_pri.param<string>("laser_frame", laser_frame, "laser");
@@ -306,29 +817,81 @@ namespace estimation
         n_pri.param<double>("initPoseTheta", initPoseTheta, 5.0);
 	    n_pri.param<std::string>("compensation_topic", compensation_topic, "/compensation");
 
+        // 状态历史：能接受的量测延迟约为 history_length 个轮式里程计周期
+        int history_length;
+        n_pri.param<int>("history_length", history_length, 400);
+        fuser.setHistoryLength(history_length > 1 ? history_length : 2);
+        n_pri.param<double>("odom_noise_xy", fuser.odom_noise_xy, 1e-3);
+        n_pri.param<double>("odom_noise_yaw", fuser.odom_noise_yaw, 1e-3);
+        // 融合后端：ekf 或 smoother（滑窗位姿图平滑）
+        std::string backend;
+        n_pri.param<std::string>("fusion_backend", backend, "ekf");
+        if (backend == "smoother")
+            fuser.backend = pose_fuser::SMOOTHER;
+        else if (backend != "ekf")
+            ROS_ERROR("unknown fusion_backend %s, using ekf", backend.c_str());
+        n_pri.param<int>("smoother_window", fuser.smoother_window, 20);
+        n_pri.param<int>("smoother_iterations", fuser.smoother_iterations, 3);
+
+        // 新息一致性检查：NIS 超过 nis_gate 降权，超过 nis_reject 丢弃，均为 3 自由度卡方分位数
+        n_pri.param<bool>("debug", debug_, false);
+        n_pri.param<bool>("self_diagnose", self_diagnose_, true);
+        fuser.gating = self_diagnose_;
+        n_pri.param<double>("nis_gate", fuser.lidar_gate.accept, 11.34);
+        n_pri.param<double>("nis_reject", fuser.lidar_gate.reject, 21.11);
+        n_pri.param<double>("wheel_slip_gate", fuser.wheel_gate.accept, 11.34);
+        n_pri.param<int>("nis_reject_limit", fuser.reject_limit, 3);
+        n_pri.param<double>("slip_max_gap", fuser.slip_max_gap, 1.0);
+        int nis_window;
+        n_pri.param<int>("nis_window", nis_window, 50);
+        fuser.lidar_nis.setWindow(nis_window > 0 ? nis_window : 1);
+        fuser.wheel_nis.setWindow(nis_window > 0 ? nis_window : 1);
+        n_pri.param<double>("consistency_report_period", consistency_report_period, 1.0);
+        n_pri.param<double>("consistency_warn_rate", consistency_warn_rate, 0.2);
+
+        // IMU 外推：陀螺积分航向，加速度计默认不用（场地上振动大）
+        n_pri.param<bool>("imu_use_accel", imu_predictor_.use_accel, false);
+        n_pri.param<double>("imu_gyro_noise", imu_predictor_.gyro_noise, 1e-4);
+        n_pri.param<double>("imu_vel_noise", imu_predictor_.vel_noise, 1e-3);
+        n_pri.param<double>("imu_max_dt", imu_predictor_.max_dt, 0.05);
+
+        // 全场重定位与扫描匹配，场地线段与似然场参数见 initFieldMaps
+        n_pri.param<bool>("use_reloc", use_reloc, false);
+        n_pri.param<string>("scan_topic", scan_topic, "scan_filtered");
+        n_pri.param<string>("reloc_topic", reloc_topic, "relocalization");
+        n_pri.param<double>("reloc_point_spacing", reloc_point_spacing, 0.15);
+        n_pri.param<double>("reloc_lost_dist", reloc_lost_dist, 0.3);
+        n_pri.param<double>("reloc_lost_yaw", reloc_lost_yaw, 0.3);
+        n_pri.param<int>("reloc_lost_count", reloc_lost_count, 5);
+        n_pri.param<double>("reloc_collision_accel", reloc_collision_accel, 0.0);
+        n_pri.param<int>("reloc_depth", relocalizer_.options.depth, 6);
+        n_pri.param<double>("reloc_min_score", relocalizer_.options.min_score, 0.5);
+        n_pri.param<double>("reloc_ambiguity", relocalizer_.options.ambiguity, 0.9);
+        n_pri.param<double>("reloc_max_range", relocalizer_.options.max_range, 12.0);
+        n_pri.param<bool>("use_scan_match", use_scan_match, false);
+        n_pri.param<string>("scan_match_topic", scan_match_topic, "scan_match_pose");
+        n_pri.param<double>("scan_match_point_spacing", scan_match_point_spacing, 0.05);
+        n_pri.param<double>("scan_match_window_xy", scan_matcher_.options.window_xy, 0.3);
+        n_pri.param<double>("scan_match_window_yaw", scan_matcher_.options.window_yaw, 0.15);
+        n_pri.param<double>("scan_match_min_score", scan_matcher_.options.min_score, 0.4);
+        n_pri.param<double>("scan_match_max_range", scan_matcher_.options.max_range, 12.0);
+        double laser_x, laser_y, laser_yaw;
+        n_pri.param<double>("laser_offset_x", laser_x, 0.0);
+        n_pri.param<double>("laser_offset_y", laser_y, 0.0);
+        n_pri.param<double>("laser_offset_yaw", laser_yaw, 0.0);
+        laser_mount_ = SE2(laser_x, laser_y, laser_yaw);
+
     }
 
     // initialize prior density of filter
     void BR_pose_ekf::initialize(const Transform &prior, const Time &time)
     {
         // set prior of filter
-        ColumnVector prior_Mu(3);
-        decomposeTransform(prior, prior_Mu(1), prior_Mu(2), prior_Mu(3));
-        SymmetricMatrix prior_Cov(3);
-        for (unsigned int i = 1; i <= 3; i++)
-        {
-            for (unsigned int j = 1; j <= 3; j++)
-            {
-                if (i == j)
-                    prior_Cov(i, j) = pow(0.01, 2);
-                else
-                    prior_Cov(i, j) = 0;
-            }
-        }
-        prior_ = new Gaussian(prior_Mu, prior_Cov);
-        filter_ = new ExtendedKalmanFilter(prior_);
-        auto prior2_ = new Gaussian(prior_Mu, prior_Cov);
-        tmpfilter_ = new ExtendedKalmanFilter(prior2_);
+        Eigen::Vector3d prior_Mu;
+        decomposeTransform(prior, prior_Mu(0), prior_Mu(1), prior_Mu(2));
+        Eigen::Matrix3d prior_Cov = Eigen::Matrix3d::Identity() * pow(0.01, 2);
+        filter_.init(prior_Mu, prior_Cov);
+        tmpfilter_.init(prior_Mu, prior_Cov);
 
         // remember prior
         // addMeasurement(StampedTransform(prior, time, output_frame_, base_footprint_frame_));
@@ -336,7 +899,7 @@ namespace estimation
         filter_estimate_old_ = prior;
         filter_time_old_ = time;
 
-        transformer.set_m2b_cov(wraped2eigen(prior_Cov), time);
+        transformer.set_m2b_cov(prior_Cov, time);
 
         // filter initialized
         filter_inited = true;
@@ -351,95 +914,98 @@ namespace estimation
         y = trans.getOrigin().y();
         yaw = getYaw(trans.getRotation());
     };
-    void BR_pose_ekf::decomposeTransform(const Transform &trans, ColumnVector &vec)
+    void BR_pose_ekf::decomposeTransform(const Transform &trans, Eigen::Vector3d &vec)
     {
-        vec(1) = trans.getOrigin().x();
-        vec(2) = trans.getOrigin().y();
-        vec(3) = getYaw(trans.getRotation());
+        vec(0) = trans.getOrigin().x();
+        vec(1) = trans.getOrigin().y();
+        vec(2) = getYaw(trans.getRotation());
     };
 
     // correct for angle overflow
 
-    SymmetricMatrix BR_pose_ekf::cov2wraped(const boost::array<double, 9UL> &cov)
+    Eigen::Matrix3d BR_pose_ekf::downDim(const boost::array<double, 36UL> &dim6)
     {
-        SymmetricMatrix ret(3);
-
-        for (unsigned int i = 0; i < 3; i++)
-            for (unsigned int j = 0; j < 3; j++)
-                ret(i + 1, j + 1) = cov[3 * i + j];
-
-        return ret;
-    }
-    boost::array<double, 9UL> BR_pose_ekf::wraped2cov(const SymmetricMatrix &wraped)
-    {
-        boost::array<double, 9UL> ret;
-        for (unsigned int i = 0; i < 3; i++)
-            for (unsigned int j = 0; j < 3; j++)
-                ret[3 * i + j] = wraped(i + 1, j + 1);
-
-        return ret;
-    }
-    boost::array<double, 9UL> BR_pose_ekf::downDim(const boost::array<double, 36UL> &dim6)
-    {
-        boost::array<double, 9UL> ret;
+        Eigen::Matrix3d ret;
         for (unsigned int i = 0; i < 2; i++)
             for (unsigned int j = 0; j < 2; j++)
-                ret[3 * i + j] = dim6[6 * i + j];
+                ret(i, j) = dim6[6 * i + j];
 
-        ret[6] = dim6[30];
-        ret[7] = dim6[31];
-        ret[8] = dim6[35];
-        ret[2] = dim6[5];
-        ret[5] = dim6[11];
-        return ret;
-    }
-
-    MatrixWrapper::SymmetricMatrix BR_pose_ekf::eigen2wraped(const Eigen::MatrixXd &eig)
-    {
-        MatrixWrapper::SymmetricMatrix ret(eig.rows());
-        for (unsigned int i = 0; i < eig.rows(); i++)
-            for (unsigned int j = 0; j < eig.rows(); j++)
-                ret(i + 1, j + 1) = eig(i, j);
+        ret(2, 0) = dim6[30];
+        ret(2, 1) = dim6[31];
+        ret(2, 2) = dim6[35];
+        ret(0, 2) = dim6[5];
+        ret(1, 2) = dim6[11];
         return ret;
     }
 
     void BR_pose_ekf::newloCallback(const laser_odomConstPtr &lo)
     {
-        boost::mutex::scoped_lock(lo_mutex);
-
-        assert(use_lo);
-        std::cout << "lo** ined" << std::endl;
-        if (lo->header.stamp < fuser.last_filt_time)
-            return;
+        assert(use_lo || use_scan_match);
+        ROS_DEBUG_STREAM("lo in: " << lo->header.stamp);
+        // 晚到的量测由 fuser 插到自己的时间戳上，过旧的会被丢弃
 
         lo_stamp_ = lo->header.stamp;
-        poseMsgToTF(lo->pose.pose, lo_meas_);
+        SE2 meas = SE2::fromPose(lo->pose.pose);
 
-        TransformStorage o2b, tp;
-        if (!transformer.o2b_list.getData(lo_stamp_, o2b))
-        {
-            transformer.o2b_list.getData(Time(0), o2b);
+        PoseHistory::Sample frames;
+        if (!transformer.lookup_frames(lo_stamp_, frames))
             ROS_ERROR("no lo stamp find");
-        };
-
-        if (!transformer.true_pose_list.getData(lo_stamp_, tp))
+        if (use_reloc && reloc_lost_count > 0)
         {
-            transformer.true_pose_list.getData(Time(0), tp);
+            // lo 与估计连续多帧对不上，认为估计已经丢失
+            SE2 d = (frames.pose(PoseHistory::M2O) * frames.pose(PoseHistory::O2B)).between(meas);
+            if (hypot(d.x, d.y) <= reloc_lost_dist && fabs(d.yaw()) <= reloc_lost_yaw)
+                lo_outliers_ = 0;
+            else if (++lo_outliers_ >= reloc_lost_count)
+            {
+                requestRelocalization(lo_stamp_, "laser pose disagrees with the estimate");
+                lo_outliers_ = 0;
+            }
         }
 
-        tf::Transform o2bTran(o2b.rotation_, o2b.translation_);
-        tf::Transform tpTran(tp.rotation_, tp.translation_);
-
-        pose_factor::Ptr lo_factor(new pose_factor());
+        pose_factor::Ptr lo_factor = pose_factor::create();
+        if (!lo_factor)
+        {
+            ROS_WARN_THROTTLE(1, "pose_factor pool exhausted, measurement dropped");
+            return;
+        }
         lo_factor->stamp = lo_stamp_;
-        lo_factor->woTrans = o2bTran;
+        lo_factor->woTrans = frames.pose(PoseHistory::O2B);
         // TODO
-        lo_factor->cov = wraped2eigen(cov2wraped(downDim(lo->pose.covariance)));      
-        std::cout<<"lo_factor->cov"<<lo_factor->cov<<std::endl;
+        lo_factor->cov = downDim(lo->pose.covariance);
         // lo_factor->cov = Eigen::Matrix3d::Identity();
 
-        lo_factor->measurement = lo_meas_;
-        fuser.addMeasurements(lo_factor);
+        lo_factor->measurement = meas;
+        bool fused = fuser.addMeasurements(lo_factor);
+        pose_fuser::MeasurementCheck check = fuser.lastCheck();
+        if (debug_)
+            ROS_INFO_STREAM("lo " << lo_stamp_ << " nis " << check.nis << " wheel nis " << check.wheel_nis
+                                  << (check.verdict == NisGate::REJECT ? " rejected" : check.verdict == NisGate::DOWNWEIGHT ? " downweighted" : "")
+                                  << (check.slip ? " slip" : "") << "\ncov\n"
+                                  << lo_factor->cov);
+        if (logger_.isOpen())
+        {
+            // 融合后的状态和新息在量测自己的时间戳上
+            pose_fuser::Snapshot snap;
+            Eigen::Vector3d z = meas.vec();
+            if (fused && fuser.snapshotAt(lo_stamp_, snap))
+            {
+                uint32_t flags = FilterLogRecord::FLAG_MEASUREMENT;
+                if (check.verdict == NisGate::DOWNWEIGHT)
+                    flags |= FilterLogRecord::FLAG_DOWNWEIGHTED;
+                if (check.slip)
+                    flags |= FilterLogRecord::FLAG_WHEEL_SLIP;
+                logUpdate(snap.x, snap.P, z, flags);
+                for (int i = 0; i < 3; ++i)
+                    log_rec_.nu[i] = snap.nu(i);
+            }
+            else
+            {
+                logUpdate(Eigen::Vector3d::Zero(), Eigen::Matrix3d::Zero(), z, FilterLogRecord::FLAG_REJECTED);
+            }
+            log_rec_.nis = check.nis;
+            FilterLogRecord::packCov(lo_factor->cov.data(), log_rec_.R);
+        }
 
         // ColumnVector meas_vec(3);
         // decomposeTransform(lo_meas_, meas_vec);
@@ -514,8 +1080,6 @@ namespace estimation
     }
     void BR_pose_ekf::loCallback(const laser_odomConstPtr &lo)
     {
-        boost::mutex::scoped_lock(lo_mutex);
-
         assert(use_lo);
         while (filter_time_old_ < lo->header.stamp)
         {
@@ -528,17 +1092,9 @@ namespace estimation
         lo_callback_counter_++;
         lo_stamp_ = lo->header.stamp;
         poseMsgToTF(lo->pose.pose, lo_meas_);
-        TransformStorage m2o, o2b, tp;
-        if ((!transformer.m2o_list.getData(lo_stamp_, m2o)) || (!transformer.o2b_list.getData(lo_stamp_, o2b)))
-        {
-            transformer.m2o_list.getData(Time(0), m2o);
-            transformer.o2b_list.getData(Time(0), o2b);
+        PoseHistory::Sample frames;
+        if (!transformer.lookup_frames(lo_stamp_, frames))
             ROS_ERROR("no lo stamp find");
-        };
-        if (!transformer.true_pose_list.getData(lo_stamp_, tp))
-        {
-            transformer.true_pose_list.getData(Time(0), tp);
-        }
         // if (!filter_inited)
         // {
         //     // init filter
@@ -552,17 +1108,17 @@ namespace estimation
             lo_inited = true;
         }
 
-        tf::Transform m2oTran(transformer.map2odom), o2bTran(o2b.rotation_, o2b.translation_); // 原来是 m2oTran(m2o.rotation_, m2o.translation_) ，为了测试使用新的m2o而不是根据时间戳
-        tf::Transform priTran, tpTran(tp.rotation_, tp.translation_);
+        tf::Transform m2oTran(transformer.get_m2o()), o2bTran(frames.transform(PoseHistory::O2B)); // 原来是 m2oTran(frames.transform(PoseHistory::M2O)) ，为了测试使用新的m2o而不是根据时间戳
+        tf::Transform priTran, tpTran(frames.transform(PoseHistory::TRUE_POSE));
         tf::Transform postTran;
         uncertain_tf::CovarianceStorage priCov;
         transformer.lookupPoseAndCov(lo_stamp_, priTran, priCov);
 
-        ColumnVector meas_vec(3);
+        Eigen::Vector3d meas_vec;
         decomposeTransform(lo_meas_, meas_vec);
-        ColumnVector pri_vec(3);
+        Eigen::Vector3d pri_vec;
         decomposeTransform(priTran, pri_vec);
-        angleOverflowCorrect(meas_vec(3), pri_vec(3));
+        angleOverflowCorrect(meas_vec(2), pri_vec(2));
 
         // TODO
         // 获取stamp的位姿、协方差
@@ -576,32 +1132,27 @@ namespace estimation
         // 可以只要cache？两个cache维护，发布只发布最新的即可？
 
         // update filter
-        MatrixWrapper::ColumnVector tmpvec(3);
+        Eigen::Vector3d tmpvec;
 
         decomposeTransform(tpTran, tmpvec);
-        cout << "tpvec: " << tmpvec << endl;
-        cout << "lo pri: " << pri_vec << endl;
+        cout << "tpvec: " << tmpvec.transpose() << endl;
+        cout << "lo pri: " << pri_vec.transpose() << endl;
 
-        tmpfilter_->PostGet()->ExpectedValueSet(pri_vec);
+        setPrior(tmpfilter_, pri_vec, priCov);
         // // TODO 需要考虑滤波器的设计，状态数量，以及记得对lo数据进行tf，变到base_footprint下
-        tmpfilter_->PostGet()->CovarianceSet(eigen2wraped(priCov.covariance_));
-        // cout << "lastvec: " << tmpfilter_->PostGet()->ExpectedValueGet() << endl;
-        boost::array<double, 9UL> cov3x3 = downDim(lo->pose.covariance);
-        // cout << cov2wraped(cov3x3) << endl;
-        // lo_meas_pdf_->AdditiveNoiseSigmaSet(cov2wraped(cov3x3));
-        angleOverflowCorrect(meas_vec(3), tmpfilter_->PostGet()->ExpectedValueGet()(3));
-        cout << "filter cov: " << tmpfilter_->PostGet()->CovarianceGet() << endl;
-        cout << "sys cov: " << sys_model_->SystemPdfGet()->CovarianceGet() << endl;
-        cout << "lo cov: " << lo_meas_model_->MeasurementPdfGet()->CovarianceGet() << endl;
-
-        tmpfilter_->Update(sys_model_, MatrixWrapper::ColumnVector(3) = 0, lo_meas_model_, meas_vec);
-        customizAngle_in_fabsPi(tmpfilter_->PostGet()->ExpectedValueGet()(3));
-        auto post_vec = tmpfilter_->PostGet()->ExpectedValueGet();
-        auto post_cov = tmpfilter_->PostGet()->CovarianceGet();
+        // lo_meas_cov_ = downDim(lo->pose.covariance);
+        angleOverflowCorrect(meas_vec(2), tmpfilter_.state()(2));
+        cout << "filter cov: " << tmpfilter_.covariance() << endl;
+        cout << "sys cov: " << sys_cov_ << endl;
+        cout << "lo cov: " << lo_meas_cov_ << endl;
+
+        filterUpdate(tmpfilter_, Eigen::Vector3d::Zero(), lo_meas_cov_, meas_vec);
+        customizAngle_in_fabsPi(tmpfilter_.state()(2));
+        Eigen::Vector3d post_vec = tmpfilter_.state();
 
         ColumnVector2Transform(post_vec, postTran);
-        cout << "laser odom: " << meas_vec << endl;
-        cout << "lo post: " << post_vec << endl;
+        cout << "laser odom: " << meas_vec.transpose() << endl;
+        cout << "lo post: " << post_vec.transpose() << endl;
 
         // output_.header.frame_id = map_frame;
         // output_.header.stamp = lo_stamp_;
@@ -618,12 +1169,12 @@ namespace estimation
         transformer.set_m2o(postTran * o2bTran.inverse(), ros::Time::now());
         // transformer.set_m2o(m2oTran * o2bTran * priTran.inverse() * lo_meas_ * o2bTran.inverse(), ros::Time::now());
 
-        decomposeTransform(transformer.map2odom * o2bTran, meas_vec);
-        cout << "corrected : " << meas_vec << endl;
+        decomposeTransform(transformer.get_m2o() * o2bTran, meas_vec);
+        cout << "corrected : " << meas_vec.transpose() << endl;
         // decomposeTransform(lo_meas_, post_vec);
 
-        auto err = (post_vec - meas_vec);
-        ROS_WARN_STREAM_COND(fabs(err(1)) + fabs(err(2)) > 1e-4, "err too much: " << err);
+        Eigen::Vector3d err = (post_vec - meas_vec);
+        ROS_WARN_STREAM_COND(fabs(err(0)) + fabs(err(1)) > 1e-4, "err too much: " << err.transpose());
         // tf::Quaternion q;
         // q.setRPY(0, 0, filter_estimate_old_vec_(3));
         // filter_estimate_old_ = tf::Transform(q, Vector3(filter_estimate_old_vec_(1), filter_estimate_old_vec_(2), 0));
@@ -631,15 +1182,19 @@ namespace estimation
         ROS_INFO_STREAM("lo out: " << ros::Time::now() << endl);
     }
 
-    Eigen::MatrixXd BR_pose_ekf::wraped2eigen(const MatrixWrapper::SymmetricMatrix &wraped)
+    // 与 BFL ExtendedKalmanFilter::Update(sys, u, meas, z) 相同：先按系统模型预测，再用全状态观测更新
+    void BR_pose_ekf::filterUpdate(FixedEKF<3> &filter, const Eigen::Vector3d &u, const Eigen::Matrix3d &meas_cov, const Eigen::Vector3d &z)
     {
-        Eigen::MatrixXd ret;
-        ret = Eigen::MatrixXd::Zero(wraped.size1(), wraped.size1());
-        for (unsigned int i = 0; i < ret.rows(); i++)
-            for (unsigned int j = 0; j < ret.rows(); j++)
-                ret(i, j) = wraped(i + 1, j + 1);
+        filter.predict<3>(sys_A_, sys_B_, u, sys_cov_);
+        filter.updateIdentity(z - filter.state(), meas_cov);
+    }
 
-        return ret;
+    void BR_pose_ekf::setPrior(FixedEKF<3> &filter, const Eigen::Vector3d &pose, const uncertain_tf::CovarianceStorage &cov)
+    {
+        filter.state() = pose;
+        // 缓存里可能还没有协方差（初始化时存的是零矩阵），此时保留滤波器原有的协方差
+        if (!cov.covariance_.isZero())
+            filter.covariance() = cov.covariance_;
     }
 
     void BR_pose_ekf::voCallback(const visual_odomConstPtr &vo)
@@ -647,34 +1202,27 @@ namespace estimation
         assert(use_vo);
         vo_stamp_ = vo->header.stamp;
         poseMsgToTF(vo->pose.pose, vo_meas_);
-        TransformStorage m2o, o2b;
-        if ((!transformer.m2o_list.getData(vo_stamp_, m2o)) || (!transformer.o2b_list.getData(vo_stamp_, o2b)))
-        {
-            transformer.m2o_list.getData(Time(0), m2o);
-            transformer.o2b_list.getData(Time(0), o2b);
+        PoseHistory::Sample frames;
+        if (!transformer.lookup_frames(vo_stamp_, frames))
             ROS_ERROR("no wo stamp find");
-        };
-        tf::Transform m2oTran(m2o.rotation_, m2o.translation_), o2bTran(o2b.rotation_, o2b.translation_);
+        tf::Transform m2oTran(frames.transform(PoseHistory::M2O)), o2bTran(frames.transform(PoseHistory::O2B));
         tf::Transform priTran;
         tf::Transform postTran;
         uncertain_tf::CovarianceStorage priCov;
         transformer.lookupPoseAndCov(vo_stamp_, priTran, priCov);
-        ColumnVector meas_vec(3);
+        Eigen::Vector3d meas_vec;
         decomposeTransform(vo_meas_, meas_vec);
-        ColumnVector pri_vec(3);
+        Eigen::Vector3d pri_vec;
         decomposeTransform(priTran, pri_vec);
-        angleOverflowCorrect(meas_vec(3), pri_vec(3));
+        angleOverflowCorrect(meas_vec(2), pri_vec(2));
 
-        tmpfilter_->PostGet()->ExpectedValueSet(pri_vec);
+        setPrior(tmpfilter_, pri_vec, priCov);
         // TODO 需要考虑滤波器的设计，状态数量，以及记得对lo数据进行tf，变到base_footprint下
-        tmpfilter_->PostGet()->CovarianceSet(eigen2wraped(priCov.covariance_));
 
-        boost::array<double, 9UL> cov3x3 = downDim(vo->pose.covariance);
-        vo_meas_pdf_->AdditiveNoiseSigmaSet(cov2wraped(cov3x3));
-        tmpfilter_->Update(sys_model_, MatrixWrapper::ColumnVector(3) = 0, vo_meas_model_, meas_vec);
+        vo_meas_cov_ = downDim(vo->pose.covariance);
+        filterUpdate(tmpfilter_, Eigen::Vector3d::Zero(), vo_meas_cov_, meas_vec);
 
-        auto post_vec = filter_->PostGet()->ExpectedValueGet();
-        auto post_cov = filter_->PostGet()->CovarianceGet();
+        Eigen::Vector3d post_vec = filter_.state();
         ColumnVector2Transform(post_vec, postTran);
 
         // pri * corr = post;
@@ -692,67 +1240,191 @@ namespace estimation
     void BR_pose_ekf::woCallback2(const wheel_odomConstPtr &odom)
     {
         assert(use_wo);
-        ROS_INFO_STREAM("wo in**: " << ros::Time::now() << endl
-                                  << "stamp: " << odom->header.stamp);
+        ROS_DEBUG_STREAM("wo in: " << ros::Time::now() << endl
+                                   << "stamp: " << odom->header.stamp);
 
-        tf::poseMsgToTF(odom->pose.pose, wo_meas_);
-        auto tr = wo_meas_.getOrigin();
-        tr.setZ(0);
-        wo_meas_.setOrigin(tr);
-        MatrixWrapper::ColumnVector odom_vec(3);
+        // 只取平面分量，z 与横滚俯仰丢掉
+        SE2 wo = SE2::fromPose(odom->pose.pose);
+        Eigen::Vector3d odom_vec;
         wo_stamp_ = odom->header.stamp;
-        tf::Transform curr_m2o = transformer.map2odom;
+        SE2 curr_m2o = SE2::fromTransform(transformer.get_m2o());
         // transformer.set_m2o(transformer.map2odom, wo_stamp_);
         // transformer.set_o2b(m2otf.inverse() * filter_estimate_old_, wo_stamp_);
-        transformer.set_o2b(wo_meas_, wo_stamp_);
+        transformer.set_o2b(wo, wo_stamp_);
+        fuser.addOdometry(wo, wo_stamp_);
+        Eigen::Vector3d o2b_vec = wo.vec();
+        if (use_imu)
+        {
+            imu_predictor_.reset(wo_stamp_, o2b_vec, Eigen::Vector2d(odom->twist.twist.linear.x, odom->twist.twist.linear.y));
+        }
+        storeMotion(wo_stamp_, o2b_vec, odom->twist.twist.linear.x, odom->twist.twist.linear.y, odom->twist.twist.angular.z);
+        if (logger_.isOpen())
+        {
+            pose_fuser::Snapshot snap;
+            if (fuser.snapshotAt(wo_stamp_, snap))
+                logUpdate(snap.x, snap.P, o2b_vec, 0);
+        }
 
         // transformer.set_m2b_cov(wraped2eigen(cov2wraped(downDim(odom->pose.covariance))), wo_stamp_);
-        MatrixWrapper::SymmetricMatrix wo_cov(3);
-        for (unsigned int i = 1; i <= 2; i++)
+        Eigen::Matrix3d wo_cov = Eigen::Matrix3d::Zero();
+        for (unsigned int i = 0; i < 2; i++)
             wo_cov(i, i) = pow(0.16, 2);
-        wo_cov(3, 3) = 9e-2;
-        transformer.set_m2b_cov(wraped2eigen(wo_cov), wo_stamp_);
+        wo_cov(2, 2) = 9e-2;
+        transformer.set_m2b_cov(wo_cov, wo_stamp_);
 
         filter_time_old_ = wo_stamp_;
 
         // output_.pose.covariance = wraped2cov(filter_->PostGet()->CovarianceGet());
-        MatrixWrapper::ColumnVector ll(3);
-        decomposeTransform(curr_m2o, ll);
-        std::cout << "wo2zhong" << ll << std::endl;
-        filter_estimate_old_ = curr_m2o * wo_meas_;
-        decomposeTransform(filter_estimate_old_, odom_vec);
+        ROS_DEBUG_STREAM("wo m2o: " << curr_m2o.vec().transpose());
+        SE2 m2b = curr_m2o * wo;
+        filter_estimate_old_ = m2b.toTransform();
+        odom_vec = m2b.vec();
 
-        angleOverflowCorrect(odom_vec(3), filter_->PostGet()->ExpectedValueGet()(3));
+        angleOverflowCorrect(odom_vec(2), filter_.state()(2));
 
-        filter_->Update(sys_model_, ColumnVector(3) = 0, wo_meas_model_, odom_vec);
+        filterUpdate(filter_, Eigen::Vector3d::Zero(), wo_meas_cov_, odom_vec);
         // cout << "wo filter cov: " << filter_->PostGet()->CovarianceGet() << endl;
         // cout << "wo sys cov: " << sys_model_->SystemPdfGet()->CovarianceGet() << endl;
         // cout << "wo lo cov: " << wo_meas_model_->MeasurementPdfGet()->CovarianceGet() << endl;
 
-        customizAngle_in_fabsPi(filter_->PostGet()->ExpectedValueGet()(3));
-        auto post_vec = filter_->PostGet()->ExpectedValueGet();
-        auto post_cov = filter_->PostGet()->CovarianceGet();
-        double ot = tf::getYaw(latest_true_pose.pose.pose.orientation);
-        angleOverflowCorrect(ot, post_vec(3));
+        customizAngle_in_fabsPi(filter_.state()(2));
         // ColumnVector2Transform(post_vec, filter_estimate_old_);
+        EKF_LATENCY(update_done_ns_ = ros::WallTime::now().toNSec());
 
         output_.header.frame_id = map_frame;
         output_.header.stamp = odom->header.stamp;
-        poseTFToMsg(filter_estimate_old_, output_.pose.pose);
+        m2b.toPose(output_.pose.pose);
         pose_pub.publish(output_);
 
-        output_compensation.header.frame_id = map_frame;
-        output_compensation.header.stamp = odom->header.stamp;
-        poseTFToMsg(transformer.map2odom, output_compensation.pose.pose);
-        compensation_pub.publish(output_compensation);
+        // 一次读出成对的变换，避免与 lo 线程的更新交错
+        tf::StampedTransform m2o, o2b;
+        transformer.get_frames(m2o, o2b);
+        if (output_rate <= 0)
+        {
+            output_compensation.header.frame_id = map_frame;
+            output_compensation.header.stamp = odom->header.stamp;
+            poseTFToMsg(m2o, output_compensation.pose.pose);
+            compensation_pub.publish(output_compensation);
+        }
 
         if (broadcastTF)
         {
-            pose_broadcaster_.sendTransform(StampedTransform(transformer.map2odom, odom->header.stamp, map_frame, odom_frame));
-            pose_broadcaster_.sendTransform(StampedTransform(transformer.odom2basefootprint, odom->header.stamp, odom_frame, base_footprint_frame));
+            pose_broadcaster_.sendTransform(StampedTransform(m2o, odom->header.stamp, map_frame, odom_frame));
+            pose_broadcaster_.sendTransform(StampedTransform(o2b, odom->header.stamp, odom_frame, base_footprint_frame));
         }
     }
 
+    void BR_pose_ekf::imuCallback(const imuConstPtr &imu)
+    {
+        assert(use_imu);
+        imu_callback_counter_++;
+        imu_stamp_ = imu->header.stamp;
+        // 撞击后用之后的第一帧激光确认位姿
+        if (reloc_collision_accel > 0 && hypot(imu->linear_acceleration.x, imu->linear_acceleration.y) > reloc_collision_accel)
+            requestRelocalization(imu_stamp_, "collision");
+        if (!imu_predictor_.predict(imu_stamp_, imu->angular_velocity.z,
+                                    Eigen::Vector2d(imu->linear_acceleration.x, imu->linear_acceleration.y)))
+            return;
+        const ImuPredictor::State &st = imu_predictor_.state();
+        storeMotion(st.stamp, st.pose, st.vel(0), st.vel(1), imu->angular_velocity.z);
+
+        // map2odom 取最新的，lo 修正后下一帧 IMU 就能体现
+        SE2 o2b(st.pose);
+        SE2 m2b = SE2::fromTransform(transformer.get_m2o()) * o2b;
+        PoseHistory::Sample frames;
+        transformer.lookup_frames(ros::Time(0), frames);
+        Eigen::Matrix3d cov = frames.cov + st.P;
+        EKF_LATENCY(update_done_ns_ = ros::WallTime::now().toNSec());
+
+        geometry_msgs::PoseWithCovarianceStamped out;
+        out.header.frame_id = map_frame;
+        out.header.stamp = imu_stamp_;
+        m2b.toPose(out.pose.pose);
+        // 6 维协方差的 x y yaw 位置
+        const int idx[3] = {0, 1, 5};
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                out.pose.covariance[6 * idx[i] + idx[j]] = cov(i, j);
+        pose_pub.publish(out);
+        if (logger_.isOpen())
+        {
+            logUpdate(m2b.vec(), cov, st.pose, 0);
+        }
+
+        if (broadcastTF)
+            pose_broadcaster_.sendTransform(StampedTransform(o2b.toTransform(), imu_stamp_, odom_frame, base_footprint_frame));
+    }
+
+    void BR_pose_ekf::storeMotion(const ros::Time &stamp, const Eigen::Vector3d &o2b, double vx, double vy, double wz)
+    {
+        // IMU 已经外推到更新的时刻时，晚到的里程计不覆盖
+        int64_t ns = stamp.toNSec();
+        if (ns < motion_.load().stamp)
+            return;
+        Motion m;
+        m.o2b[0] = o2b(0);
+        m.o2b[1] = o2b(1);
+        m.o2b[2] = o2b(2);
+        m.vel[0] = vx;
+        m.vel[1] = vy;
+        m.vel[2] = wz;
+        m.stamp = ns;
+        motion_.store(m);
+    }
+
+    void BR_pose_ekf::outputLoop(void)
+    {
+        ros::Rate rate(output_rate);
+        while (output_running_ && ros::ok())
+        {
+            publishExtrapolated(ros::Time::now());
+            rate.sleep();
+        }
+    }
+
+    void BR_pose_ekf::publishExtrapolated(const ros::Time &now)
+    {
+        Motion m = motion_.load();
+        if (m.stamp == 0)
+            return;
+        ros::Time source;
+        source.fromNSec(m.stamp);
+        // 只向前外推，且不超过上限，里程计断了也不会飞出去
+        double dt = std::min(std::max((now - source).toSec(), 0.0), max_extrapolation);
+
+        // 机体系匀速，航向取区间中点
+        double ym = m.o2b[2] + 0.5 * m.vel[2] * dt;
+        double c = cos(ym), sn = sin(ym);
+        SE2 o2b(m.o2b[0] + (c * m.vel[0] - sn * m.vel[1]) * dt,
+                m.o2b[1] + (sn * m.vel[0] + c * m.vel[1]) * dt,
+                m.o2b[2] + m.vel[2] * dt);
+        tf::Transform m2o = transformer.get_m2o();
+        PoseHistory::Sample frames;
+        transformer.lookup_frames(ros::Time(0), frames);
+
+        ekf_pose_fusion::ExtrapolatedPose out;
+        out.header.frame_id = map_frame;
+        out.header.stamp = now;
+        (SE2::fromTransform(m2o) * o2b).toPose(out.pose.pose);
+        const int idx[3] = {0, 1, 5};
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                out.pose.covariance[6 * idx[i] + idx[j]] = frames.cov(i, j);
+        out.twist.linear.x = m.vel[0];
+        out.twist.linear.y = m.vel[1];
+        out.twist.angular.z = m.vel[2];
+        out.source_stamp = source;
+        out.extrapolation_age = (now - source).toSec();
+        extrapolated_pub.publish(out);
+
+        nav_msgs::Odometry comp;
+        comp.header.frame_id = map_frame;
+        comp.header.stamp = now;
+        poseTFToMsg(m2o, comp.pose.pose);
+        compensation_pub.publish(comp);
+        EKF_LATENCY(latency_->hist[LatencyStats::OUTPUT][LatencyStats::TOTAL].record((ros::Time::now() - source).toNSec()));
+    }
+
     void BR_pose_ekf::woCallback(const wheel_odomConstPtr &odom)
     {
         assert(use_wo);
@@ -764,27 +1436,20 @@ namespace estimation
 
         tf::poseMsgToTF(odom->pose.pose, wo_meas_);
         wo_stamp_ = odom->header.stamp;
-        TransformStorage m2o, o2b, tp;
-        if ((!transformer.m2o_list.getData(wo_stamp_, m2o)) || (!transformer.o2b_list.getData(wo_stamp_, o2b)))
-        {
-            transformer.m2o_list.getData(Time(0), m2o);
-            transformer.o2b_list.getData(Time(0), o2b);
-        };
-        if (!transformer.true_pose_list.getData(wo_stamp_, tp))
-        {
-            transformer.true_pose_list.getData(Time(0), tp);
+        PoseHistory::Sample frames;
+        if (!transformer.lookup_frames(wo_stamp_, frames))
             ROS_ERROR("true pose not find");
-        }
-        ColumnVector m2ovec(3);
+        tf::Transform m2o = frames.transform(PoseHistory::M2O);
+        Eigen::Vector3d m2ovec;
         // decomposeTransform(Transform(m2o.rotation_, m2o.translation_), m2ovec);
         // cout << "m2ovec: " << m2ovec << endl;
-        ColumnVector o2bvec(3);
+        Eigen::Vector3d o2bvec;
         // decomposeTransform(Transform(o2b.rotation_, o2b.translation_), o2bvec);
         // cout << "o2bvec: " << o2bvec << endl;
         // ColumnVector tpvec(3);
 
-        decomposeTransform(tf::Transform(tp.rotation_, tp.translation_), o2bvec);
-        cout << "tpvec: " << o2bvec << endl;
+        decomposeTransform(frames.transform(PoseHistory::TRUE_POSE), o2bvec);
+        cout << "tpvec: " << o2bvec.transpose() << endl;
 
         // if (!filter_inited)
         // {
@@ -798,11 +1463,11 @@ namespace estimation
             wo_inited = true;
         }
 
-        ColumnVector odom_rel(3);
-        decomposeTransform(Transform(m2o.rotation_, m2o.translation_) * wo_meas_, odom_rel);
-        angleOverflowCorrect(odom_rel(3), filter_estimate_old_vec_(3));
-        cout << "wo : " << odom_rel << endl;
-        cout << "last: " << filter_->PostGet()->ExpectedValueGet() << endl;
+        Eigen::Vector3d odom_rel;
+        decomposeTransform(m2o * wo_meas_, odom_rel);
+        angleOverflowCorrect(odom_rel(2), filter_estimate_old_vec_(2));
+        cout << "wo : " << odom_rel.transpose() << endl;
+        cout << "last: " << filter_.state().transpose() << endl;
         // wheel odom cov处理：降维、转类型、做R * cov * R'变换
         {
             // MatrixWrapper::SymmetricMatrix 2dCov;
@@ -827,26 +1492,25 @@ namespace estimation
             // cout << "true vel: " << vel_o.getX() << ", " << vel_o.getY() << ", " << vel_o.getZ() << endl;
             vel_o *= (odom->header.stamp - last_wo_time_).toSec();
 
-            tf::Vector3 ve = Transform(m2o.rotation_) * vel_o;
+            tf::Vector3 ve = Transform(m2o.getRotation()) * vel_o;
             // TODO 获取stamp的变换并进行vector的坐标系转换
             // transformer.transformVector(map_frame, wo_stamp_, Stamped<Vector3>(vel_o, Time(0), odom->header.frame_id), map_frame, ve);
-            ColumnVector vel(3);
-            vel = 0;
-            vel(1) = ve.getX();
-            vel(2) = ve.getY();
-            vel(3) = ve.getZ();
+            Eigen::Vector3d vel;
+            vel(0) = ve.getX();
+            vel(1) = ve.getY();
+            vel(2) = ve.getZ();
             // cout << "vel: " << vel << endl;
-            filter_->Update(sys_model_, vel, wo_meas_model_, odom_rel);
+            filterUpdate(filter_, vel, wo_meas_cov_, odom_rel);
         }
         else
-            filter_->Update(sys_model_, ColumnVector(3) = 0, wo_meas_model_, odom_rel);
+            filterUpdate(filter_, Eigen::Vector3d::Zero(), wo_meas_cov_, odom_rel);
 
-        filter_estimate_old_vec_ = filter_->PostGet()->ExpectedValueGet();
-        MatrixWrapper::SymmetricMatrix est_cov = filter_->PostGet()->CovarianceGet();
-        std::cout << "post: " << filter_estimate_old_vec_ << std::endl;
+        filter_estimate_old_vec_ = filter_.state();
+        Eigen::Matrix3d est_cov = filter_.covariance();
+        std::cout << "post: " << filter_estimate_old_vec_.transpose() << std::endl;
         tf::Quaternion q;
-        q.setRPY(0, 0, filter_estimate_old_vec_(3));
-        filter_estimate_old_ = Transform(q, Vector3(filter_estimate_old_vec_(1), filter_estimate_old_vec_(2), 0));
+        q.setRPY(0, 0, filter_estimate_old_vec_(2));
+        filter_estimate_old_ = Transform(q, Vector3(filter_estimate_old_vec_(0), filter_estimate_old_vec_(1), 0));
 
         filter_time_old_ = odom->header.stamp;
 
@@ -854,18 +1518,18 @@ namespace estimation
         last_wo_twist_ = odom->twist.twist;
 
         // publish tf and topic
-        auto m2otf = Transform(m2o.rotation_, m2o.translation_);
+        auto m2otf = m2o;
         transformer.set_m2o(m2otf, wo_stamp_);
-        auto m2orot = Transform(m2o.rotation_, tf::Vector3(0, 0, 0));
+        auto m2orot = Transform(m2o.getRotation(), tf::Vector3(0, 0, 0));
 
         // transformer.set_o2b(m2otf.inverse() * filter_estimate_old_, wo_stamp_);
         transformer.set_o2b(wo_meas_, wo_stamp_);
 
-        transformer.set_m2b_cov(wraped2eigen(est_cov), wo_stamp_);
+        transformer.set_m2b_cov(est_cov, wo_stamp_);
         // 加入cov
 
         // TODO 多加spiner，但是不要对wo和lo使用不同的queue，同一queue能保证时间序列的
-        cout << "length" << transformer.m2b_cov_list.storage_.size() << endl;
+        cout << "length" << transformer.history.size() << endl;
 
         output_.header.frame_id = map_frame;
         output_.header.stamp = odom->header.stamp;
@@ -0,0 +1,153 @@
+// 对比 BFL ExtendedKalmanFilter 与 FixedEKF<3> 的单次更新开销，以及 pose_factor 池与 make_shared
+// 用法：ekf_update_bench [updates=200000]
+// 两条路径走 pose_fuser 量测更新的同一套流程：设置量测协方差 -> Update(sys, 0, meas, z)
+#include "ekf_pose_fusion/ekf_pose_fusion.hpp"
+#include <bfl/filter/extendedkalmanfilter.h>
+#include <bfl/wrappers/matrix/matrix_wrapper.h>
+#include <bfl/model/linearanalyticsystemmodel_gaussianuncertainty.h>
+#include <bfl/model/linearanalyticmeasurementmodel_gaussianuncertainty.h>
+#include <bfl/pdf/linearanalyticconditionalgaussian.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+// 统计堆分配次数
+static std::atomic<long> g_allocs(0);
+void *operator new(size_t size)
+{
+    ++g_allocs;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+using namespace estimation;
+typedef std::chrono::steady_clock bench_clock;
+
+struct Result
+{
+    double ns;
+    double allocs;
+};
+
+static void report(const char *name, const Result &r)
+{
+    printf("%-28s %10.1f ns/update %8.2f allocs/update\n", name, r.ns, r.allocs);
+}
+
+template <class F>
+static Result run(int n, F &&body)
+{
+    long a0 = g_allocs;
+    auto t0 = bench_clock::now();
+    for (int i = 0; i < n; ++i)
+        body(i);
+    auto t1 = bench_clock::now();
+    Result r;
+    r.ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+    r.allocs = double(g_allocs - a0) / n;
+    return r;
+}
+
+// 与原 eigen2wraped 相同
+static MatrixWrapper::SymmetricMatrix eigen2wraped(const Eigen::Matrix3d &eig)
+{
+    MatrixWrapper::SymmetricMatrix ret(3);
+    for (unsigned int i = 0; i < 3; i++)
+        for (unsigned int j = 0; j < 3; j++)
+            ret(i + 1, j + 1) = eig(i, j);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+    if (n <= 0)
+        n = 200000;
+
+    // 预先生成量测，避免随机数计入更新时间
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0, 0.01);
+    std::vector<Eigen::Vector3d> z(1024);
+    std::vector<Eigen::Matrix3d> R(1024);
+    for (size_t i = 0; i < z.size(); ++i)
+    {
+        z[i] << 1 + noise(rng), 2 + noise(rng), 0.5 + noise(rng);
+        R[i] = Eigen::Matrix3d::Identity() * (1e-4 + fabs(noise(rng)) * 1e-2);
+    }
+    std::vector<MatrixWrapper::ColumnVector> zw(z.size(), MatrixWrapper::ColumnVector(3));
+    for (size_t i = 0; i < z.size(); ++i)
+        for (int k = 0; k < 3; ++k)
+            zw[i](k + 1) = z[i](k);
+
+    // BFL：与原 pose_fuser 相同的模型
+    MatrixWrapper::ColumnVector mu(3);
+    mu = 0;
+    MatrixWrapper::SymmetricMatrix zero_cov(3);
+    zero_cov = 0;
+    MatrixWrapper::Matrix A(3, 3), B(3, 3), H(3, 3);
+    A = 0;
+    B = 0;
+    H = 0;
+    for (int i = 1; i <= 3; ++i)
+        A(i, i) = H(i, i) = 1.0;
+    B(1, 1) = B(2, 1) = B(3, 3) = 1.0;
+    std::vector<MatrixWrapper::Matrix> AB(2);
+    AB[0] = A;
+    AB[1] = B;
+    BFL::LinearAnalyticConditionalGaussian sys_pdf(AB, BFL::Gaussian(mu, zero_cov));
+    BFL::LinearAnalyticSystemModelGaussianUncertainty sys_model(&sys_pdf);
+    BFL::LinearAnalyticConditionalGaussian meas_pdf(H, BFL::Gaussian(mu, zero_cov));
+    BFL::LinearAnalyticMeasurementModelGaussianUncertainty meas_model(&meas_pdf);
+    MatrixWrapper::SymmetricMatrix prior_cov(3);
+    prior_cov = 0;
+    for (int i = 1; i <= 3; ++i)
+        prior_cov(i, i) = 1e-4;
+    BFL::Gaussian prior(mu, prior_cov);
+    BFL::ExtendedKalmanFilter bfl(&prior);
+    MatrixWrapper::ColumnVector u(3);
+    u = 0;
+
+    Result r_bfl = run(n, [&](int i) {
+        size_t k = i % z.size();
+        meas_pdf.AdditiveNoiseSigmaSet(eigen2wraped(R[k]));
+        bfl.Update(&sys_model, u, &meas_model, zw[k]);
+    });
+
+    FixedEKF<3> ekf;
+    ekf.init(Eigen::Vector3d::Zero(), Eigen::Matrix3d::Identity() * 1e-4);
+    Result r_fixed = run(n, [&](int i) {
+        size_t k = i % z.size();
+        ekf.updateIdentity(z[k] - ekf.state(), R[k]);
+    });
+
+    // 两者结果应一致
+    MatrixWrapper::ColumnVector bx = bfl.PostGet()->ExpectedValueGet();
+    double diff = 0;
+    for (int k = 0; k < 3; ++k)
+        diff = std::max(diff, fabs(bx(k + 1) - ekf.state()(k)));
+
+    // pose_factor：make_shared 与池
+    Result r_shared = run(n, [&](int i) {
+        auto f = std::make_shared<pose_factor>();
+        f->cov = R[i % R.size()];
+    });
+    Result r_pool = run(n, [&](int i) {
+        pose_factor::Ptr f = pose_factor::create();
+        f->cov = R[i % R.size()];
+    });
+
+    printf("updates: %d\n", n);
+    report("BFL ExtendedKalmanFilter", r_bfl);
+    report("FixedEKF<3>", r_fixed);
+    report("pose_factor make_shared", r_shared);
+    report("pose_factor pool", r_pool);
+    printf("speedup: %.1fx, max state diff: %.3g\n", r_bfl.ns / r_fixed.ns, diff);
+    return 0;
+}
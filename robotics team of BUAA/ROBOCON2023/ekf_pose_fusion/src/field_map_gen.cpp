@@ -0,0 +1,270 @@
+// 离线生成场地距离图文件，节点用参数 field_map_file 只读映射，启动时不再计算
+// 用法：field_map_gen <out.fmap> <segments.txt | map.pgm> [选项]
+//   segments.txt 每行 x1 y1 x2 y2（map 系，m），# 开头为注释，与参数 field_segments 含义相同
+//   map.pgm      二值化的场地图（P5），灰度低于 128 为障碍；行 0 在上，与 map_server 相同
+// 选项：
+//   levels=0.02:0.03,0.05:0.05  每层 分辨率:sigma，默认与扫描匹配、重定位的默认参数一致
+//   margin=0.5                  线段外扩范围 (m)
+//   max_distance=1.0            距离图截断值 (m)
+//   image_resolution=0.01       pgm 每像素边长 (m)
+//   origin=0,0                  pgm 左下角在 map 系的坐标
+#include "ekf_pose_fusion/field_map_file.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace estimation;
+
+static bool endsWith(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool readSegments(const std::string &path, std::vector<FieldSegment> &segments)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+        return false;
+    std::string line;
+    int no = 0;
+    while (std::getline(in, line))
+    {
+        ++no;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        std::istringstream ss(line);
+        FieldSegment s;
+        if (ss >> s.x1 >> s.y1 >> s.x2 >> s.y2)
+            segments.push_back(s);
+        else if (line.find_first_not_of(" \t\r") != std::string::npos)
+            fprintf(stderr, "%s:%d: expected x1 y1 x2 y2, ignored\n", path.c_str(), no);
+    }
+    return true;
+}
+
+// 只支持二进制 P5、maxval < 256；occupied 行 0 在下（已翻转为 map 系）
+static bool readPgm(const std::string &path, int &width, int &height, std::vector<uint8_t> &occupied)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::string magic;
+    int maxval = 0;
+    in >> magic;
+    auto skip = [&]()
+    {
+        while (in >> std::ws && in.peek() == '#')
+            in.ignore(1 << 20, '\n');
+    };
+    skip();
+    in >> width;
+    skip();
+    in >> height;
+    skip();
+    in >> maxval;
+    in.get();
+    if (!in || magic != "P5" || width <= 0 || height <= 0 || maxval <= 0 || maxval > 255)
+        return false;
+    std::vector<uint8_t> pix(size_t(width) * height);
+    if (!in.read(reinterpret_cast<char *>(pix.data()), pix.size()))
+        return false;
+    occupied.resize(pix.size());
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            occupied[size_t(height - 1 - y) * width + x] = pix[size_t(y) * width + x] * 2 < maxval;
+    return true;
+}
+
+// Felzenszwalb 一维平方距离变换：d[q] = min_p (q - p)^2 + f[p]
+static void edt1d(const float *f, int n, float *d, std::vector<int> &v, std::vector<float> &z)
+{
+    v.resize(n);
+    z.resize(n + 1);
+    int k = 0;
+    v[0] = 0;
+    z[0] = -INFINITY;
+    z[1] = INFINITY;
+    // 没有障碍时 f 为 1e20 而不是 inf，s 不会出现 nan
+    for (int q = 1; q < n; ++q)
+    {
+        float s = ((f[q] + float(q) * q) - (f[v[k]] + float(v[k]) * v[k])) / (2.0f * (q - v[k]));
+        while (s <= z[k])
+        {
+            --k;
+            s = ((f[q] + float(q) * q) - (f[v[k]] + float(v[k]) * v[k])) / (2.0f * (q - v[k]));
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = INFINITY;
+    }
+    k = 0;
+    for (int q = 0; q < n; ++q)
+    {
+        while (z[k + 1] < q)
+            ++k;
+        float dq = float(q - v[k]);
+        d[q] = dq * dq + f[v[k]];
+    }
+}
+
+// 二维欧氏距离变换，单位为像素
+static void edt2d(const std::vector<uint8_t> &occupied, int width, int height, std::vector<float> &dist)
+{
+    const float inf = 1e20f;
+    dist.resize(occupied.size());
+    for (size_t i = 0; i < occupied.size(); ++i)
+        dist[i] = occupied[i] ? 0.0f : inf;
+    std::vector<int> v;
+    std::vector<float> z, f(std::max(width, height)), d(std::max(width, height));
+    for (int x = 0; x < width; ++x)
+    {
+        for (int y = 0; y < height; ++y)
+            f[y] = dist[size_t(y) * width + x];
+        edt1d(f.data(), height, d.data(), v, z);
+        for (int y = 0; y < height; ++y)
+            dist[size_t(y) * width + x] = d[y];
+    }
+    for (int y = 0; y < height; ++y)
+    {
+        edt1d(&dist[size_t(y) * width], width, d.data(), v, z);
+        for (int x = 0; x < width; ++x)
+            dist[size_t(y) * width + x] = std::sqrt(d[x]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <out.fmap> <segments.txt|map.pgm> [levels=RES:SIGMA,...] [margin=M] "
+                        "[max_distance=M] [image_resolution=M] [origin=X,Y]\n",
+                argv[0]);
+        return 1;
+    }
+    std::string out = argv[1], input = argv[2];
+    std::vector<std::pair<double, double>> level_specs;
+    double margin = 0.5, max_distance = 1.0, image_resolution = 0.01, origin_x = 0, origin_y = 0;
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        size_t eq = a.find('=');
+        std::string key = a.substr(0, eq), val = eq == std::string::npos ? "" : a.substr(eq + 1);
+        if (key == "levels")
+        {
+            std::istringstream ss(val);
+            std::string item;
+            while (std::getline(ss, item, ','))
+            {
+                double r, s;
+                if (sscanf(item.c_str(), "%lf:%lf", &r, &s) != 2 || r <= 0 || s <= 0)
+                {
+                    fprintf(stderr, "bad level %s, expected RESOLUTION:SIGMA\n", item.c_str());
+                    return 1;
+                }
+                level_specs.push_back(std::make_pair(r, s));
+            }
+        }
+        else if (key == "margin")
+            margin = atof(val.c_str());
+        else if (key == "max_distance")
+            max_distance = atof(val.c_str());
+        else if (key == "image_resolution")
+            image_resolution = atof(val.c_str());
+        else if (key == "origin")
+            sscanf(val.c_str(), "%lf,%lf", &origin_x, &origin_y);
+        else
+            fprintf(stderr, "ignored argument: %s\n", argv[i]);
+    }
+    if (level_specs.empty())
+    {
+        level_specs.push_back(std::make_pair(0.02, 0.03)); // scan_match_resolution / scan_match_sigma
+        level_specs.push_back(std::make_pair(0.05, 0.05)); // reloc_resolution / reloc_sigma
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<FieldMapFile::LevelData> levels;
+    if (endsWith(input, ".pgm"))
+    {
+        int iw, ih;
+        std::vector<uint8_t> occupied;
+        if (!readPgm(input, iw, ih, occupied))
+        {
+            fprintf(stderr, "cannot read %s (binary P5 pgm expected)\n", input.c_str());
+            return 1;
+        }
+        std::vector<float> pixel_dist;
+        edt2d(occupied, iw, ih, pixel_dist);
+        // 每层格中心取最近像素的距离
+        for (const auto &spec : level_specs)
+        {
+            FieldMapFile::LevelData d;
+            d.resolution = spec.first;
+            d.sigma = spec.second;
+            d.origin_x = origin_x;
+            d.origin_y = origin_y;
+            d.max_distance = max_distance;
+            d.width = std::max(1, int(std::ceil(iw * image_resolution / d.resolution)));
+            d.height = std::max(1, int(std::ceil(ih * image_resolution / d.resolution)));
+            d.distance.resize(size_t(d.width) * d.height);
+            for (int y = 0; y < d.height; ++y)
+                for (int x = 0; x < d.width; ++x)
+                {
+                    int px = std::min(iw - 1, int((x + 0.5) * d.resolution / image_resolution));
+                    int py = std::min(ih - 1, int((y + 0.5) * d.resolution / image_resolution));
+                    d.distance[size_t(y) * d.width + x] = std::min(float(max_distance), float(pixel_dist[size_t(py) * iw + px] * image_resolution));
+                }
+            levels.push_back(std::move(d));
+        }
+    }
+    else
+    {
+        std::vector<FieldSegment> segments;
+        if (!readSegments(input, segments) || segments.empty())
+        {
+            fprintf(stderr, "no segments read from %s\n", input.c_str());
+            return 1;
+        }
+        double min_x = 1e9, min_y = 1e9, max_x = -1e9, max_y = -1e9;
+        for (const FieldSegment &s : segments)
+        {
+            min_x = std::min(min_x, std::min(s.x1, s.x2));
+            min_y = std::min(min_y, std::min(s.y1, s.y2));
+            max_x = std::max(max_x, std::max(s.x1, s.x2));
+            max_y = std::max(max_y, std::max(s.y1, s.y2));
+        }
+        // 与节点里由 field_segments 直接生成时的范围一致
+        for (const auto &spec : level_specs)
+        {
+            FieldMapFile::LevelData d;
+            d.resolution = spec.first;
+            d.sigma = spec.second;
+            d.origin_x = min_x - margin;
+            d.origin_y = min_y - margin;
+            d.max_distance = max_distance;
+            d.width = std::max(1, int(std::ceil((max_x - min_x + 2 * margin) / d.resolution)));
+            d.height = std::max(1, int(std::ceil((max_y - min_y + 2 * margin) / d.resolution)));
+            segmentDistance(segments, d.origin_x, d.origin_y, d.width, d.height, d.resolution, max_distance, d.distance);
+            levels.push_back(std::move(d));
+        }
+        printf("%zu segments\n", segments.size());
+    }
+
+    std::string error;
+    if (!FieldMapFile::write(out, levels, error))
+    {
+        fprintf(stderr, "cannot write field map: %s\n", error.c_str());
+        return 1;
+    }
+    for (const auto &d : levels)
+        printf("level %.3f m sigma %.3f: %dx%d cells, origin (%.3f, %.3f)\n", d.resolution, d.sigma, d.width, d.height,
+               d.origin_x, d.origin_y);
+    printf("wrote %s in %.1f ms\n", out.c_str(),
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+    return 0;
+}
@@ -0,0 +1,148 @@
+// 读取 BR_pose_ekf 写出的二进制滤波日志（参数 log_dir）
+// 用法：fusion_log_dump <log.bin> [summary] [type=wheel|laser|visual|imu|true_pose]
+//   默认输出 CSV（时间单位 s，耗时 us），summary 只输出各传感器的计数、耗时分位数与新息统计
+// 运行中的日志也可以读，只读到写线程最近一次同步的记录数
+#include "ekf_pose_fusion/binary_log.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace estimation;
+
+static const char *TYPE_NAMES[] = {"wheel", "laser", "visual", "imu", "true_pose", "output"};
+static const int TYPES = sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]);
+
+static const char *typeName(uint32_t t)
+{
+    return t < uint32_t(TYPES) ? TYPE_NAMES[t] : "unknown";
+}
+
+static double pct(std::vector<double> &v, double q)
+{
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, size_t(q * v.size()))];
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <log.bin> [summary] [type=NAME]\n", argv[0]);
+        return 1;
+    }
+    bool summary = false;
+    int only = -1;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "summary")
+            summary = true;
+        else if (a.compare(0, 5, "type=") == 0)
+        {
+            for (int t = 0; t < TYPES; ++t)
+                if (a.substr(5) == TYPE_NAMES[t])
+                    only = t;
+            if (only < 0)
+            {
+                fprintf(stderr, "unknown type: %s\n", a.c_str() + 5);
+                return 1;
+            }
+        }
+        else
+            fprintf(stderr, "ignored argument: %s\n", argv[i]);
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FilterLogHeader))
+    {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "cannot map %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    const FilterLogHeader *h = static_cast<const FilterLogHeader *>(map);
+    if (memcmp(h->magic, "EKFLOG1", 8) != 0 || h->record_size != sizeof(FilterLogRecord))
+    {
+        fprintf(stderr, "%s is not a filter log (or a different version)\n", argv[1]);
+        return 1;
+    }
+    // 写线程先写记录后写计数，计数以内的记录都是完整的
+    size_t count = std::min<size_t>(h->count, (st.st_size - sizeof(FilterLogHeader)) / sizeof(FilterLogRecord));
+    const FilterLogRecord *rec = reinterpret_cast<const FilterLogRecord *>(static_cast<const char *>(map) + sizeof(FilterLogHeader));
+
+    if (!summary)
+    {
+        printf("type,stamp,flags,x,y,yaw,p_xx,p_xy,p_xyaw,p_yy,p_yyaw,p_yawyaw,z_x,z_y,z_yaw,nu_x,nu_y,nu_yaw,"
+               "r_xx,r_xy,r_xyaw,r_yy,r_yyaw,r_yawyaw,m2o_x,m2o_y,m2o_yaw,nis,queue_us,update_us\n");
+        for (size_t i = 0; i < count; ++i)
+        {
+            const FilterLogRecord &r = rec[i];
+            if (only >= 0 && int(r.type) != only)
+                continue;
+            printf("%s,%.6f,%u", typeName(r.type), r.stamp_ns * 1e-9, r.flags);
+            const double *cols[] = {r.x, r.P, r.z, r.nu, r.R, r.m2o};
+            const int lens[] = {3, 6, 3, 3, 6, 3};
+            for (int c = 0; c < 6; ++c)
+                for (int k = 0; k < lens[c]; ++k)
+                    printf(",%.9g", cols[c][k]);
+            printf(",%.4g,%.1f,%.1f\n", r.nis, (r.start_ns - r.arrival_ns) / 1e3, (r.end_ns - r.start_ns) / 1e3);
+        }
+        return 0;
+    }
+
+    printf("%zu records, %llu dropped", count, (unsigned long long)h->dropped);
+    if (count)
+        printf(", %.1f s of data", (rec[count - 1].stamp_ns - rec[0].stamp_ns) * 1e-9);
+    printf("\n%-10s %8s %8s %8s %6s | %9s %9s %9s %9s | %9s %9s %9s %9s\n", "type", "count", "rejected", "downwt", "slip",
+           "queue_p50", "queue_p99", "upd_p50", "upd_p99", "nu_x_rms", "nu_y_rms", "nu_yaw_rms", "nis_mean");
+    for (int t = 0; t < TYPES; ++t)
+    {
+        if (only >= 0 && t != only)
+            continue;
+        std::vector<double> queue_us, update_us;
+        size_t rejected = 0, fused = 0, downweighted = 0, slips = 0;
+        double nu2[3] = {0, 0, 0}, nis = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const FilterLogRecord &r = rec[i];
+            if (int(r.type) != t)
+                continue;
+            queue_us.push_back((r.start_ns - r.arrival_ns) / 1e3);
+            update_us.push_back((r.end_ns - r.start_ns) / 1e3);
+            if (r.flags & FilterLogRecord::FLAG_REJECTED)
+                ++rejected;
+            if (r.flags & FilterLogRecord::FLAG_DOWNWEIGHTED)
+                ++downweighted;
+            if (r.flags & FilterLogRecord::FLAG_WHEEL_SLIP)
+                ++slips;
+            if (r.flags & FilterLogRecord::FLAG_MEASUREMENT)
+            {
+                ++fused;
+                for (int k = 0; k < 3; ++k)
+                    nu2[k] += r.nu[k] * r.nu[k];
+                nis += r.nis;
+            }
+        }
+        if (queue_us.empty())
+            continue;
+        size_t n = queue_us.size();
+        printf("%-10s %8zu %8zu %8zu %6zu | %9.1f %9.1f %9.1f %9.1f |", TYPE_NAMES[t], n, rejected, downweighted, slips,
+               pct(queue_us, 0.5), pct(queue_us, 0.99), pct(update_us, 0.5), pct(update_us, 0.99));
+        if (fused)
+            printf(" %9.4f %9.4f %9.4f %9.2f\n", sqrt(nu2[0] / fused), sqrt(nu2[1] / fused), sqrt(nu2[2] / fused), nis / fused);
+        else
+            printf(" %9s %9s %9s %9s\n", "-", "-", "-", "-");
+    }
+    return 0;
+}
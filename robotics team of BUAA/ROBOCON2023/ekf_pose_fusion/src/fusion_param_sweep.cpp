@@ -0,0 +1,268 @@
+// 离线调参：一次把 bag 中的轮式里程计、雷达位姿和真值读进内存，
+// 对参数网格中的每一组配置用 runReplay 回放，多线程并行，每组都远快于实时
+// 按精度排序输出表格
+// 用法：fusion_param_sweep <bag> [key=value ...]
+//   话题：wo_topic=odom lo_topic=vo truth_topic=/ground_truth/state
+//   网格（逗号分隔多个取值）：odom_noise_xy= odom_noise_yaw= odom_noise_min= lo_cov= lo_cov_scale= history=
+//         smoother_window=（0 为 EKF 后端） smoother_iterations=
+//   其他：threads=0（0 为全部核） sort=xy|yaw|latency top=0（0 为全部）
+// 没有真值话题时以雷达位姿作为参考，此时 RMSE 含雷达自身噪声
+#include "ekf_pose_fusion/fusion_replay.hpp"
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace estimation;
+
+static std::vector<double> parseList(const std::string &s)
+{
+    std::vector<double> v;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            v.push_back(atof(item.c_str()));
+    return v;
+}
+
+// PoseWithCovariance 的 6 维协方差取 x y yaw
+static Eigen::Matrix3d downDim(const boost::array<double, 36UL> &c)
+{
+    const int idx[3] = {0, 1, 5};
+    Eigen::Matrix3d ret;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            ret(i, j) = c[6 * idx[i] + idx[j]];
+    return ret;
+}
+
+static Eigen::Vector3d poseToVec(const geometry_msgs::Pose &p)
+{
+    Eigen::Vector3d v(p.position.x, p.position.y, tf::getYaw(p.orientation));
+    return v;
+}
+
+struct SweepRow
+{
+    ReplayConfig cfg;
+    ReplayResult res;
+};
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <bag> [key=value ...]\n", argv[0]);
+        return 1;
+    }
+    std::map<std::string, std::string> args;
+    args["wo_topic"] = "odom";
+    args["lo_topic"] = "vo";
+    args["truth_topic"] = "/ground_truth/state";
+    args["threads"] = "0";
+    args["sort"] = "xy";
+    args["top"] = "0";
+    ReplayConfig def;
+    std::map<std::string, std::vector<double>> grid;
+    grid["odom_noise_xy"] = std::vector<double>(1, def.odom_noise_xy);
+    grid["odom_noise_yaw"] = std::vector<double>(1, def.odom_noise_yaw);
+    grid["odom_noise_min"] = std::vector<double>(1, def.odom_noise_min);
+    grid["lo_cov"] = std::vector<double>(1, def.lo_cov);
+    grid["lo_cov_scale"] = std::vector<double>(1, def.lo_cov_scale);
+    grid["history"] = std::vector<double>(1, def.history);
+    grid["smoother_window"] = std::vector<double>(1, def.smoother_window);
+    grid["smoother_iterations"] = std::vector<double>(1, def.smoother_iterations);
+    for (int i = 2; i < argc; ++i)
+    {
+        const char *eq = strchr(argv[i], '=');
+        if (!eq)
+        {
+            fprintf(stderr, "ignored argument: %s\n", argv[i]);
+            continue;
+        }
+        std::string key(argv[i], eq - argv[i]);
+        if (grid.count(key))
+            grid[key] = parseList(eq + 1);
+        else if (args.count(key))
+            args[key] = eq + 1;
+        else
+            fprintf(stderr, "ignored argument: %s\n", argv[i]);
+    }
+
+    // BR_transformer 构造时读私有参数，没有 master 时很快失败并使用默认值
+    ros::init(argc, argv, "fusion_param_sweep", ros::init_options::NoSigintHandler | ros::init_options::AnonymousName);
+    ros::master::setRetryTimeout(ros::WallDuration(0.1));
+    ros::Time::init();
+
+    // 读 bag，一次进内存；以录制时刻作为到达时刻，保留真实的延迟与乱序
+    std::vector<ReplayEvent> events;
+    ReplayTruth truth, lidar_ref;
+    {
+        rosbag::Bag bag;
+        try
+        {
+            bag.open(argv[1], rosbag::bagmode::Read);
+        }
+        catch (rosbag::BagException &ex)
+        {
+            fprintf(stderr, "cannot open %s: %s\n", argv[1], ex.what());
+            return 1;
+        }
+        std::vector<std::string> topics;
+        topics.push_back(args["wo_topic"]);
+        topics.push_back(args["lo_topic"]);
+        topics.push_back(args["truth_topic"]);
+        rosbag::View view(bag, rosbag::TopicQuery(topics));
+        for (rosbag::View::iterator it = view.begin(); it != view.end(); ++it)
+        {
+            const rosbag::MessageInstance &m = *it;
+            ReplayEvent e;
+            e.arrival = m.getTime().toSec();
+            e.cov.setZero();
+            if (m.getTopic() == args["truth_topic"])
+            {
+                nav_msgs::Odometry::ConstPtr odom = m.instantiate<nav_msgs::Odometry>();
+                if (odom)
+                {
+                    truth.stamp.push_back(odom->header.stamp);
+                    truth.pose.push_back(poseToVec(odom->pose.pose));
+                }
+            }
+            else if (m.getTopic() == args["wo_topic"])
+            {
+                nav_msgs::Odometry::ConstPtr odom = m.instantiate<nav_msgs::Odometry>();
+                if (!odom)
+                    continue;
+                e.stamp = odom->header.stamp;
+                e.lidar = false;
+                e.value = poseToVec(odom->pose.pose);
+                events.push_back(e);
+            }
+            else
+            {
+                geometry_msgs::PoseWithCovarianceStamped::ConstPtr lo = m.instantiate<geometry_msgs::PoseWithCovarianceStamped>();
+                if (!lo)
+                    continue;
+                e.stamp = lo->header.stamp;
+                e.lidar = true;
+                e.value = poseToVec(lo->pose.pose);
+                e.cov = downDim(lo->pose.covariance);
+                events.push_back(e);
+                lidar_ref.stamp.push_back(e.stamp);
+                lidar_ref.pose.push_back(e.value);
+            }
+        }
+    }
+    std::stable_sort(events.begin(), events.end());
+    if (truth.stamp.empty())
+    {
+        fprintf(stderr, "no ground truth on %s, using lidar poses as reference\n", args["truth_topic"].c_str());
+        truth = lidar_ref;
+    }
+    // 真值按时间戳排序，录制顺序不一定单调
+    {
+        std::vector<size_t> order(truth.stamp.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return truth.stamp[a] < truth.stamp[b]; });
+        ReplayTruth sorted;
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            sorted.stamp.push_back(truth.stamp[order[i]]);
+            sorted.pose.push_back(truth.pose[order[i]]);
+        }
+        truth = sorted;
+    }
+    if (events.empty())
+    {
+        fprintf(stderr, "no odometry or lidar messages found\n");
+        return 1;
+    }
+    double duration = events.back().arrival - events.front().arrival;
+
+    // 参数网格的笛卡尔积
+    std::vector<SweepRow> rows(1);
+    const char *keys[] = {"odom_noise_xy", "odom_noise_yaw", "odom_noise_min", "lo_cov", "lo_cov_scale", "history", "smoother_window", "smoother_iterations"};
+    for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); ++k)
+    {
+        const std::vector<double> &vals = grid[keys[k]];
+        if (vals.empty())
+            continue;
+        std::vector<SweepRow> next;
+        for (size_t r = 0; r < rows.size(); ++r)
+            for (size_t v = 0; v < vals.size(); ++v)
+            {
+                SweepRow row = rows[r];
+                ReplayConfig &c = row.cfg;
+                switch (k)
+                {
+                case 0: c.odom_noise_xy = vals[v]; break;
+                case 1: c.odom_noise_yaw = vals[v]; break;
+                case 2: c.odom_noise_min = vals[v]; break;
+                case 3: c.lo_cov = vals[v]; break;
+                case 4: c.lo_cov_scale = vals[v]; break;
+                case 5: c.history = int(vals[v]); break;
+                case 6: c.smoother_window = int(vals[v]); break;
+                case 7: c.smoother_iterations = int(vals[v]); break;
+                }
+                next.push_back(row);
+            }
+        rows.swap(next);
+    }
+
+    // 每个工作线程一个 transformer，在主线程构造；配置按原子计数领取
+    unsigned int threads = atoi(args["threads"].c_str());
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads, rows.size());
+    std::vector<std::unique_ptr<BR_transformer>> transformers;
+    for (unsigned int t = 0; t < threads; ++t)
+        transformers.emplace_back(new BR_transformer());
+
+    printf("%zu events (%.1f s), %zu truth samples, %zu configurations on %u threads\n",
+           events.size(), duration, truth.stamp.size(), rows.size(), threads);
+    std::atomic<size_t> next_row(0);
+    std::vector<std::thread> workers;
+    auto wall0 = std::chrono::steady_clock::now();
+    for (unsigned int t = 0; t < threads; ++t)
+        workers.emplace_back([&, t]() {
+            for (size_t r = next_row++; r < rows.size(); r = next_row++)
+                rows[r].res = runReplay(events, truth, rows[r].cfg, *transformers[t]);
+        });
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+
+    std::string sort = args["sort"];
+    std::stable_sort(rows.begin(), rows.end(), [&](const SweepRow &a, const SweepRow &b) {
+        if (sort == "yaw")
+            return a.res.rmse_yaw < b.res.rmse_yaw;
+        if (sort == "latency")
+            return a.res.odom_p99_us + a.res.lidar_p99_us < b.res.odom_p99_us + b.res.lidar_p99_us;
+        return a.res.rmse_xy < b.res.rmse_xy;
+    });
+
+    printf("%-4s %-10s %-10s %-10s %-10s %-8s %-7s %-7s | %-9s %-9s %-9s %-9s %-9s %-7s %-6s\n",
+           "rank", "noise_xy", "noise_yaw", "noise_min", "lo_cov", "lo_scale", "history", "window",
+           "rmse_xy", "rmse_yaw", "max_xy", "odom_p99", "lidar_p99", "reject", "x_rt");
+    size_t top = atoi(args["top"].c_str());
+    for (size_t r = 0; r < rows.size() && (top == 0 || r < top); ++r)
+    {
+        const ReplayConfig &c = rows[r].cfg;
+        const ReplayResult &s = rows[r].res;
+        printf("%-4zu %-10.3g %-10.3g %-10.3g %-10.3g %-8.3g %-7d %-7d | %-9.4f %-9.4f %-9.4f %-9.2f %-9.2f %-7zu %-6.0f\n",
+               r + 1, c.odom_noise_xy, c.odom_noise_yaw, c.odom_noise_min, c.lo_cov, c.lo_cov_scale, c.history, c.smoother_window,
+               s.rmse_xy, s.rmse_yaw, s.max_xy, s.odom_p99_us, s.lidar_p99_us, s.rejected, s.wall > 0 ? duration / s.wall : 0.0);
+    }
+    printf("total wall %.2f s\n", wall);
+    return 0;
+}
@@ -0,0 +1,104 @@
+// uncertain_tf 采样开销：BatchNormalSampler 与原 EigenMultivariateNormal 的 6 维采样，
+// 以及 UncertainTransformListener 在一条三环节链上的 sampleTransform / sampleTransformUniformTime / unscentedTransform
+// 用法：utf_sample_bench [samples=1000] [rounds=200]
+// 链直接用 setTransform / setCovariance 填入，不需要别的节点发 tf；监听器会订阅 /tf_uncertainty，需要 roscore
+#include "ekf_pose_fusion/UncertainTransformListener.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace uncertain_tf;
+typedef std::chrono::steady_clock bench_clock;
+
+template <class F>
+static double run(int rounds, F &&body)
+{
+    body(); // 预热：建线程、填因子缓存
+    auto t0 = bench_clock::now();
+    for (int i = 0; i < rounds; ++i)
+        body();
+    auto t1 = bench_clock::now();
+    return std::chrono::duration<double, std::micro>(t1 - t0).count() / rounds;
+}
+
+static void addLink(UncertainTransformListener &utf, const std::string &parent, const std::string &child,
+                    const tf::Transform &t, const Eigen::Matrix<double, 6, 1> &var)
+{
+    for (int s = 0; s <= 10; ++s)
+    {
+        ros::Time stamp(100.0 + s * 0.1);
+        utf.setTransform(tf::StampedTransform(t, stamp, parent, child), "utf_sample_bench");
+        utf.setCovariance(StampedCovariance(MatrixXd(var.asDiagonal()), stamp, child));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "utf_sample_bench");
+    int n = argc > 1 ? atoi(argv[1]) : 1000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    if (n <= 0)
+        n = 1000;
+    if (rounds <= 0)
+        rounds = 200;
+
+    Eigen::Matrix<double, 6, 1> var;
+    var << 0.01, 0.01, 0.0025, 0.004, 0.001, 0.001;
+    Eigen::Matrix<double, 6, 6> cov = var.asDiagonal();
+    Eigen::Matrix<double, 6, 1> mean = Eigen::Matrix<double, 6, 1>::Zero();
+
+    printf("%d samples, %d rounds\n", n, rounds);
+
+    // 原来的路径：每次调用新建 EigenMultivariateNormal（含一次特征分解），逐个取样本
+    Eigen::Matrix<double, 6, 1> s;
+    double t_old = run(rounds, [&] {
+        EigenMultivariateNormal<double, 6> normX(mean, cov);
+        for (int k = 0; k < n; ++k)
+            normX.nextSample(s);
+    });
+    BatchNormalSampler<6> sampler;
+    BatchNormalSampler<6>::Samples out;
+    double t_batch = run(rounds, [&] { sampler.sample(mean, cov, n, out); });
+    printf("%-34s %10.1f us\n", "EigenMultivariateNormal", t_old);
+    printf("%-34s %10.1f us\n", "BatchNormalSampler", t_batch);
+
+    // map -> odom -> base_link -> laser，每个环节都带协方差
+    UncertainTransformListener utf;
+    tf::Transform t;
+    t.setOrigin(tf::Vector3(1.0, 2.0, 0.0));
+    t.setRotation(tf::createQuaternionFromYaw(0.3));
+    addLink(utf, "map", "odom", t, var);
+    t.setOrigin(tf::Vector3(0.5, -0.2, 0.0));
+    t.setRotation(tf::createQuaternionFromYaw(-0.7));
+    addLink(utf, "odom", "base_link", t, var);
+    t.setOrigin(tf::Vector3(0.2, 0.0, 0.3));
+    t.setRotation(tf::createQuaternionFromYaw(3.1));
+    addLink(utf, "base_link", "laser", t, var * 0.1);
+
+    ros::Time when(100.5), from(100.1), to(100.9);
+    std::vector<tf::StampedTransform> samples;
+    samples.reserve(n);
+    unsigned int hw = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int thread_counts[2] = {1, hw};
+    for (int i = 0; i < (hw > 1 ? 2 : 1); ++i)
+    {
+        utf.setNumThreads(thread_counts[i]);
+        double t_fixed = run(rounds, [&] {
+            samples.clear();
+            utf.sampleTransform("map", "laser", when, samples, n);
+        });
+        double t_uniform = run(rounds, [&] {
+            samples.clear();
+            utf.sampleTransformUniformTime("map", "laser", from, to, samples, n);
+        });
+        printf("threads %-2u %-23s %10.1f us (%zu samples)\n", thread_counts[i], "sampleTransform", t_fixed, samples.size());
+        printf("threads %-2u %-23s %10.1f us\n", thread_counts[i], "sampleTransformUniformTime", t_uniform);
+    }
+
+    tf::StampedTransform ut_mean;
+    MatrixXd ut_cov;
+    double t_ut = run(rounds, [&] { utf.unscentedTransform("map", "laser", when, ut_mean, ut_cov); });
+    printf("%-34s %10.1f us\n", "unscentedTransform", t_ut);
+    return 0;
+}
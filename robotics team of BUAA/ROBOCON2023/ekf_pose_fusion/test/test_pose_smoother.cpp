@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include "ekf_pose_fusion/pose_smoother.hpp"
+
+using namespace estimation;
+
+namespace
+{
+    // 边走边转的轨迹，t = 0..4 s 每秒一帧；里程计带漂移，雷达量测在真值上加固定偏差
+    struct Track
+    {
+        ros::Time stamp[5];
+        SE2 o2b[5];
+        Eigen::Vector3d z[5];
+        Eigen::Matrix3d R;
+
+        Track()
+        {
+            const double dz[5][3] = {{0, 0, 0}, {0.02, -0.01, 0.01}, {-0.03, 0.02, -0.02}, {0.01, 0.03, 0.015}, {-0.02, -0.02, 0.0}};
+            for (int i = 0; i < 5; ++i)
+            {
+                stamp[i] = ros::Time(100.0 + i);
+                Eigen::Vector3d truth(0.8 * i, 0.1 * i * i, 0.3 * i);
+                o2b[i] = SE2(1.05 * truth(0), 1.05 * truth(1), 0.98 * truth(2));
+                z[i] = truth + Eigen::Vector3d(dz[i][0], dz[i][1], dz[i][2]);
+            }
+            R = Eigen::Vector3d(0.01, 0.01, 0.004).asDiagonal();
+        }
+    };
+
+    SlidingWindowSmoother makeSmoother(const Track &t)
+    {
+        SlidingWindowSmoother s;
+        s.options.max_iterations = 50;
+        s.options.tolerance = 1e-12;
+        s.reset(t.stamp[0], t.o2b[0], t.z[0], t.R);
+        return s;
+    }
+
+    void expectSame(const SlidingWindowSmoother &a, const SlidingWindowSmoother &b)
+    {
+        ASSERT_EQ(a.size(), b.size());
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            EXPECT_EQ(a.node(i).stamp, b.node(i).stamp);
+            EXPECT_LT((a.node(i).x - b.node(i).x).cwiseAbs().maxCoeff(), 1e-8) << "node " << i;
+            EXPECT_LT((a.node(i).P - b.node(i).P).cwiseAbs().maxCoeff(), 1e-8) << "node " << i;
+            EXPECT_LT((a.node(i).slip - b.node(i).slip).cwiseAbs().maxCoeff(), 1e-12) << "node " << i;
+        }
+    }
+}
+
+TEST(SlidingWindowSmoother, OutOfOrderMatchesInOrder)
+{
+    Track t;
+    SlidingWindowSmoother in_order = makeSmoother(t), out_of_order = makeSmoother(t);
+    for (int i = 1; i < 5; ++i)
+        in_order.add(t.stamp[i], t.o2b[i], t.z[i], t.R);
+    out_of_order.add(t.stamp[1], t.o2b[1], t.z[1], t.R);
+    out_of_order.add(t.stamp[3], t.o2b[3], t.z[3], t.R);
+    out_of_order.add(t.stamp[4], t.o2b[4], t.z[4], t.R);
+    out_of_order.add(t.stamp[2], t.o2b[2], t.z[2], t.R);
+    expectSame(in_order, out_of_order);
+}
+
+TEST(SlidingWindowSmoother, OutOfOrderSplitsSlip)
+{
+    // 1 -> 3 整段判定打滑后，2 才到：打滑协方差应拆到 1 -> 2、2 -> 3 两段，
+    // 与按顺序到达时两段各自带上对应部分的结果相同
+    Track t;
+    Eigen::Matrix3d slip;
+    slip << 0.04, 0.01, 0.0, 0.01, 0.02, 0.0, 0.0, 0.0, 0.01;
+
+    SlidingWindowSmoother out_of_order = makeSmoother(t);
+    out_of_order.add(t.stamp[1], t.o2b[1], t.z[1], t.R);
+    out_of_order.add(t.stamp[3], t.o2b[3], t.z[3], t.R, slip);
+    out_of_order.add(t.stamp[2], t.o2b[2], t.z[2], t.R);
+    out_of_order.add(t.stamp[4], t.o2b[4], t.z[4], t.R);
+
+    // 2 在 1、3 正中：前半段在节点 1 系下，后半段转到节点 2 系下
+    Eigen::Matrix3d J = Eigen::Matrix3d::Identity();
+    J.topLeftCorner<2, 2>() = Eigen::Rotation2Dd(-t.o2b[1].between(t.o2b[2]).yaw()).toRotationMatrix();
+    SlidingWindowSmoother in_order = makeSmoother(t);
+    in_order.add(t.stamp[1], t.o2b[1], t.z[1], t.R);
+    in_order.add(t.stamp[2], t.o2b[2], t.z[2], t.R, 0.5 * slip);
+    in_order.add(t.stamp[3], t.o2b[3], t.z[3], t.R, 0.5 * J * slip * J.transpose());
+    in_order.add(t.stamp[4], t.o2b[4], t.z[4], t.R);
+
+    expectSame(in_order, out_of_order);
+}
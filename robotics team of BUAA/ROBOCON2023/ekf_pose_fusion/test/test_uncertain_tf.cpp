@@ -0,0 +1,136 @@
+// UncertainTransformListener：按时刻并行采样、采样时并发写入协方差，以及无迹变换与蒙特卡洛采样的一致性
+// 链直接用 setTransform / setCovariance 填入；监听器会订阅 /tf_uncertainty，所以走 rostest
+#include <gtest/gtest.h>
+#include "ekf_pose_fusion/UncertainTransformListener.h"
+#include <atomic>
+#include <thread>
+
+using namespace uncertain_tf;
+
+class UncertainTfTest : public testing::Test
+{
+protected:
+    typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+    // map -> odom -> base_link，变换和协方差在 [100, 101] s 上每 0.1 s 一帧
+    void SetUp() override
+    {
+        Vector6d var;
+        var << 0.01, 0.01, 0.0025, 0.004, 0.001, 0.001;
+        tf::Transform t;
+        t.setOrigin(tf::Vector3(1.0, 2.0, 0.0));
+        t.setRotation(tf::createQuaternionFromYaw(0.3));
+        addLink("map", "odom", t, var);
+        t.setOrigin(tf::Vector3(0.5, -0.2, 0.1));
+        t.setRotation(tf::createQuaternionFromYaw(-0.7));
+        addLink("odom", "base_link", t, var);
+    }
+
+    void addLink(const std::string &parent, const std::string &child, const tf::Transform &t, const Vector6d &var)
+    {
+        for (int s = 0; s <= 10; ++s)
+        {
+            ros::Time stamp(100.0 + s * 0.1);
+            utf_.setTransform(tf::StampedTransform(t, stamp, parent, child), "test_uncertain_tf");
+            utf_.setCovariance(StampedCovariance(MatrixXd(var.asDiagonal()), stamp, child));
+        }
+    }
+
+    UncertainTransformListener utf_;
+};
+
+TEST_F(UncertainTfTest, UniformTimeKeepsOrderAcrossThreads)
+{
+    const size_t n = 1000;
+    ros::Time from(100.1), to(100.9);
+    tf::StampedTransform mean;
+    utf_.lookupTransform("map", "base_link", ros::Time(100.5), mean);
+
+    utf_.setNumThreads(4);
+    std::vector<tf::StampedTransform> samples;
+    utf_.sampleTransformUniformTime("map", "base_link", from, to, samples, n);
+    ASSERT_EQ(n, samples.size());
+
+    double step = (to - from).toSec() / n;
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    for (size_t k = 0; k < n; ++k)
+    {
+        EXPECT_NEAR(from.toSec() + k * step, samples[k].stamp_.toSec(), 1e-6);
+        EXPECT_EQ("map", samples[k].frame_id_);
+        sum += Eigen::Vector3d(samples[k].getOrigin().x(), samples[k].getOrigin().y(), samples[k].getOrigin().z());
+    }
+    // 链是静止的，样本均值应落在均值变换附近（两环节、每维标准差 0.1 左右）
+    sum /= n;
+    EXPECT_NEAR(mean.getOrigin().x(), sum.x(), 0.03);
+    EXPECT_NEAR(mean.getOrigin().y(), sum.y(), 0.03);
+    EXPECT_NEAR(mean.getOrigin().z(), sum.z(), 0.03);
+}
+
+TEST_F(UncertainTfTest, UniformTimeSkipsUnknownTimes)
+{
+    // 后一半时刻在缓存之外，查链失败的时刻跳过，不影响其余样本
+    utf_.setNumThreads(4);
+    std::vector<tf::StampedTransform> samples;
+    utf_.sampleTransformUniformTime("map", "base_link", ros::Time(100.5), ros::Time(101.5), samples, 400);
+    ASSERT_EQ(201u, samples.size());
+    EXPECT_LE(samples.back().stamp_.toSec(), 101.0 + 1e-9);
+}
+
+TEST_F(UncertainTfTest, SamplingWhileCovariancesArrive)
+{
+    // 回调线程不断为新坐标系写协方差（covariances_ 会扩容），同时并行采样
+    utf_.setNumThreads(4);
+    std::atomic<bool> stop(false);
+    std::thread writer([&] {
+        Vector6d var = Vector6d::Constant(0.01);
+        for (int i = 0; !stop; ++i)
+        {
+            std::string frame = "extra_" + std::to_string(i % 64);
+            utf_.setCovariance(StampedCovariance(MatrixXd(var.asDiagonal()), ros::Time(100.0 + (i % 10) * 0.1), frame));
+            utf_.setCovariance(StampedCovariance(MatrixXd(var.asDiagonal()), ros::Time(100.5), "odom"));
+        }
+    });
+    for (int round = 0; round < 20; ++round)
+    {
+        std::vector<tf::StampedTransform> samples;
+        utf_.sampleTransformUniformTime("map", "base_link", ros::Time(100.1), ros::Time(100.9), samples, 512);
+        EXPECT_EQ(512u, samples.size());
+    }
+    stop = true;
+    writer.join();
+}
+
+TEST_F(UncertainTfTest, UnscentedMatchesMonteCarlo)
+{
+    // 两环节链上，无迹变换的均值和协方差应与大量蒙特卡洛样本的统计量一致
+    ros::Time when(100.5);
+    tf::StampedTransform ut_mean;
+    MatrixXd ut_cov;
+    ASSERT_TRUE(utf_.unscentedTransform("map", "base_link", when, ut_mean, ut_cov));
+    EXPECT_EQ("map", ut_mean.frame_id_);
+
+    const size_t n = 20000;
+    std::vector<tf::StampedTransform> samples;
+    utf_.sampleTransform("map", "base_link", when, samples, n);
+    ASSERT_EQ(n, samples.size());
+    MatrixXd x = utf_.sampleSetTFtoMatrixXd(samples);
+    Eigen::VectorXd mc_mean = utf_.calculateSampleMean(x);
+    MatrixXd mc_cov;
+    utf_.calculateSampleCovariance(x, x, mc_cov);
+
+    Eigen::VectorXd m = utf_.transformTFToVectorXd(ut_mean);
+    for (int i = 0; i < 6; ++i)
+    {
+        double sd = sqrt(mc_cov(i, i));
+        EXPECT_NEAR(mc_mean(i), m(i), 4 * sd / sqrt(double(n)) + 1e-3) << "mean " << i;
+        for (int j = 0; j < 6; ++j)
+            EXPECT_NEAR(mc_cov(i, j), ut_cov(i, j), 0.1 * sqrt(mc_cov(i, i) * mc_cov(j, j)) + 1e-6) << "cov " << i << "," << j;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    ros::init(argc, argv, "test_uncertain_tf");
+    return RUN_ALL_TESTS();
+}
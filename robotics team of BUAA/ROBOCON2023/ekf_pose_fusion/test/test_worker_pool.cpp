@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include "ekf_pose_fusion/worker_pool.hpp"
+#include <stdexcept>
+#include <thread>
+
+using uncertain_tf::WorkerPool;
+
+TEST(WorkerPool, CoversRangeOnce)
+{
+    WorkerPool pool(4);
+    for (size_t n : {1, 7, 256, 10000})
+    {
+        std::vector<std::atomic<int>> hits(n);
+        pool.run(n, 4, [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i)
+                ++hits[i];
+        });
+        for (size_t i = 0; i < n; ++i)
+            ASSERT_EQ(1, hits[i]) << "n " << n << " i " << i;
+    }
+}
+
+TEST(WorkerPool, RethrowsAfterAllChunks)
+{
+    // 任一块抛出都不能在工作线程里 terminate，其余块照常执行完，调用线程收到异常
+    WorkerPool pool(4);
+    std::atomic<size_t> done(0);
+    EXPECT_THROW(pool.run(1000, 8, [&](size_t b, size_t e) {
+        if (b == 0)
+            throw std::runtime_error("chunk 0");
+        done += e - b;
+    }),
+                 std::runtime_error);
+    EXPECT_EQ(1000u - 125u, done.load());
+
+    // 之后还能正常使用
+    std::atomic<size_t> total(0);
+    pool.run(1000, 8, [&](size_t b, size_t e) { total += e - b; });
+    EXPECT_EQ(1000u, total.load());
+}
+
+TEST(WorkerPool, NestedRunIsSerial)
+{
+    WorkerPool pool(4);
+    std::atomic<size_t> total(0);
+    pool.run(64, 4, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i)
+            pool.run(10, 4, [&](size_t ib, size_t ie) { total += ie - ib; });
+    });
+    EXPECT_EQ(640u, total.load());
+}
+
+TEST(WorkerPool, ConcurrentCallers)
+{
+    WorkerPool pool(3);
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> callers;
+    for (int c = 0; c < 4; ++c)
+        callers.emplace_back([&] {
+            for (int r = 0; r < 200; ++r)
+                pool.run(100, 3, [&](size_t b, size_t e) { total += e - b; });
+        });
+    for (size_t c = 0; c < callers.size(); ++c)
+        callers[c].join();
+    EXPECT_EQ(4u * 200u * 100u, total.load());
+}
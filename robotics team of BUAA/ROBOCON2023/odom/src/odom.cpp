@@ -59,10 +59,8 @@ bool serial_init()
 
 double intergrate_angle(double angle)
 {
-    //角度归一化
-    while(angle>PI*2){angle-=PI*2;}
-    while(angle<0){angle+=PI*2;}
-    return angle;
+    //角度归一化到 [0, 2PI)，常数时间，串口数据错乱时也不会卡在循环里
+    return angle - PI * 2 * floor(angle / (PI * 2));
 }
 void TFpub(ros::Publisher &pub)
 {